@@ -0,0 +1,36 @@
+#include "src/binlog.h"
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// 把二进制日志还原成文本
+// 用法: cool-logcat [-p pattern] file...
+int main(int argc, char *argv[]) {
+  std::string pattern = "%d{%Y-%m-%d %H:%M:%S} %t(%N):%F [%p] [%c] %f:%l %m %n";
+  int opt = 0;
+  while ((opt = getopt(argc, argv, "p:")) != -1) {
+    if (opt == 'p') {
+      pattern = optarg;
+    } else {
+      std::cerr << "usage: " << argv[0] << " [-p pattern] file..." << std::endl;
+      return 1;
+    }
+  }
+  if (optind >= argc) {
+    std::cerr << "usage: " << argv[0] << " [-p pattern] file..." << std::endl;
+    return 1;
+  }
+  cool::BinLogReader reader(pattern);
+  for (int i = optind; i < argc; ++i) {
+    if (!reader.open(argv[i])) {
+      std::cerr << "open " << argv[i] << " failed" << std::endl;
+      return 1;
+    }
+    std::string line;
+    while (reader.next(line)) {
+      fwrite(line.data(), 1, line.size(), stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,501 @@
+#include "binlog.h"
+#include "config.h"
+#include "util.h"
+#include <atomic>
+#include <climits>
+#include <chrono>
+#include <condition_variable>
+#include <fcntl.h>
+#include <list>
+#include <mutex>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace cool {
+
+static ConfigVar<std::string>::ptr g_binlog_file = Config::lookup(
+    "log.binary.file", std::string(""), "binary log file, empty to disable");
+static ConfigVar<uint32_t>::ptr g_binlog_buffer_size =
+    Config::lookup("log.binary.buffer_size", (uint32_t)(64 * 1024),
+                   "per thread binary log buffer size");
+static ConfigVar<uint32_t>::ptr g_binlog_flush_interval =
+    Config::lookup("log.binary.flush_interval", (uint32_t)1000,
+                   "binary log flush interval ms");
+
+const char *BinLog::MAGIC = "COOLBLG1";
+
+namespace {
+
+// 一个线程的缓冲区, 只有这个线程写入, 后台线程取走时加锁
+struct BinLogBuffer {
+  SpinLock mutex;
+  uint32_t thread_id;
+  std::string thread_name;
+  ByteArray *data;
+  // 写满之后等待后台线程取走的数据, 按顺序写出
+  std::list<ByteArray *> full;
+};
+
+struct BinLogSite {
+  std::string logger;
+  LogLevel::Level level;
+  std::string file;
+  uint32_t line;
+  std::string fmt;
+  std::string types;
+};
+
+class BinLogWriter {
+public:
+  using MutexType = Mutex;
+  struct Chunk {
+    uint32_t thread_id;
+    std::string thread_name;
+    ByteArray *data;
+  };
+
+  // 不析构, 进程退出时由atexit写出剩下的日志
+  static BinLogWriter *GetInstance() {
+    static BinLogWriter *s_writer = new BinLogWriter;
+    return s_writer;
+  }
+
+  bool open(const std::string &file);
+  bool enabled() const { return m_fd >= 0; }
+  uint32_t registerSite(const BinLogSite &site);
+  BinLogBuffer *newBuffer();
+  // 线程退出时把剩下的数据交给后台线程
+  void closeBuffer(BinLogBuffer *buffer);
+  void notify() { m_cond.notify_one(); }
+  void drain();
+
+private:
+  BinLogWriter() {}
+  // 需要持有m_drainMutex
+  void drainLocked();
+  void run();
+  static void WriteChunk(int fd, const Chunk &chunk);
+  static void Stop();
+
+private:
+  // 保护m_buffers, m_orphans, m_sites
+  MutexType m_mutex;
+  std::list<BinLogBuffer *> m_buffers;
+  // 已经退出的线程留下的数据
+  std::vector<Chunk> m_orphans;
+  std::vector<BinLogSite> m_sites;
+  // 当前文件已经写了多少个调用点
+  size_t m_sitesWritten = 0;
+
+  MutexType m_drainMutex;
+  std::atomic<int> m_fd = {-1};
+  std::mutex m_waitMutex;
+  std::condition_variable m_cond;
+  Thread::ptr m_thread;
+  std::atomic<bool> m_stop = {false};
+};
+
+static void write_all(int fd, std::vector<iovec> &iovs) {
+  size_t i = 0;
+  while (i < iovs.size()) {
+    ssize_t n = ::writev(fd, &iovs[i], std::min(iovs.size() - i, (size_t)IOV_MAX));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    while (n > 0 && i < iovs.size()) {
+      if ((size_t)n >= iovs[i].iov_len) {
+        n -= iovs[i].iov_len;
+        ++i;
+      } else {
+        iovs[i].iov_base = (char *)iovs[i].iov_base + n;
+        iovs[i].iov_len -= n;
+        n = 0;
+      }
+    }
+  }
+}
+
+static void write_bytes(int fd, ByteArray &ba) {
+  ba.position(0);
+  std::vector<iovec> iovs;
+  ba.getReadBuffers(iovs);
+  write_all(fd, iovs);
+}
+
+bool BinLogWriter::open(const std::string &file) {
+  MutexType::Lock lock(m_drainMutex);
+  int old = m_fd;
+  if (old >= 0) {
+    drainLocked();
+  }
+  int fd = -1;
+  if (!file.empty()) {
+    fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      std::cout << "binary log open error: " << file << " errno=" << errno
+                << " " << strerror(errno) << std::endl;
+      return false;
+    }
+    ByteArray ba;
+    ba.write(BinLog::MAGIC, strlen(BinLog::MAGIC));
+    write_bytes(fd, ba);
+  }
+  {
+    MutexType::Lock lock2(m_mutex);
+    m_sitesWritten = 0;
+    if (!m_thread && fd >= 0) {
+      m_thread.reset(
+          new Thread(std::bind(&BinLogWriter::run, this), "log_binary"));
+      atexit(&BinLogWriter::Stop);
+    }
+  }
+  m_fd = fd;
+  if (old >= 0) {
+    ::close(old);
+  }
+  return true;
+}
+
+uint32_t BinLogWriter::registerSite(const BinLogSite &site) {
+  MutexType::Lock lock(m_mutex);
+  m_sites.push_back(site);
+  return m_sites.size() - 1;
+}
+
+BinLogBuffer *BinLogWriter::newBuffer() {
+  BinLogBuffer *buffer = new BinLogBuffer;
+  buffer->thread_id = thread_id();
+  buffer->thread_name = Thread::GetName();
+  buffer->data = new ByteArray;
+  MutexType::Lock lock(m_mutex);
+  m_buffers.push_back(buffer);
+  return buffer;
+}
+
+void BinLogWriter::closeBuffer(BinLogBuffer *buffer) {
+  MutexType::Lock lock(m_mutex);
+  m_buffers.remove(buffer);
+  buffer->full.push_back(buffer->data);
+  for (auto i : buffer->full) {
+    m_orphans.push_back(Chunk{buffer->thread_id, buffer->thread_name, i});
+  }
+  delete buffer;
+}
+
+void BinLogWriter::drain() {
+  MutexType::Lock lock(m_drainMutex);
+  drainLocked();
+}
+
+void BinLogWriter::drainLocked() {
+  std::vector<Chunk> chunks;
+  ByteArray sites;
+  {
+    MutexType::Lock lock(m_mutex);
+    chunks.swap(m_orphans);
+    for (auto b : m_buffers) {
+      std::list<ByteArray *> full;
+      ByteArray *data = nullptr;
+      {
+        SpinLock::Lock lock2(b->mutex);
+        full.swap(b->full);
+        if (b->data->getSize() > 0) {
+          data = b->data;
+          b->data = new ByteArray;
+        }
+      }
+      for (auto i : full) {
+        chunks.push_back(Chunk{b->thread_id, b->thread_name, i});
+      }
+      if (data) {
+        chunks.push_back(Chunk{b->thread_id, b->thread_name, data});
+      }
+    }
+    // 调用点在使用之前登记, 先写调用点再写日志
+    for (; m_sitesWritten < m_sites.size(); ++m_sitesWritten) {
+      const BinLogSite &s = m_sites[m_sitesWritten];
+      sites.write_fuint8(BinLog::SITE);
+      sites.write_uint32(m_sitesWritten);
+      sites.write_uint32(s.level);
+      sites.write_string_vint(s.logger);
+      sites.write_string_vint(s.file);
+      sites.write_uint32(s.line);
+      sites.write_string_vint(s.fmt);
+      sites.write_string_vint(s.types);
+    }
+  }
+  int fd = m_fd;
+  if (fd >= 0) {
+    write_bytes(fd, sites);
+  }
+  for (auto &i : chunks) {
+    if (fd >= 0) {
+      WriteChunk(fd, i);
+    }
+    delete i.data;
+  }
+}
+
+void BinLogWriter::WriteChunk(int fd, const Chunk &chunk) {
+  ByteArray head(64);
+  head.write_fuint8(BinLog::CHUNK);
+  head.write_uint32(chunk.thread_id);
+  head.write_string_vint(chunk.thread_name);
+  head.position(0);
+  chunk.data->position(0);
+  std::vector<iovec> iovs;
+  head.getReadBuffers(iovs);
+  chunk.data->getReadBuffers(iovs);
+  write_all(fd, iovs);
+}
+
+void BinLogWriter::run() {
+  while (!m_stop) {
+    {
+      std::unique_lock<std::mutex> lock(m_waitMutex);
+      m_cond.wait_for(lock, std::chrono::milliseconds(
+                                g_binlog_flush_interval->get_value()));
+    }
+    drain();
+  }
+}
+
+void BinLogWriter::Stop() {
+  BinLogWriter *writer = GetInstance();
+  writer->m_stop = true;
+  writer->notify();
+  writer->m_thread->join();
+  writer->drain();
+}
+
+struct BinLogBufferHolder {
+  ~BinLogBufferHolder() {
+    if (buffer) {
+      BinLogWriter::GetInstance()->closeBuffer(buffer);
+      buffer = nullptr;
+    }
+  }
+  BinLogBuffer *buffer = nullptr;
+};
+static thread_local BinLogBufferHolder t_binlog_buffer;
+
+struct BinLogIniter {
+  BinLogIniter() {
+    g_binlog_file->add_listener(
+        [](const std::string &old_value, const std::string &new_value) {
+          BinLog::Open(new_value);
+        });
+  }
+};
+static BinLogIniter __binlog_init;
+
+} // namespace
+
+bool BinLog::Open(const std::string &file) {
+  return BinLogWriter::GetInstance()->open(file);
+}
+
+bool BinLog::IsEnabled() { return BinLogWriter::GetInstance()->enabled(); }
+
+void BinLog::Flush() { BinLogWriter::GetInstance()->drain(); }
+
+uint32_t BinLog::Register(const std::string &logger, LogLevel::Level level,
+                          const char *file, uint32_t line, const char *fmt,
+                          const char *types) {
+  return BinLogWriter::GetInstance()->registerSite(
+      BinLogSite{logger, level, file, line, fmt, types});
+}
+
+ByteArray *BinLog::Begin(uint32_t site) {
+  BinLogBuffer *buffer = t_binlog_buffer.buffer;
+  if (!buffer) {
+    buffer = t_binlog_buffer.buffer = BinLogWriter::GetInstance()->newBuffer();
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  buffer->mutex.lock();
+  ByteArray *ba = buffer->data;
+  ba->write_fuint8(EVENT);
+  ba->write_uint32(site);
+  ba->write_uint64(ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+  ba->write_uint32(fiber_id());
+  return ba;
+}
+
+void BinLog::End() {
+  BinLogBuffer *buffer = t_binlog_buffer.buffer;
+  bool full = buffer->data->getSize() >= g_binlog_buffer_size->get_value();
+  if (full) {
+    buffer->full.push_back(buffer->data);
+    buffer->data = new ByteArray;
+  }
+  buffer->mutex.unlock();
+  if (full) {
+    BinLogWriter::GetInstance()->notify();
+  }
+}
+
+// BinLogReader
+BinLogReader::BinLogReader(const std::string &pattern) : m_formatter(pattern) {}
+
+bool BinLogReader::open(const std::string &file) {
+  m_data.clear();
+  if (!m_data.readFromFile(file)) {
+    return false;
+  }
+  m_data.position(0);
+  m_sites.clear();
+  return true;
+}
+
+bool BinLogReader::next(std::string &line) {
+  size_t magic_len = strlen(BinLog::MAGIC);
+  try {
+    while (m_data.getReadSize() > 0) {
+      uint8_t type = m_data.read_fuint8();
+      if (type == (uint8_t)BinLog::MAGIC[0]) {
+        // 同一个文件可能被多次打开追加, 每次都有文件头, 调用点id重新编号
+        std::string magic(magic_len - 1, '\0');
+        m_data.read(&magic[0], magic.size());
+        if (magic != BinLog::MAGIC + 1) {
+          return false;
+        }
+        m_sites.clear();
+      } else if (type == BinLog::SITE) {
+        uint32_t id = m_data.read_uint32();
+        Site site;
+        site.level = (LogLevel::Level)m_data.read_uint32();
+        std::string logger = m_data.read_string_vint();
+        site.file = m_data.read_string_vint();
+        site.line = m_data.read_uint32();
+        site.fmt = m_data.read_string_vint();
+        site.types = m_data.read_string_vint();
+        auto &l = m_loggers[logger];
+        if (!l) {
+          l.reset(new Logger(logger));
+        }
+        site.logger = l;
+        if (id >= m_sites.size()) {
+          m_sites.resize(id + 1);
+        }
+        m_sites[id] = site;
+      } else if (type == BinLog::CHUNK) {
+        m_threadId = m_data.read_uint32();
+        m_threadName = m_data.read_string_vint();
+      } else if (type == BinLog::EVENT) {
+        uint32_t id = m_data.read_uint32();
+        uint64_t us = m_data.read_uint64();
+        uint32_t fiber_id = m_data.read_uint32();
+        if (id >= m_sites.size() || !m_sites[id].logger) {
+          return false;
+        }
+        const Site &site = m_sites[id];
+        LogEvent::ptr event(new LogEvent(site.logger.get(), site.level,
+                                         site.file.c_str(), site.line, 0,
+                                         m_threadId, m_threadName, fiber_id,
+                                         us / 1000000));
+        event->get_ss() << render(site);
+        line = m_formatter.format(event);
+        return true;
+      } else {
+        return false;
+      }
+    }
+  } catch (std::out_of_range &) {
+    // 最后一条没有写完整
+  }
+  return false;
+}
+
+// 按printf的格式串把参数还原, 整数统一按64位输出
+std::string BinLogReader::render(const Site &site) {
+  std::string out;
+  const std::string &fmt = site.fmt;
+  size_t arg = 0;
+  char buf[512];
+  for (size_t i = 0; i < fmt.size(); ++i) {
+    if (fmt[i] != '%') {
+      out.push_back(fmt[i]);
+      continue;
+    }
+    if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+      out.push_back('%');
+      ++i;
+      continue;
+    }
+    // %[flags][width][.precision][length]conversion
+    size_t j = i + 1;
+    std::string spec = "%";
+    while (j < fmt.size() && strchr("-+ #0123456789.", fmt[j])) {
+      spec.push_back(fmt[j++]);
+    }
+    while (j < fmt.size() && strchr("hlLqjzt", fmt[j])) {
+      ++j;
+    }
+    if (j >= fmt.size() || arg >= site.types.size()) {
+      out.append(fmt, i, std::string::npos);
+      break;
+    }
+    char conv = fmt[j];
+    char type = site.types[arg++];
+    int n = 0;
+    if (type == 'i') {
+      int64_t v = m_data.read_int64();
+      if (conv == 'c') {
+        n = snprintf(buf, sizeof(buf), (spec + conv).c_str(), (int)v);
+      } else if (strchr("diouxX", conv)) {
+        n = snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(),
+                     (long long)v);
+      } else {
+        n = snprintf(buf, sizeof(buf), "%lld", (long long)v);
+      }
+    } else if (type == 'u') {
+      uint64_t v = m_data.read_uint64();
+      if (conv == 'c') {
+        n = snprintf(buf, sizeof(buf), (spec + conv).c_str(), (int)v);
+      } else if (strchr("diouxX", conv)) {
+        n = snprintf(buf, sizeof(buf), (spec + "ll" + conv).c_str(),
+                     (unsigned long long)v);
+      } else {
+        n = snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v);
+      }
+    } else if (type == 'f') {
+      double v = m_data.read_double();
+      n = snprintf(buf, sizeof(buf),
+                   (spec + (strchr("eEfFgGaA", conv) ? conv : 'g')).c_str(), v);
+    } else if (type == 'p') {
+      n = snprintf(buf, sizeof(buf), "%p", (void *)m_data.read_uint64());
+    } else {
+      std::string v = m_data.read_string_vint();
+      if (conv == 's' && spec.size() == 1) {
+        out.append(v);
+      } else {
+        n = snprintf(buf, sizeof(buf), (spec + 's').c_str(), v.c_str());
+      }
+    }
+    out.append(buf, std::min(std::max(n, 0), (int)sizeof(buf) - 1));
+    i = j;
+  }
+  // 格式串里没有用到的参数也要读掉
+  while (arg < site.types.size()) {
+    switch (site.types[arg++]) {
+    case 'i':
+      m_data.read_int64();
+      break;
+    case 'f':
+      m_data.read_double();
+      break;
+    case 's':
+      m_data.read_string_vint();
+      break;
+    default:
+      m_data.read_uint64();
+    }
+  }
+  return out;
+}
+
+} // namespace cool
@@ -0,0 +1,161 @@
+#ifndef __COOL_BINLOG_H
+#define __COOL_BINLOG_H
+
+#include "bytearray.h"
+#include "log.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// 二进制日志, 用法：LOG_BIN_INFO(logger, "recv %d bytes from %s", n, ip);
+// 格式串和参数类型每个调用点只登记一次, 运行时只写调用点id, 时间和参数的原始值,
+// 文件由log.binary.file配置, 用cool-logcat还原成文本
+// 每个线程的日志先攒在自己的缓冲区, 按块写出, 只保证同一个线程内的顺序
+#define LOG_BIN_LEVEL(logger, level_, fmt, ...)                            \
+  do {                                                                     \
+    if (level_ >= COOL_LOG_MIN_LEVEL && cool::BinLog::IsEnabled()) {       \
+      cool::Logger *__cool_logger = &*(logger);                            \
+      if (__cool_logger->get_level() <= level_) {                          \
+        static const uint32_t __cool_site = cool::BinLog::Register(        \
+            __cool_logger->get_name(), level_, __FILE__, __LINE__, fmt,    \
+            cool::BinLog::TypesOf(__VA_ARGS__));                           \
+        cool::BinLog::Append(__cool_site, ##__VA_ARGS__);                  \
+      }                                                                    \
+    }                                                                      \
+  } while (0)
+#define LOG_BIN_DEBUG(logger, fmt, ...) \
+  LOG_BIN_LEVEL(logger, cool::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_BIN_INFO(logger, fmt, ...) \
+  LOG_BIN_LEVEL(logger, cool::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define LOG_BIN_WARN(logger, fmt, ...) \
+  LOG_BIN_LEVEL(logger, cool::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define LOG_BIN_ERROR(logger, fmt, ...) \
+  LOG_BIN_LEVEL(logger, cool::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define LOG_BIN_FATAL(logger, fmt, ...) \
+  LOG_BIN_LEVEL(logger, cool::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+namespace cool {
+
+// 参数类型: i有符号整数, u无符号整数, f浮点数, s字符串, p指针
+template <class T, class Enable = void> struct BinLogType {};
+template <class T>
+struct BinLogType<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  static const char value = std::is_signed<T>::value ? 'i' : 'u';
+};
+template <class T>
+struct BinLogType<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+  static const char value = 'i';
+};
+template <class T>
+struct BinLogType<
+    T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static const char value = 'f';
+};
+template <class T> struct BinLogType<T *> { static const char value = 'p'; };
+template <> struct BinLogType<char *> { static const char value = 's'; };
+template <> struct BinLogType<const char *> { static const char value = 's'; };
+template <> struct BinLogType<std::string> { static const char value = 's'; };
+
+class BinLog {
+public:
+  enum RecordType {
+    // 调用点: id, 级别, logger名, 文件, 行号, 格式串, 参数类型
+    SITE = 1,
+    // 之后的日志都来自这个线程: 线程id, 线程名
+    CHUNK = 2,
+    // 一条日志: 调用点id, 时间(微秒), 协程id, 参数
+    EVENT = 3,
+  };
+  static const char *MAGIC;
+
+  // 打开文件, 追加写入, 空字符串表示关闭
+  static bool Open(const std::string &file);
+  static bool IsEnabled();
+  // 在当前线程写出所有线程缓冲区中的日志
+  static void Flush();
+
+  static uint32_t Register(const std::string &logger, LogLevel::Level level,
+                           const char *file, uint32_t line, const char *fmt,
+                           const char *types);
+  template <class... Args> static const char *TypesOf(const Args &...) {
+    static const char types[] = {
+        BinLogType<typename std::decay<Args>::type>::value..., '\0'};
+    return types;
+  }
+  template <class... Args>
+  static void Append(uint32_t site, const Args &...args) {
+    ByteArray *ba = Begin(site);
+    Encode(ba, args...);
+    End();
+  }
+
+private:
+  // 锁住当前线程的缓冲区, 写入日志头部
+  static ByteArray *Begin(uint32_t site);
+  // 解锁, 缓冲区满了交给后台线程
+  static void End();
+
+  static void Encode(ByteArray *ba) {}
+  template <class T, class... Args>
+  static void Encode(ByteArray *ba, const T &v, const Args &...args) {
+    EncodeArg(ba, v);
+    Encode(ba, args...);
+  }
+  template <class T>
+  static typename std::enable_if<std::is_integral<T>::value ||
+                                 std::is_enum<T>::value>::type
+  EncodeArg(ByteArray *ba, const T &v) {
+    if (BinLogType<T>::value == 'i') {
+      ba->write_int64((int64_t)v);
+    } else {
+      ba->write_uint64((uint64_t)v);
+    }
+  }
+  static void EncodeArg(ByteArray *ba, double v) { ba->write_double(v); }
+  static void EncodeArg(ByteArray *ba, const char *v) {
+    size_t len = v ? strlen(v) : 0;
+    ba->write_uint64(len);
+    ba->write(v, len);
+  }
+  static void EncodeArg(ByteArray *ba, const std::string &v) {
+    ba->write_string_vint(v);
+  }
+  static void EncodeArg(ByteArray *ba, const void *v) {
+    ba->write_uint64((uint64_t)(uintptr_t)v);
+  }
+};
+
+// 读取二进制日志文件, 按LogFormatter的pattern还原成文本
+class BinLogReader {
+public:
+  BinLogReader(const std::string &pattern =
+                   "%d{%Y-%m-%d %H:%M:%S} %t(%N):%F [%p] [%c] %f:%l %m %n");
+  bool open(const std::string &file);
+  // 读下一条日志, 文件结束或者数据不完整时返回false
+  bool next(std::string &line);
+
+private:
+  struct Site {
+    LogLevel::Level level;
+    Logger::ptr logger;
+    std::string file;
+    uint32_t line;
+    std::string fmt;
+    std::string types;
+  };
+  std::string render(const Site &site);
+
+private:
+  LogFormatter m_formatter;
+  ByteArray m_data;
+  std::vector<Site> m_sites;
+  std::map<std::string, Logger::ptr> m_loggers;
+  uint32_t m_threadId = 0;
+  std::string m_threadName;
+};
+
+} // namespace cool
+
+#endif /* ifndef __COOL_BINLOG_H */
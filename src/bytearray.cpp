@@ -279,7 +279,7 @@ std::string ByteArray::read_string_f64() {
 }
 // data
 std::string ByteArray::read_string_vint() {
-  uint64_t len = read_fuint64();
+  uint64_t len = read_uint64();
   std::string buf;
   buf.resize(len);
   read(&buf[0], len);
@@ -460,13 +460,11 @@ void ByteArray::addCapacity(size_t size) {
   }
   size_t old_cap = getCapacity();
   if (old_cap >= size) {
-    LOG_FMT_DEBUG(g_logger, "old_cap(%u) >= size(%u)", old_cap, size);
     return;
   }
 
   size = size - old_cap;
-  size_t count =
-      (size / m_base_size) + ((size % m_base_size > old_cap) ? 1 : 0);
+  size_t count = (size / m_base_size) + ((size % m_base_size) ? 1 : 0);
   // size_t count = ceil(1.0 * size / m_base_size);
   Node *temp = m_root;
 
@@ -2,9 +2,11 @@
 #define __COOL_CONFIG_H
 
 #include "log.h"
+#include "rcu.h"
 #include "thread.h"
 #include "util.h"
 #include <algorithm>
+#include <atomic>
 #include <boost/lexical_cast.hpp>
 #include <cstdint>
 #include <exception>
@@ -16,6 +18,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -238,6 +241,35 @@ public:
   }
 };
 
+// 配置值的存储, 读取不加锁, 热路径可以直接读最新的配置
+// 可以平凡复制并且不超过8字节的类型放在std::atomic里, 读取是一次原子load
+// 其他类型放在RCU保护的快照里, 读取时复制一份, 更新时整体替换后等旧的读者退出
+template <class T, bool = std::is_trivially_copyable<T>::value &&
+                          sizeof(T) <= sizeof(uint64_t)>
+class ConfigValue {
+public:
+  ConfigValue(const T &v) : m_val(v) {}
+  T load() const { return m_val.load(std::memory_order_acquire); }
+  void store(const T &v) { m_val.store(v, std::memory_order_release); }
+
+private:
+  std::atomic<T> m_val;
+};
+
+template <class T> class ConfigValue<T, false> {
+public:
+  ConfigValue(const T &v) : m_val(new T(v)) {}
+  T load() const {
+    Rcu::ReadLock lock;
+    return *m_val.get();
+  }
+  // 多个写者之间由ConfigVar的写锁互斥
+  void store(const T &v) { m_val.reset(new T(v)); }
+
+private:
+  RcuPtr<T> m_val;
+};
+
 // FromStr T operator(const std::string&)
 // ToStr std::string operator() (const T&)
 template <class T, class FromStr = LexicalCast<std::string, T>,
@@ -254,12 +286,11 @@ public:
   std::string to_string() override {
     try {
       // return boost::lexical_cast<std::string>(m_val);
-      RWMutexType::ReadLock lock(m_mutex);
-      return ToStr()(m_val);
+      return ToStr()(get_value());
     } catch (std::exception &e) {
       LOG_ERROR(LOG_ROOT())
           << "ConfigVar::tostring exception" << e.what()
-          << " convert: " << typeid(m_val).name() << "to string";
+          << " convert: " << typeid(T).name() << "to string";
     }
     return "";
   }
@@ -269,26 +300,25 @@ public:
       set_value(FromStr()(val));
     } catch (std::exception &e) {
       LOG_ERROR(LOG_ROOT()) << "ConfigVar::from string exception" << e.what()
-                            << " convert: string to " << typeid(m_val).name();
+                            << " convert: string to " << typeid(T).name();
     }
     return false;
   }
-  const T get_value() {
-    RWMutexType::ReadLock lock(m_mutex);
-    return m_val;
-  }
+  // 不加锁, 和set_value并发时读到旧值或新值
+  const T get_value() const { return m_val.load(); }
   void set_value(const T &v) {
     {
       RWMutexType::ReadLock lock(m_mutex);
-      if (v == m_val) {
+      T old = m_val.load();
+      if (v == old) {
         return;
       }
       for (auto &i : m_cbs) {
-        i.second(m_val, v);
+        i.second(old, v);
       }
     }
     RWMutexType::WriteLock lock(m_mutex);
-    m_val = v;
+    m_val.store(v);
   }
   std::string get_type() const override { return typeid(T).name(); }
 
@@ -314,8 +344,9 @@ public:
   }
 
 private:
+  // 保护m_cbs, 并且让写者互斥
   RWMutexType m_mutex;
-  T m_val;
+  ConfigValue<T> m_val;
   std::map<uint64_t, on_change_cb>
       m_cbs; // 回调变更查询map, uint64_t为key, 要求唯一
 };
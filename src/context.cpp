@@ -0,0 +1,144 @@
+#include "context.h"
+#include <cstdint>
+
+namespace cool {
+
+bool UContext::init() { return getcontext(&m_ctx) == 0; }
+
+bool UContext::make(void *stack, size_t size, void (*fn)()) {
+  if (getcontext(&m_ctx) != 0) {
+    return false;
+  }
+  m_ctx.uc_link = nullptr;
+  m_ctx.uc_stack.ss_sp = stack;
+  m_ctx.uc_stack.ss_size = size;
+  makecontext(&m_ctx, fn, 0);
+  return true;
+}
+
+bool UContext::Swap(UContext *from, UContext *to) {
+  return swapcontext(&from->m_ctx, &to->m_ctx) == 0;
+}
+
+#ifdef COOL_HAVE_ASM_CONTEXT
+
+extern "C" {
+// 保存callee-saved寄存器到当前栈, 栈顶写入*from_sp, 再从to_sp恢复
+void cool_context_switch(void **from_sp, void *to_sp);
+// 新上下文第一次被切入时的入口, 调用保存在寄存器中的函数
+void cool_context_entry();
+}
+
+#if defined(__x86_64__)
+// 栈布局(低地址 -> 高地址):
+// mxcsr/x87控制字(8字节) r12 r13 r14 r15 rbx rbp 返回地址
+__asm__(".text\n"
+        ".globl cool_context_switch\n"
+        ".type cool_context_switch,@function\n"
+        "cool_context_switch:\n"
+        "  pushq %rbp\n"
+        "  pushq %rbx\n"
+        "  pushq %r15\n"
+        "  pushq %r14\n"
+        "  pushq %r13\n"
+        "  pushq %r12\n"
+        "  subq $8, %rsp\n"
+        "  stmxcsr (%rsp)\n"
+        "  fnstcw 4(%rsp)\n"
+        "  movq %rsp, (%rdi)\n"
+        "  movq %rsi, %rsp\n"
+        "  ldmxcsr (%rsp)\n"
+        "  fldcw 4(%rsp)\n"
+        "  addq $8, %rsp\n"
+        "  popq %r12\n"
+        "  popq %r13\n"
+        "  popq %r14\n"
+        "  popq %r15\n"
+        "  popq %rbx\n"
+        "  popq %rbp\n"
+        "  ret\n"
+        ".size cool_context_switch,.-cool_context_switch\n"
+        ".globl cool_context_entry\n"
+        ".type cool_context_entry,@function\n"
+        "cool_context_entry:\n"
+        "  callq *%r12\n"
+        "  ud2\n"
+        ".size cool_context_entry,.-cool_context_entry\n");
+
+bool AsmContext::make(void *stack, size_t size, void (*fn)()) {
+  // 进入fn时需要满足 (rsp + 8) % 16 == 0
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  uint64_t *sp = (uint64_t *)(top - 16);
+  *--sp = (uint64_t)&cool_context_entry; // ret
+  *--sp = 0;                             // rbp
+  *--sp = 0;                             // rbx
+  *--sp = 0;                             // r15
+  *--sp = 0;                             // r14
+  *--sp = 0;                             // r13
+  *--sp = (uint64_t)fn;                  // r12
+  *--sp = 0x037F00001F80ULL;             // x87控制字 | mxcsr 默认值
+  m_sp = sp;
+  return true;
+}
+
+#elif defined(__aarch64__)
+// 栈布局: x19-x30(96字节) d8-d15(64字节)
+__asm__(".text\n"
+        ".globl cool_context_switch\n"
+        ".type cool_context_switch,%function\n"
+        "cool_context_switch:\n"
+        "  sub sp, sp, #160\n"
+        "  stp x19, x20, [sp, #0]\n"
+        "  stp x21, x22, [sp, #16]\n"
+        "  stp x23, x24, [sp, #32]\n"
+        "  stp x25, x26, [sp, #48]\n"
+        "  stp x27, x28, [sp, #64]\n"
+        "  stp x29, x30, [sp, #80]\n"
+        "  stp d8, d9, [sp, #96]\n"
+        "  stp d10, d11, [sp, #112]\n"
+        "  stp d12, d13, [sp, #128]\n"
+        "  stp d14, d15, [sp, #144]\n"
+        "  mov x9, sp\n"
+        "  str x9, [x0]\n"
+        "  mov sp, x1\n"
+        "  ldp x19, x20, [sp, #0]\n"
+        "  ldp x21, x22, [sp, #16]\n"
+        "  ldp x23, x24, [sp, #32]\n"
+        "  ldp x25, x26, [sp, #48]\n"
+        "  ldp x27, x28, [sp, #64]\n"
+        "  ldp x29, x30, [sp, #80]\n"
+        "  ldp d8, d9, [sp, #96]\n"
+        "  ldp d10, d11, [sp, #112]\n"
+        "  ldp d12, d13, [sp, #128]\n"
+        "  ldp d14, d15, [sp, #144]\n"
+        "  add sp, sp, #160\n"
+        "  ret\n"
+        ".size cool_context_switch,.-cool_context_switch\n"
+        ".globl cool_context_entry\n"
+        ".type cool_context_entry,%function\n"
+        "cool_context_entry:\n"
+        "  blr x19\n"
+        "  brk #0\n"
+        ".size cool_context_entry,.-cool_context_entry\n");
+
+bool AsmContext::make(void *stack, size_t size, void (*fn)()) {
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  uint64_t *sp = (uint64_t *)(top - 160);
+  for (int i = 0; i < 20; ++i) {
+    sp[i] = 0;
+  }
+  sp[0] = (uint64_t)fn;                   // x19
+  sp[11] = (uint64_t)&cool_context_entry; // x30
+  m_sp = sp;
+  return true;
+}
+#endif
+
+bool AsmContext::Swap(AsmContext *from, AsmContext *to) {
+  cool_context_switch(&from->m_sp, to->m_sp);
+  return true;
+}
+
+#endif
+
+} // namespace cool
@@ -0,0 +1,48 @@
+#ifndef __COOL_CONTEXT_H
+#define __COOL_CONTEXT_H
+
+#include <cstddef>
+#include <ucontext.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define COOL_HAVE_ASM_CONTEXT 1
+#endif
+
+namespace cool {
+
+// 基于ucontext的上下文, 每次切换都有一次rt_sigprocmask系统调用
+class UContext {
+public:
+  // 保存当前执行流, 用于线程主协程
+  bool init();
+  // 在栈[stack, stack + size)上准备执行fn, fn不能返回
+  bool make(void *stack, size_t size, void (*fn)());
+  // 保存当前上下文到from, 切换到to
+  static bool Swap(UContext *from, UContext *to);
+
+private:
+  ucontext_t m_ctx;
+};
+
+#ifdef COOL_HAVE_ASM_CONTEXT
+// 手写汇编的上下文, 只保存callee-saved寄存器, 切换不进内核
+class AsmContext {
+public:
+  bool init() { return true; }
+  bool make(void *stack, size_t size, void (*fn)());
+  static bool Swap(AsmContext *from, AsmContext *to);
+
+private:
+  void *m_sp = nullptr;
+};
+#endif
+
+#if defined(COOL_FIBER_ASM_CONTEXT) && defined(COOL_HAVE_ASM_CONTEXT)
+using FiberContext = AsmContext;
+#else
+using FiberContext = UContext;
+#endif
+
+} // namespace cool
+
+#endif /* ifndef __COOL_CONTEXT_H */
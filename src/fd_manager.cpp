@@ -1,6 +1,7 @@
 #include "fd_manager.h"
 #include "hook.h"
 #include "src/thread.h"
+#include "util.h"
 #include <boost/integer_fwd.hpp>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -13,6 +14,19 @@ FdCtx::FdCtx(int fd)
   init();
 }
 
+FdCtx::FdCtx(int fd, bool nonblock_socket)
+    : m_isInit(false), m_isSocket(false), m_isClosed(false),
+      m_sysNonblock(false), m_userNonblock(false), m_fd(fd), m_recvTimeout(-1),
+      m_sendTimeout(-1) {
+  if (!nonblock_socket) {
+    init();
+    return;
+  }
+  m_isInit = true;
+  m_isSocket = true;
+  m_sysNonblock = true;
+}
+
 FdCtx::~FdCtx() {}
 
 bool FdCtx::init() {
@@ -60,32 +74,84 @@ uint64_t FdCtx::getTimeout(int type) {
   }
 }
 
-FdManager::FdManager() { m_datas.resize(64); }
+void FdCtx::armTimeout(IOManager *iom, IOManager::Event event, uint64_t ms) {
+  IoTimeout &io = getIoTimeout(event);
+  Mutex::Lock lock{io.mutex};
+  if (!io.timer || io.iom != iom || io.iom_id != iom->getTimerManagerId()) {
+    // 第一次使用或者换了IOManager, 只在这里分配一次
+    io.timer = iom->createTimer(std::bind(
+        &FdCtx::OnIoTimeout, std::weak_ptr<FdCtx>(shared_from_this()), event));
+    io.iom = iom;
+    io.iom_id = iom->getTimerManagerId();
+  }
+  io.timed_out = false;
+  io.armed = true;
+  io.deadline = GetCurrentMS() + ms;
+  io.timer->start(ms);
+}
+
+bool FdCtx::disarmTimeout(IOManager::Event event) {
+  IoTimeout &io = getIoTimeout(event);
+  Mutex::Lock lock{io.mutex};
+  if (io.timer) {
+    io.timer->cancel();
+  }
+  io.armed = false;
+  io.deadline = ~0ull;
+  bool timed_out = io.timed_out;
+  io.timed_out = false;
+  return timed_out;
+}
+
+void FdCtx::OnIoTimeout(std::weak_ptr<FdCtx> weak_ctx, IOManager::Event event) {
+  FdCtx::ptr ctx = weak_ctx.lock();
+  if (!ctx) {
+    return;
+  }
+  IoTimeout &io = ctx->getIoTimeout(event);
+  Mutex::Lock lock{io.mutex};
+  // 已经被事件唤醒后才执行到的过期回调, 或者属于上一次等待, 忽略.
+  // 持有锁时等待不会结束, 也不会开始下一次等待
+  if (!io.armed || io.timed_out || GetCurrentMS() < io.deadline) {
+    return;
+  }
+  io.timed_out = true;
+  io.iom->cancelEvent(ctx->m_fd, event);
+}
+
+FdManager::FdManager() { m_datas.getOrCreate(0); }
 
 FdCtx::ptr FdManager::get(int fd, bool auto_create) {
-  RWMutexType::ReadLock lock{m_mutex};
-  if ((int)m_datas.size() <= fd) {
-    if (!auto_create) {
-      return nullptr;
-    }
-  } else {
-    if (m_datas[fd] || !auto_create) {
-      return m_datas[fd];
-    }
+  FdCtx::ptr *slot = auto_create ? m_datas.getOrCreate(fd) : m_datas.get(fd);
+  if (!slot) {
+    return nullptr;
+  }
+  FdCtx::ptr ctx = std::atomic_load(slot);
+  if (ctx || !auto_create) {
+    return ctx;
+  }
+  FdCtx::ptr new_ctx(new FdCtx(fd));
+  // 并发创建时只保留先发布的那个
+  if (std::atomic_compare_exchange_strong(slot, &ctx, new_ctx)) {
+    return new_ctx;
   }
-  lock.unlock();
+  return ctx;
+}
 
-  RWMutexType::WriteLock lock2{m_mutex};
-  FdCtx::ptr ctx(new FdCtx(fd));
-  m_datas[fd] = ctx;
+FdCtx::ptr FdManager::addSocket(int fd) {
+  FdCtx::ptr *slot = m_datas.getOrCreate(fd);
+  FdCtx::ptr ctx(new FdCtx(fd, true));
+  if (slot) {
+    std::atomic_store(slot, ctx);
+  }
   return ctx;
 }
 
 void FdManager::del(int fd) {
-  RWMutexType::WriteLock lock{m_mutex};
-  if ((int)m_datas.size() <= fd) {
-    return ;
+  FdCtx::ptr *slot = m_datas.get(fd);
+  if (!slot) {
+    return;
   }
-  m_datas[fd].reset();
+  std::atomic_store(slot, FdCtx::ptr());
 }
 } // namespace cool
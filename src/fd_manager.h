@@ -1,9 +1,11 @@
 #ifndef __COOL_FD_MANAGER_H
 #define __COOL_FD_MANAGER_H
 
+#include "fd_table.h"
 #include "iomanager.h"
 #include "singleton.h"
 #include "thread.h"
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -12,13 +14,16 @@ class FdCtx : public std::enable_shared_from_this<FdCtx> {
 public:
   using ptr = std::shared_ptr<FdCtx>;
   FdCtx(int fd);
+  // 已知是非阻塞的socket(例如accept4(SOCK_NONBLOCK)的返回值), 不需要系统调用
+  FdCtx(int fd, bool nonblock_socket);
   ~FdCtx();
 
   bool init();
   bool isInit() const { return m_isInit; }
   bool isSocket() const { return m_isSocket; }
   bool isClose() const { return m_isClosed; }
-  bool clost();
+  // 标记为已关闭, 之后的hook IO直接返回EBADF
+  void close() { m_isClosed = true; }
 
   void setUserNonBlock(bool v) { m_userNonblock = v; }
   bool getUserNonBlock() const { return m_userNonblock; }
@@ -29,28 +34,53 @@ public:
   void setTimeout(int type, uint64_t v);
   uint64_t getTimeout(int type);
 
+  // hook的IO挂起前启动超时定时器, 定时器按读写方向缓存在FdCtx中复用
+  void armTimeout(IOManager *iom, IOManager::Event event, uint64_t ms);
+  // 唤醒后停止定时器, 返回是否是因为超时被唤醒
+  bool disarmTimeout(IOManager::Event event);
+
 private:
+  struct IoTimeout {
+    // 定时器回调的检查和取消事件, 与启动/停止定时器互斥, 否则过期的回调
+    // 可能取消掉下一次挂起的等待
+    Mutex mutex;
+    Timer::ptr timer;
+    IOManager *iom = nullptr;
+    uint64_t iom_id = 0;
+    // 定时器复用, 回调里没有对应哪一次等待的信息, 停止定时器时清除
+    bool armed = false;
+    uint64_t deadline = ~0ull;
+    bool timed_out = false;
+  };
+  IoTimeout &getIoTimeout(IOManager::Event event) {
+    return m_ioTimeouts[event == IOManager::READ ? 0 : 1];
+  }
+  static void OnIoTimeout(std::weak_ptr<FdCtx> weak_ctx, IOManager::Event event);
+
+
   bool m_isInit;
   bool m_isSocket;
-  bool m_isClosed;
+  std::atomic<bool> m_isClosed;
   bool m_sysNonblock;
   bool m_userNonblock;
   int m_fd;
   uint64_t m_recvTimeout;
   uint64_t m_sendTimeout;
+  IoTimeout m_ioTimeouts[2];
   // cool::IOManager *m_iomanager;
 };
 
 class FdManager {
 public:
-  using RWMutexType = RWMutex;
   FdManager();
 
   FdCtx::ptr get(int fd, bool auto_create = false);
+  // 注册一个新的非阻塞socket, 覆盖同一个句柄上残留的旧记录
+  FdCtx::ptr addSocket(int fd);
   void del(int fd);
 private:
-  RWMutexType m_mutex;
-  std::vector<FdCtx::ptr> m_datas;
+  // 槽位通过std::atomic_load/atomic_store等读写, 不需要全局锁
+  FdTable<FdCtx::ptr> m_datas;
 };
 
 using FdMgr = Singleton<FdManager>;
@@ -0,0 +1,83 @@
+#ifndef __COOL_FD_TABLE_H
+#define __COOL_FD_TABLE_H
+
+#include "noncopyable.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+namespace cool {
+
+// 以fd为下标的两级表, 第一级是固定大小的段指针数组, 第二级是按需分配的段
+// 段一旦发布就不会移动或释放(直到表析构), 所以查找不需要加锁,
+// 扩容也只是CAS发布一个新段, 不会阻塞其他线程
+// 默认上限 1 << 20 与 fs.nr_open 的默认值一致
+template <class T, size_t SegmentBits = 8, size_t MaxFd = 1 << 20>
+class FdTable : Noncopyable {
+public:
+  // 新段发布前对每个元素调用一次, 参数为元素和它对应的fd
+  using InitFunc = std::function<void(T &, int)>;
+
+  static constexpr size_t SEGMENT_SIZE = (size_t)1 << SegmentBits;
+  static constexpr size_t SEGMENT_COUNT =
+      (MaxFd + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+
+  FdTable(InitFunc init = nullptr) : m_init(init) {
+    for (size_t i = 0; i < SEGMENT_COUNT; ++i) {
+      m_segments[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+  ~FdTable() {
+    for (size_t i = 0; i < SEGMENT_COUNT; ++i) {
+      delete m_segments[i].load(std::memory_order_relaxed);
+    }
+  }
+
+  // fd越界或所在的段还没分配时返回nullptr
+  T *get(int fd) const {
+    if (fd < 0 || (size_t)fd >= SEGMENT_COUNT * SEGMENT_SIZE) {
+      return nullptr;
+    }
+    Segment *seg =
+        m_segments[fd >> SegmentBits].load(std::memory_order_acquire);
+    if (!seg) {
+      return nullptr;
+    }
+    return &seg->items[fd & (SEGMENT_SIZE - 1)];
+  }
+
+  // 段不存在时分配, 只有fd越界才返回nullptr
+  T *getOrCreate(int fd) {
+    T *item = get(fd);
+    if (item || fd < 0 || (size_t)fd >= SEGMENT_COUNT * SEGMENT_SIZE) {
+      return item;
+    }
+    size_t idx = fd >> SegmentBits;
+    Segment *seg = new Segment;
+    if (m_init) {
+      for (size_t i = 0; i < SEGMENT_SIZE; ++i) {
+        m_init(seg->items[i], (int)(idx * SEGMENT_SIZE + i));
+      }
+    }
+    Segment *expected = nullptr;
+    if (!m_segments[idx].compare_exchange_strong(expected, seg,
+                                                 std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) {
+      // 其他线程先发布了这个段
+      delete seg;
+      seg = expected;
+    }
+    return &seg->items[fd & (SEGMENT_SIZE - 1)];
+  }
+
+private:
+  struct Segment {
+    T items[SEGMENT_SIZE];
+  };
+  InitFunc m_init;
+  std::atomic<Segment *> m_segments[SEGMENT_COUNT];
+};
+
+} // namespace cool
+
+#endif /* __COOL_FD_TABLE_H */
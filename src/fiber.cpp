@@ -3,13 +3,13 @@
 #include "log.h"
 #include "macro.h"
 #include "scheduler.h"
+#include "stack_allocator.h"
 #include "src/util.h"
 #include <atomic>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
 #include <memory>
-#include <ucontext.h>
 
 namespace cool {
 static Logger::ptr g_logger = LOG_NAME("system");
@@ -22,21 +22,11 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size = Config::lookup<uint32_t>(
     "fiber.stack_size", 1024 * 1024, "fiber stack size");
 
-class MallocStackAllocator {
-public:
-  static void *Alloc(size_t size) { return malloc(size); }
-  static void Dealloc(void *vp, size_t size) { return free(vp); }
-
-private:
-};
-
-using StackAllocator = MallocStackAllocator;
-
 Fiber::Fiber() {
   m_state = State::EXEC;
   SetThis(this);
 
-  ASSERT2(getcontext(&m_ctx) == 0, "getcontext");
+  ASSERT2(m_ctx.init(), "getcontext");
   ++s_fiber_count;
 
   LOG_DEBUG(g_logger) << "Fiber::Fiber id=0";
@@ -46,16 +36,12 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller)
     : m_id(++s_fiber_id), m_cb(cb) {
   ++s_fiber_count;
   m_stacksize = stacksize ? stacksize : g_fiber_stack_size->get_value();
-  m_stack = StackAllocator::Alloc(m_stacksize);
-  ASSERT2(getcontext(&m_ctx) == 0, "getcontext");
-  m_ctx.uc_link = nullptr;
-  m_ctx.uc_stack.ss_sp = m_stack;
-  m_ctx.uc_stack.ss_size = m_stacksize;
-  if (!use_caller) {
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
-  } else {
-    makecontext(&m_ctx, &Fiber::CallMainFunc, 0);
-  }
+  m_allocator = StackAllocator::GetDefault();
+  m_stack = m_allocator->alloc(m_stacksize);
+  ASSERT2(m_stack, "alloc fiber stack");
+  ASSERT2(m_ctx.make(m_stack, m_stacksize,
+                     use_caller ? &Fiber::CallMainFunc : &Fiber::MainFunc),
+          "makecontext");
   LOG_DEBUG(g_logger) << "Fiber::Fiber id=" << m_id;
 }
 
@@ -64,7 +50,7 @@ Fiber::~Fiber() {
   if (m_stack) {
     ASSERT(m_state == State::TERM || m_state == State::INIT ||
            m_state == State::ERROR);
-    StackAllocator::Dealloc(m_stack, m_stacksize);
+    m_allocator->dealloc(m_stack, m_stacksize);
   } else {
     ASSERT(!m_cb);
     ASSERT(m_state == State::EXEC);
@@ -81,33 +67,29 @@ void Fiber::reset(std::function<void()> cb) {
   ASSERT(m_state == State::TERM || m_state == State::INIT ||
          m_state == State::ERROR);
   m_cb = cb;
-  ASSERT2(getcontext(&m_ctx) == 0, "getcontext");
-  m_ctx.uc_link = nullptr;
-  m_ctx.uc_stack.ss_sp = m_stack;
-  m_ctx.uc_stack.ss_size = m_stacksize;
-  makecontext(&m_ctx, &Fiber::MainFunc, 0);
+  ASSERT2(m_ctx.make(m_stack, m_stacksize, &Fiber::MainFunc), "makecontext");
   m_state = State::INIT;
 }
 
 void Fiber::call () {
   SetThis(this);
   m_state = State::EXEC;
-  ASSERT2(swapcontext(&t_thread_fiber->m_ctx, &m_ctx) != -1, "swapcontext");
+  ASSERT2(FiberContext::Swap(&t_thread_fiber->m_ctx, &m_ctx), "swapcontext");
 }
 void Fiber::back () {
   SetThis(t_thread_fiber.get());
-  ASSERT2(swapcontext(&m_ctx, &t_thread_fiber->m_ctx) != -1,
-            "swapcontext");
+  ASSERT2(FiberContext::Swap(&m_ctx, &t_thread_fiber->m_ctx), "swapcontext");
 }
 void Fiber::swapIn() {
   SetThis(this);
   ASSERT(m_state != State::EXEC);
   m_state = State::EXEC;
-  ASSERT2(swapcontext(&cool::Scheduler::GetMainFiber()->m_ctx, &m_ctx) != -1, "swapcontext");
+  ASSERT2(FiberContext::Swap(&cool::Scheduler::GetMainFiber()->m_ctx, &m_ctx),
+          "swapcontext");
 }
 void Fiber::swapOut() {
   SetThis(cool::Scheduler::GetMainFiber());
-  ASSERT2(swapcontext(&m_ctx, &cool::Scheduler::GetMainFiber()->m_ctx) != -1,
+  ASSERT2(FiberContext::Swap(&m_ctx, &cool::Scheduler::GetMainFiber()->m_ctx),
           "swapcontext");
 }
 
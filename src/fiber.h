@@ -1,14 +1,14 @@
 #ifndef __COOL_FIBER_H
 #define __COOL_FIBER_H
 
+#include "context.h"
 #include "thread.h"
 #include <functional>
 #include <memory>
-#include <sys/ucontext.h>
-#include <ucontext.h>
 
 namespace cool {
 class Scheduler;
+class StackAllocator;
 class Fiber : public std::enable_shared_from_this<Fiber> {
   friend class Scheduler;
 public:
@@ -41,8 +41,9 @@ private:
   uint64_t m_id = 0;
   uint32_t m_stacksize = 0;
   State m_state = State::INIT;
-  ucontext_t m_ctx;
+  FiberContext m_ctx;
   void *m_stack = nullptr;
+  StackAllocator *m_allocator = nullptr; // 释放时必须用分配时的分配器
   std::function<void()> m_cb;
 };
 } // namespace cool
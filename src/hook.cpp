@@ -10,8 +10,11 @@
 #include <cstdarg>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <cstring>
 #include <functional>
+#include <linux/io_uring.h>
 #include <memory>
+#include <poll.h>
 // #include <sys/socket.h>
 #include <utility>
 
@@ -30,6 +33,7 @@ static thread_local bool t_hook_enable = false;
   XX(socket)                                                                   \
   XX(connect)                                                                  \
   XX(accept)                                                                   \
+  XX(accept4)                                                                  \
   XX(read)                                                                     \
   XX(readv)                                                                    \
   XX(recv)                                                                     \
@@ -40,6 +44,7 @@ static thread_local bool t_hook_enable = false;
   XX(send)                                                                     \
   XX(sendto)                                                                   \
   XX(sendmsg)                                                                  \
+  XX(sendfile)                                                                 \
   XX(close)                                                                    \
   XX(fcntl)                                                                    \
   XX(ioctl)                                                                    \
@@ -56,16 +61,13 @@ void hook_init() {
 #undef XX
 }
 
-static uint64_t s_connect_timeout = -1;
 struct _HookIniter {
   _HookIniter() {
     hook_init();
-    s_connect_timeout = g_tcp_connect_timeout->get_value();
     g_tcp_connect_timeout->add_listener(
         [](const int &old_val, const int &new_val) {
           LOG_DEBUG(g_logger) << "tcp connect timeout changed from " << old_val
                               << " to " << new_val;
-          s_connect_timeout = new_val;
         });
   }
 };
@@ -77,13 +79,16 @@ bool is_hook_enable() { return t_hook_enable; }
 void set_hook_enable(bool flag) { t_hook_enable = flag; }
 } // namespace cool
 
-struct timer_info {
-  int cancelled = 0;
+// 不支持io_uring的操作, 总是走epoll
+struct NoUring {
+  bool operator()(io_uring_sqe &sqe) const { return false; }
 };
 
-template <typename OriginFun, typename... Args>
+// io_uring后端: 直接尝试返回EAGAIN后, 由prep填好对应的SQE交给io_uring完成
+template <typename OriginFun, typename PrepFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name,
-                     uint32_t event, int timeout_so, Args &&...args) {
+                     uint32_t event, int timeout_so, PrepFun prep,
+                     Args &&...args) {
   if (!cool::t_hook_enable) {
     return fun(fd, std::forward<Args>(args)...);
   }
@@ -99,7 +104,6 @@ static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name,
     return fun(fd, std::forward<Args>(args)...);
   }
   uint64_t to = ctx->getTimeout(timeout_so);
-  std::shared_ptr<timer_info> tinfo(new timer_info);
 
 retry:
   ssize_t n = fun(fd, std::forward<Args>(args)...);
@@ -108,40 +112,52 @@ retry:
   }
   if (n == -1 && errno == EAGAIN) {
     cool::IOManager *iom = cool::IOManager::GetThis();
-    cool::Timer::ptr timer;
-    std::weak_ptr<timer_info> winfo(tinfo);
-
+    cool::IOManager::Event ev = (cool::IOManager::Event)event;
+    io_uring_sqe sqe;
+    if (iom->isUring()) {
+      memset(&sqe, 0, sizeof(sqe));
+      sqe.fd = fd;
+    }
+    if (iom->isUring() && prep(sqe)) {
+      int rt = iom->uringCall(fd, ev, sqe, to);
+      // 不在工作线程上(没有本线程的io_uring)或者SQ满了, 下面改用epoll等待
+      if (rt != -ENOTSUP && rt != -EBUSY) {
+        if (rt < 0) {
+          // 被close取消的请求按EBADF返回, 与epoll后端一致
+          errno = ctx->isClose() ? EBADF : -rt;
+          return -1;
+        }
+        return rt;
+      }
+    }
+    // 超时定时器缓存在FdCtx中, 这条路径上不分配内存
     if (to != (uint64_t)-1) {
-      timer = iom->addConditionTimer(
-          to,
-          [winfo, fd, iom, event]() {
-            auto t = winfo.lock();
-            if (!t || t->cancelled) {
-              return;
-            }
-            t->cancelled = ETIMEDOUT;
-            iom->cancelEvent(fd, (cool::IOManager::Event)event);
-          },
-          winfo);
+      ctx->armTimeout(iom, ev, to);
     }
 
-    int rt = iom->addEvent(fd, (cool::IOManager::Event)event);
+    int rt = iom->addEvent(fd, ev);
+    if (!rt && ctx->isClose()) {
+      // 注册之前句柄已经被其他线程close, 没有人会再唤醒这个事件
+      iom->cancelEvent(fd, ev);
+    }
     if (rt) {
       LOG_ERROR(g_logger)
           << hook_fun_name << " addevent(" << fd << ", " << event << ")";
-      if (timer) {
-        timer->cancel();
+      if (to != (uint64_t)-1) {
+        ctx->disarmTimeout(ev);
       }
       return -1;
     } else {
       // LOG_DEBUG(g_logger) << "do_io<" << hook_fun_name << ">";
       cool::Fiber::YieldToHold();
       // LOG_DEBUG(g_logger) << "do_io<" << hook_fun_name << ">";
-      if (timer) {
-        timer->cancel();
+      if (to != (uint64_t)-1 && ctx->disarmTimeout(ev)) {
+        errno = ETIMEDOUT;
+        return -1;
       }
-      if (tinfo->cancelled) {
-        errno = tinfo->cancelled;
+      // 被close唤醒时句柄可能还没真正关闭, 不能再去注册事件
+      if (ctx->isClose()) {
+        errno = EBADF;
         return -1;
       }
       goto retry;
@@ -156,48 +172,50 @@ HOOK_FUN(XX);
 #undef XX
 
 unsigned int sleep(unsigned int seconds) {
-  if (!cool::t_hook_enable) {
+  cool::IOManager *iom = cool::IOManager::GetThis();
+  // 不在IOManager中(如普通的Scheduler)时没有定时器, 直接阻塞线程
+  if (!cool::t_hook_enable || !iom) {
     return sleep_f(seconds);
   }
   cool::Fiber::ptr fiber = cool::Fiber::GetThis();
-  cool::IOManager *iom = cool::IOManager::GetThis();
   // iom->addTimer(seconds * 1000, [iom, fiber]() { iom->schedule(fiber); });
   iom->addTimer(
       seconds * 1000,
       std::bind((void (cool::Scheduler::*)(cool::Fiber::ptr, int thread)) &
                     cool::IOManager::schedule,
-                iom, fiber, -1));
+                iom, fiber, cool::Scheduler::GetPinnedThread()));
   cool::Fiber::YieldToHold();
   return 0;
 }
 int usleep(useconds_t usec) {
-  if (!cool::t_hook_enable) {
+  cool::IOManager *iom = cool::IOManager::GetThis();
+  // 不在IOManager中(如普通的Scheduler)时没有定时器, 直接阻塞线程
+  if (!cool::t_hook_enable || !iom) {
     return usleep_f(usec);
   }
   cool::Fiber::ptr fiber = cool::Fiber::GetThis();
-  cool::IOManager *iom = cool::IOManager::GetThis();
   // iom->addTimer(usec / 1000, [iom, fiber]() { iom->schedule(fiber); });
   iom->addTimer(
       usec / 1000,
       std::bind((void (cool::Scheduler::*)(cool::Fiber::ptr, int thread)) &
                     cool::IOManager::schedule,
-                iom, fiber, -1));
+                iom, fiber, cool::Scheduler::GetPinnedThread()));
   cool::Fiber::YieldToHold();
   return 0;
 }
 int nanosleep(const struct timespec *req, struct timespec *rem) {
-  if (!cool::t_hook_enable) {
-    return nanosleep(req, rem);
+  cool::IOManager *iom = cool::IOManager::GetThis();
+  if (!cool::t_hook_enable || !iom) {
+    return nanosleep_f(req, rem);
   }
   int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
   cool::Fiber::ptr fiber = cool::Fiber::GetThis();
-  cool::IOManager *iom = cool::IOManager::GetThis();
   // iom->addTimer(timeout_ms, [iom, fiber]() { iom->schedule(fiber); });
   iom->addTimer(
       timeout_ms,
       std::bind((void (cool::Scheduler::*)(cool::Fiber::ptr, int thread)) &
                     cool::IOManager::schedule,
-                iom, fiber, -1));
+                iom, fiber, cool::Scheduler::GetPinnedThread()));
   cool::Fiber::YieldToHold();
   return 0;
 }
@@ -233,38 +251,36 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
     return n;
   }
   cool::IOManager* iom = cool::IOManager::GetThis();
-  cool::Timer::ptr timer;
-  std::shared_ptr<timer_info> tinfo(new timer_info);
-  std::weak_ptr<timer_info> winfo(tinfo);
-
-  if (timeout_ms != (uint64_t)-1) {
-    timer = iom->addConditionTimer(
-        timeout_ms,
-        [winfo, sockfd, iom]() {
-          auto t = winfo.lock();
-          if (!t || t->cancelled) {
-            return;
-          }
-          t->cancelled = ETIMEDOUT;
-          iom->cancelEvent(sockfd, cool::IOManager::WRITE);
-        },
-        winfo);
-  }
-  int rt = iom->addEvent(sockfd, cool::IOManager::WRITE);
-  if (rt == 0) {
-    cool::Fiber::YieldToHold();
-    if (timer) {
-      timer->cancel();
-    }
-    if (tinfo->cancelled) {
-      errno = tinfo->cancelled;
+  if (iom->isUring()) {
+    // 连接已经在进行中, 等可写即可
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = sockfd;
+    sqe.poll32_events = POLLOUT;
+    int rt = iom->uringCall(sockfd, cool::IOManager::WRITE, sqe, timeout_ms);
+    if (rt < 0) {
+      errno = ctx->isClose() ? EBADF : -rt;
       return -1;
     }
   } else {
-    if (timer) {
-      timer->cancel();
+    if (timeout_ms != (uint64_t)-1) {
+      ctx->armTimeout(iom, cool::IOManager::WRITE, timeout_ms);
+    }
+    int rt = iom->addEvent(sockfd, cool::IOManager::WRITE);
+    if (rt == 0) {
+      cool::Fiber::YieldToHold();
+      if (timeout_ms != (uint64_t)-1 &&
+          ctx->disarmTimeout(cool::IOManager::WRITE)) {
+        errno = ETIMEDOUT;
+        return -1;
+      }
+    } else {
+      if (timeout_ms != (uint64_t)-1) {
+        ctx->disarmTimeout(cool::IOManager::WRITE);
+      }
+      LOG_ERROR(g_logger) << "connect addEvent (" << sockfd <<", WRITE) error";
     }
-    LOG_ERROR(g_logger) << "connect addEvent (" << sockfd <<", WRITE) error";
   }
   int error = 0;
   socklen_t len = sizeof(int);
@@ -280,11 +296,18 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
 }
 
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-  return connect_with_timeout(sockfd, addr, addrlen, cool::s_connect_timeout);
+  return connect_with_timeout(sockfd, addr, addrlen,
+                              (uint64_t)g_tcp_connect_timeout->get_value());
 }
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
   int fd = do_io(sockfd, accept_f, "accept", cool::IOManager::READ, SO_RCVTIMEO,
+                 [=](io_uring_sqe &sqe) {
+                   sqe.opcode = IORING_OP_ACCEPT;
+                   sqe.addr = (uint64_t)addr;
+                   sqe.addr2 = (uint64_t)addrlen;
+                   return true;
+                 },
                  addr, addrlen);
   if (fd >= 0) {
     cool::FdMgr::instance()->get(fd, true);
@@ -292,57 +315,151 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
   return fd;
 }
 
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+  if (!cool::t_hook_enable) {
+    int fd = accept4_f(sockfd, addr, addrlen, flags);
+    if (fd >= 0) {
+      cool::FdMgr::instance()->get(fd, true);
+    }
+    return fd;
+  }
+  // 系统层面总是非阻塞的, 直接得到非阻塞socket, 不需要再fstat/fcntl
+  int fd = do_io(sockfd, accept4_f, "accept4", cool::IOManager::READ,
+                 SO_RCVTIMEO,
+                 [=](io_uring_sqe &sqe) {
+                   sqe.opcode = IORING_OP_ACCEPT;
+                   sqe.addr = (uint64_t)addr;
+                   sqe.addr2 = (uint64_t)addrlen;
+                   sqe.accept_flags = flags | SOCK_NONBLOCK;
+                   return true;
+                 },
+                 addr, addrlen, flags | SOCK_NONBLOCK);
+  if (fd >= 0) {
+    cool::FdCtx::ptr ctx = cool::FdMgr::instance()->addSocket(fd);
+    ctx->setUserNonBlock(flags & SOCK_NONBLOCK);
+  }
+  return fd;
+}
+
 ssize_t read(int fd, void *buf, size_t count) {
-  return do_io(fd, read_f, "read", cool::IOManager::READ, SO_RCVTIMEO, buf,
-               count);
+  return do_io(fd, read_f, "read", cool::IOManager::READ, SO_RCVTIMEO,
+               [=](io_uring_sqe &sqe) {
+                 // io_uring的READ遇到非阻塞句柄直接返回EAGAIN, socket用RECV等待
+                 sqe.opcode = IORING_OP_RECV;
+                 sqe.addr = (uint64_t)buf;
+                 sqe.len = count;
+                 return true;
+               },
+               buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
-  return do_io(fd, readv_f, "readv", cool::IOManager::READ, SO_RCVTIMEO, iov,
-               iovcnt);
+  msghdr msg;
+  return do_io(fd, readv_f, "readv", cool::IOManager::READ, SO_RCVTIMEO,
+               [&](io_uring_sqe &sqe) {
+                 memset(&msg, 0, sizeof(msg));
+                 msg.msg_iov = (iovec *)iov;
+                 msg.msg_iovlen = iovcnt;
+                 sqe.opcode = IORING_OP_RECVMSG;
+                 sqe.addr = (uint64_t)&msg;
+                 sqe.len = 1;
+                 return true;
+               },
+               iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-  return do_io(sockfd, recv_f, "recv", cool::IOManager::READ, SO_RCVTIMEO, buf,
-               len, flags);
+  return do_io(sockfd, recv_f, "recv", cool::IOManager::READ, SO_RCVTIMEO,
+               [=](io_uring_sqe &sqe) {
+                 sqe.opcode = IORING_OP_RECV;
+                 sqe.addr = (uint64_t)buf;
+                 sqe.len = len;
+                 sqe.msg_flags = flags;
+                 return true;
+               },
+               buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
                  struct sockaddr *src_addr, socklen_t *addrlen) {
 
   return do_io(sockfd, recvfrom_f, "recvfrom", cool::IOManager::READ,
-               SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+               SO_RCVTIMEO, NoUring(), buf, len, flags, src_addr, addrlen);
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
   return do_io(sockfd, recvmsg_f, "recvmsg", cool::IOManager::READ, SO_RCVTIMEO,
+               [=](io_uring_sqe &sqe) {
+                 sqe.opcode = IORING_OP_RECVMSG;
+                 sqe.addr = (uint64_t)msg;
+                 sqe.len = 1;
+                 sqe.msg_flags = flags;
+                 return true;
+               },
                msg, flags);
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
-  return do_io(fd, write_f, "write", cool::IOManager::WRITE, SO_SNDTIMEO, buf,
-               count);
+  return do_io(fd, write_f, "write", cool::IOManager::WRITE, SO_SNDTIMEO,
+               [=](io_uring_sqe &sqe) {
+                 sqe.opcode = IORING_OP_SEND;
+                 sqe.addr = (uint64_t)buf;
+                 sqe.len = count;
+                 return true;
+               },
+               buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
-  return do_io(fd, writev_f, "writev", cool::IOManager::WRITE, SO_SNDTIMEO, iov,
-               iovcnt);
+  msghdr msg;
+  return do_io(fd, writev_f, "writev", cool::IOManager::WRITE, SO_SNDTIMEO,
+               [&](io_uring_sqe &sqe) {
+                 memset(&msg, 0, sizeof(msg));
+                 msg.msg_iov = (iovec *)iov;
+                 msg.msg_iovlen = iovcnt;
+                 sqe.opcode = IORING_OP_SENDMSG;
+                 sqe.addr = (uint64_t)&msg;
+                 sqe.len = 1;
+                 return true;
+               },
+               iov, iovcnt);
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
-  return do_io(sockfd, send_f, "send", cool::IOManager::WRITE, SO_SNDTIMEO, buf,
-               len, flags);
+  return do_io(sockfd, send_f, "send", cool::IOManager::WRITE, SO_SNDTIMEO,
+               [=](io_uring_sqe &sqe) {
+                 sqe.opcode = IORING_OP_SEND;
+                 sqe.addr = (uint64_t)buf;
+                 sqe.len = len;
+                 sqe.msg_flags = flags;
+                 return true;
+               },
+               buf, len, flags);
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
                const struct sockaddr *dest_addr, socklen_t addrlen) {
   return do_io(sockfd, sendto_f, "sendto", cool::IOManager::WRITE, SO_SNDTIMEO,
-               buf, len, flags, dest_addr, addrlen);
+               NoUring(), buf, len, flags, dest_addr, addrlen);
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
   return do_io(sockfd, sendmsg_f, "sendmsg", cool::IOManager::WRITE,
-               SO_SNDTIMEO, msg, flags);
+               SO_SNDTIMEO,
+               [=](io_uring_sqe &sqe) {
+                 sqe.opcode = IORING_OP_SENDMSG;
+                 sqe.addr = (uint64_t)msg;
+                 sqe.len = 1;
+                 sqe.msg_flags = flags;
+                 return true;
+               },
+               msg, flags);
+}
+
+// io_uring没有对应的操作, 总是走epoll
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+  return do_io(out_fd, sendfile_f, "sendfile", cool::IOManager::WRITE,
+               SO_SNDTIMEO, NoUring(), in_fd, offset, count);
 }
 
 int close(int fd) {
@@ -351,6 +468,8 @@ int close(int fd) {
   }
   cool::FdCtx::ptr ctx = cool::FdMgr::instance()->get(fd);
   if (ctx) {
+    // 先标记关闭再唤醒等待的协程, 它们醒来后不会重新注册事件
+    ctx->close();
     auto iom = cool::IOManager::GetThis();
     if (iom) {
       iom->cancekAll(fd);
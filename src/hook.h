@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -49,6 +50,10 @@ typedef int (*accept_fun)(int sockfd, struct sockaddr *addr,
                           socklen_t *addrlen);
 extern accept_fun accept_f;
 
+typedef int (*accept4_fun)(int sockfd, struct sockaddr *addr,
+                           socklen_t *addrlen, int flags);
+extern accept4_fun accept4_f;
+
 typedef int (*close_fun)(int fd);
 extern close_fun close_f;
 
@@ -95,6 +100,10 @@ extern sendto_fun sendto_f;
 typedef ssize_t (*sendmsg_fun)(int sockfd, const struct msghdr *msg, int flags);
 extern sendmsg_fun sendmsg_f;
 
+typedef ssize_t (*sendfile_fun)(int out_fd, int in_fd, off_t *offset,
+                                size_t count);
+extern sendfile_fun sendfile_f;
+
 //
 typedef int (*fcntl_fun)(int fd, int cmd, ... /* arg */);
 extern fcntl_fun fcntl_f;
@@ -2,7 +2,7 @@
 #include <cstdint>
 #include <cstring>
 #include <sstream>
-#include <strings.h>
+#include <unistd.h>
 
 namespace cool {
 namespace http {
@@ -50,72 +50,115 @@ const char *http_status_to_chars(const http_status &v) {
   }
 }
 
-bool CaseInsensitiveLess::operator()(const std::string &lhs,
-                                     const std::string &rhs) const {
-  return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
-}
-
 HttpRequest::HttpRequest(uint8_t version, bool close)
     : m_method(http_method::GET), m_version(version), m_close(close),
       m_path("/") {}
 
-std::string HttpRequest::getHeader(const std::string &key,
-                                   const std::string &def) const {
+void HttpRequest::reset() {
+  m_method = http_method::GET;
+  m_version = 0x11;
+  m_close = true;
+  m_path = "/";
+  m_query.clear();
+  m_fragment.clear();
+  m_body.clear();
+  m_headers.clear();
+  m_params.clear();
+  m_cookies.clear();
+  m_bodyStorage.clear();
+  m_storage.clear();
+  m_bodyStream.reset();
+}
+
+void HttpRequest::detach() {
+  m_path = save(m_path);
+  m_query = save(m_query);
+  m_fragment = save(m_fragment);
+  if (!m_body.empty() && m_body.data() != m_bodyStorage.data()) {
+    m_body = save(m_body);
+  }
+  for (MapType *m : {&m_headers, &m_params, &m_cookies}) {
+    for (auto &i : *m) {
+      i.first = save(i.first);
+      i.second = save(i.second);
+    }
+  }
+}
+
+StringView HttpRequest::save(StringView v) {
+  m_storage.emplace_back(v.data(), v.size());
+  return m_storage.back();
+}
+
+void HttpRequest::setValue(MapType &m, StringView key, StringView val) {
+  auto it = m.find(key);
+  if (it == m.end()) {
+    m.set(save(key), save(val));
+  } else {
+    it->second = save(val);
+  }
+}
+
+StringView HttpRequest::getHeader(StringView key, StringView def) const {
   auto it = m_headers.find(key);
   return it == m_headers.end() ? def : it->second;
 }
-std::string HttpRequest::getParam(const std::string &key,
-                                  const std::string &def) const {
+StringView HttpRequest::getHeader(http_header id, StringView def) const {
+  auto it = m_headers.find(id);
+  return it == m_headers.end() ? def : it->second;
+}
+StringView HttpRequest::getParam(StringView key, StringView def) const {
   auto it = m_params.find(key);
   return it == m_params.end() ? def : it->second;
 }
-std::string HttpRequest::getCookie(const std::string &key,
-                                   const std::string &def) const {
+StringView HttpRequest::getCookie(StringView key, StringView def) const {
   auto it = m_cookies.find(key);
   return it == m_cookies.end() ? def : it->second;
 }
 
-void HttpRequest::setHeader(const std::string &key, const std::string &val) {
-  m_headers[key] = val;
+void HttpRequest::setHeader(StringView key, StringView val) {
+  setValue(m_headers, key, val);
 }
-void HttpRequest::setParam(const std::string &key, const std::string &val) {
-  m_params[key] = val;
+void HttpRequest::setParam(StringView key, StringView val) {
+  setValue(m_params, key, val);
 }
-void HttpRequest::setCookie(const std::string &key, const std::string &val) {
-  m_cookies[key] = val;
+void HttpRequest::setCookie(StringView key, StringView val) {
+  setValue(m_cookies, key, val);
 }
 
-void HttpRequest::delHeader(const std::string &key) { m_headers.erase(key); }
-void HttpRequest::delParam(const std::string &key) { m_params.erase(key); }
-void HttpRequest::delCookie(const std::string &key) { m_params.erase(key); }
+void HttpRequest::delHeader(StringView key) { m_headers.erase(key); }
+void HttpRequest::delParam(StringView key) { m_params.erase(key); }
+void HttpRequest::delCookie(StringView key) { m_cookies.erase(key); }
 
-bool HttpRequest::hasHeader(const std::string &key, std::string *val) {
+bool HttpRequest::hasHeader(StringView key, StringView *val) const {
   auto it = m_headers.find(key);
   if (it == m_headers.end()) {
-    // val = nullptr;
     return false;
-  } else {
+  }
+  if (val) {
     *val = it->second;
-    return true;
   }
+  return true;
 }
-bool HttpRequest::hasParam(const std::string &key, std::string *val) {
+bool HttpRequest::hasParam(StringView key, StringView *val) const {
   auto it = m_params.find(key);
   if (it == m_params.end()) {
     return false;
-  } else {
+  }
+  if (val) {
     *val = it->second;
-    return true;
   }
+  return true;
 }
-bool HttpRequest::hasCookie(const std::string &key, std::string *val) {
+bool HttpRequest::hasCookie(StringView key, StringView *val) const {
   auto it = m_cookies.find(key);
   if (it == m_cookies.end()) {
     return false;
-  } else {
+  }
+  if (val) {
     *val = it->second;
-    return true;
   }
+  return true;
 }
 
 std::string HttpRequest::to_string() const {
@@ -134,7 +177,7 @@ std::ostream &HttpRequest::dump(std::ostream &os) const {
      << "\r\n";
   os << "Connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
   for (auto &i : m_headers) {
-    if (strcasecmp(i.first.c_str(), "Connection") == 0) {
+    if (i.id == http_header::CONNECTION) {
       continue;
     }
     os << i.first << ":" << i.second << "\r\n";
@@ -150,34 +193,127 @@ std::ostream &HttpRequest::dump(std::ostream &os) const {
 HttpResponse::HttpResponse(uint8_t version, bool close)
     : m_status(http_status::OK), m_version(version), m_close(close) {}
 
+HttpResponse::~HttpResponse() { clearBody(); }
+
+void HttpResponse::clearBody() {
+  m_body.clear();
+  m_bodyArray.reset();
+  if (m_bodyFd >= 0 && m_bodyFdOwner) {
+    ::close(m_bodyFd);
+  }
+  m_bodyFd = -1;
+  m_bodyFdOwner = false;
+  m_bodyOffset = 0;
+  m_bodyLength = 0;
+}
+
+void HttpResponse::body(ByteArray::ptr ba) {
+  clearBody();
+  m_bodyArray = ba;
+}
+
+void HttpResponse::bodyFile(int fd, uint64_t offset, uint64_t length,
+                            bool owner) {
+  clearBody();
+  m_bodyFd = fd;
+  m_bodyFdOwner = owner;
+  m_bodyOffset = offset;
+  m_bodyLength = length;
+}
+
+uint64_t HttpResponse::contentLength() const {
+  if (m_bodyArray) {
+    return m_bodyArray->getReadSize();
+  }
+  if (m_bodyFd >= 0) {
+    return m_bodyLength;
+  }
+  return m_body.size();
+}
+
 std::string HttpResponse::getHeader(const std::string &key,
                                     const std::string &def) const {
   auto it = m_headers.find(key);
   return it == m_headers.end() ? def : it->second;
 }
 
+std::string HttpResponse::getHeader(http_header id,
+                                    const std::string &def) const {
+  auto it = m_headers.find(id);
+  return it == m_headers.end() ? def : it->second;
+}
+
 void HttpResponse::setHeader(const std::string &key, const std::string &val) {
-  m_headers[key] = val;
+  m_headers.set(key, val);
 }
 
 void HttpResponse::delHeader(const std::string &key) { m_headers.erase(key); }
 
-std::ostream &HttpResponse::dump(std::ostream &os) const {
-  os << "HTTP/" << ((uint32_t)(m_version >> 4)) << "."
-     << ((uint32_t)(m_version & 0x0F)) << " " << (uint32_t)m_status << " "
-     << (m_reason.empty() ? http_status_to_chars(m_status) : m_reason)
-     << "\r\n";
+static void append_uint(std::string &buf, uint64_t v) {
+  char tmp[24];
+  char *p = tmp + sizeof(tmp);
+  do {
+    *--p = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  buf.append(p, tmp + sizeof(tmp) - p);
+}
+
+void HttpResponse::serializeHeader(std::string &buf) const {
+  buf.append("HTTP/");
+  buf.push_back('0' + (m_version >> 4));
+  buf.push_back('.');
+  buf.push_back('0' + (m_version & 0x0F));
+  buf.push_back(' ');
+  append_uint(buf, (uint32_t)m_status);
+  buf.push_back(' ');
+  if (m_reason.empty()) {
+    buf.append(http_status_to_chars(m_status));
+  } else {
+    buf.append(m_reason);
+  }
+  buf.append("\r\n");
+  uint64_t length = contentLength();
+  bool has_length = false;
   for (auto &i : m_headers) {
-    if (strcasecmp(i.first.c_str(), "Connection") == 0) {
+    // 由下面根据body写出的头部不能重复
+    if (i.id == http_header::CONNECTION ||
+        (i.id == http_header::CONTENT_LENGTH && (m_stream || length > 0)) ||
+        (i.id == http_header::TRANSFER_ENCODING && m_stream)) {
       continue;
     }
-    os << i.first << ": " << i.second << "\r\n";
+    has_length = has_length || i.id == http_header::CONTENT_LENGTH;
+    buf.append(i.first).append(": ").append(i.second).append("\r\n");
   }
-  os << "Connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
-  if (!m_body.empty()) {
-    os << "Content-Length: " << m_body.size() << "\r\n\r\n" << m_body;
-  } else {
-    os << "\r\n";
+  buf.append(m_close ? "Connection: close\r\n" : "Connection: keep-alive\r\n");
+  // 1xx, 204, 304没有body; 其他的空body也要写Content-Length: 0,
+  // 否则客户端只能读到连接关闭为止(RFC 7230 3.3.3)
+  uint32_t status = (uint32_t)m_status;
+  bool no_body = status < 200 || m_status == http_status::NO_CONTENT ||
+                 m_status == http_status::NOT_MODIFIED;
+  if (m_stream) {
+    if (m_version >= 0x11) {
+      buf.append("Transfer-Encoding: chunked\r\n");
+    }
+  } else if (length > 0 || (!no_body && !has_length)) {
+    buf.append("Content-Length: ");
+    append_uint(buf, length);
+    buf.append("\r\n");
+  }
+  buf.append("\r\n");
+}
+
+std::ostream &HttpResponse::dump(std::ostream &os) const {
+  std::string header;
+  serializeHeader(header);
+  os << header;
+  if (m_stream) {
+    return os;
+  }
+  if (m_bodyArray) {
+    os << m_bodyArray->to_string();
+  } else if (m_bodyFd < 0) {
+    os << m_body;
   }
   return os;
 }
@@ -2,12 +2,15 @@
 #define __COOL_HTTP_H
 
 #include "http11_parser.h"
+#include "http_header.h"
 #include "httpclient_parser.h"
-#include <boost/lexical_cast.hpp>
+#include "src/bytearray.h"
+#include "src/noncopyable.h"
+#include "src/stream.h"
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <ostream>
 #include <sstream>
@@ -144,48 +147,42 @@ http_method chars_to_http_methd(const char *v);
 const char *http_method_to_chars(const http_method &v);
 const char *http_status_to_chars(const http_status &v);
 
-struct CaseInsensitiveLess {
-  bool operator()(const std::string &lhs, const std::string &rhs) const;
-};
-
-template <class MapType, class T>
-bool checkGetAs(const MapType &m, const std::string &key, T &val,
-                const T &def = T()) {
+// Key 为头部名或者 http_header
+template <class MapType, class Key, class T>
+bool checkGetAs(const MapType &m, const Key &key, T &val, const T &def = T()) {
   auto it = m.find(key);
-  if (it == m.end()) {
-    val = def;
-    return false;
-  }
-  try {
-    val = boost::lexical_cast<T>(it->second);
+  if (it != m.end() && parse_value(StringView(it->second), val)) {
     return true;
-  } catch (...) { val = def; }
+  }
+  val = def;
   return false;
 }
-template <class MapType, class T>
-T getAs(const MapType &m, const std::string &key, const T &def = T()) {
-  auto it = m.find(key);
-  if (it == m.end()) {
-    return def;
-  }
-  try {
-    return boost::lexical_cast<T>(it->second);
-  } catch (...) {}
-  return def;
+template <class MapType, class Key, class T>
+T getAs(const MapType &m, const Key &key, const T &def = T()) {
+  T val;
+  checkGetAs(m, key, val, def);
+  return val;
 }
 
-class HttpRequest {
+// 解析得到的请求不拷贝数据, 路径/头部/body都是指向连接读缓冲区的视图,
+// 只在下一次recvRequest之前有效. 通过setXXX设置的值由请求自己保存,
+// 视图可能指向自己的存储, 不能拷贝
+class HttpRequest : Noncopyable {
 public:
   using ptr = std::shared_ptr<HttpRequest>;
-  using MapType = std::map<std::string, std::string, CaseInsensitiveLess>;
+  using MapType = HeaderMap<StringView>;
   HttpRequest(uint8_t version = 0x11, bool close = true);
   // ~HttpRequest ();
 
+  // 清空所有字段, 供同一个连接上的下一个请求复用
+  void reset();
+
   http_method method() const { return m_method; }
   uint8_t version() const { return m_version; }
-  const std::string &path() const { return m_path; }
-  const std::string &query() const { return m_query; }
-  const std::string &body() const { return m_body; }
+  StringView path() const { return m_path; }
+  StringView query() const { return m_query; }
+  StringView fragment() const { return m_fragment; }
+  StringView body() const { return m_body; }
 
   const MapType &headers() const { return m_headers; }
   const MapType &params() const { return m_params; }
@@ -194,88 +191,121 @@ public:
   void method(http_method v) { m_method = v; }
   void version(uint8_t v) { m_version = v; }
   bool isClose() const { return m_close; }
+  void setClose(bool v) { m_close = v; }
 
-  void fragment(const std::string &v) { m_fragment = v; }
-  void path(const std::string &v) { m_path = v; }
-  void query(const std::string &v) { m_query = v; }
-  void body(const std::string &v) { m_body = v; }
-
-  void headers(const MapType &v) { m_headers = v; }
-  void params(const MapType &v) { m_params = v; }
-  void cookies(const MapType &v) { m_cookies = v; }
-
-  std::string getHeader(const std::string &key,
-                        const std::string &def = "") const;
-  std::string getParam(const std::string &key,
-                       const std::string &def = "") const;
-  std::string getCookie(const std::string &key,
-                        const std::string &def = "") const;
-
-  void setHeader(const std::string &key, const std::string &val);
-  void setParam(const std::string &key, const std::string &val);
-  void setCookie(const std::string &key, const std::string &val);
-
-  void delHeader(const std::string &key);
-  void delParam(const std::string &key);
-  void delCookie(const std::string &key);
+  void fragment(StringView v) { m_fragment = save(v); }
+  void path(StringView v) { m_path = save(v); }
+  void query(StringView v) { m_query = save(v); }
+  void body(StringView v) { m_body = save(v); }
+  void body(const char *v) { body(StringView(v)); }
+  void body(std::string &&v) {
+    m_bodyStorage = std::move(v);
+    m_body = m_bodyStorage;
+  }
 
-  bool hasHeader(const std::string &key, std::string *val = nullptr);
-  bool hasParam(const std::string &key, std::string *val = nullptr);
-  bool hasCookie(const std::string &key, std::string *val = nullptr);
+  // 只保存视图不拷贝, 调用方保证数据在请求使用期间有效
+  void fragmentView(StringView v) { m_fragment = v; }
+  void pathView(StringView v) { m_path = v; }
+  void queryView(StringView v) { m_query = v; }
+  void bodyView(StringView v) { m_body = v; }
+  // 把指向读缓冲区的视图都拷贝一份, 之后读缓冲区可以被覆盖
+  void detach();
+
+  // body是chunked编码或者太大时不读入内存, body()为空, 由servlet从这里读取
+  // read返回0表示body已经读完, 只在处理当前请求期间有效
+  Stream::ptr bodyStream() const { return m_bodyStream; }
+  void bodyStream(Stream::ptr v) { m_bodyStream = v; }
+  void setHeaderView(StringView key, StringView val) { m_headers.set(key, val); }
+
+  StringView getHeader(StringView key, StringView def = StringView()) const;
+  StringView getHeader(http_header id, StringView def = StringView()) const;
+  StringView getParam(StringView key, StringView def = StringView()) const;
+  StringView getCookie(StringView key, StringView def = StringView()) const;
+
+  void setHeader(StringView key, StringView val);
+  void setParam(StringView key, StringView val);
+  void setCookie(StringView key, StringView val);
+
+  void delHeader(StringView key);
+  void delParam(StringView key);
+  void delCookie(StringView key);
+
+  bool hasHeader(StringView key, StringView *val = nullptr) const;
+  bool hasParam(StringView key, StringView *val = nullptr) const;
+  bool hasCookie(StringView key, StringView *val = nullptr) const;
 
   template <class T>
-  bool checkGetHeaderAs(const std::string &key, T &val, const T &def = T()) {
+  bool checkGetHeaderAs(StringView key, T &val, const T &def = T()) {
     return checkGetAs(m_headers, key, val, def);
   }
 
-  template <class T>
-  T getHeaderAs(const std::string &key, const T &def = T()) {
+  template <class T> T getHeaderAs(StringView key, const T &def = T()) {
     return getAs(m_headers, key, def);
   }
 
+  // 常用头部按id查找, 不用比较字符串
   template <class T>
-  bool checkGetParamAs(const std::string &key, T &val, const T &def = T()) {
-    return checkGetAs(m_params, key, val, def);
+  bool checkGetHeaderAs(http_header id, T &val, const T &def = T()) {
+    return checkGetAs(m_headers, id, val, def);
+  }
+
+  template <class T> T getHeaderAs(http_header id, const T &def = T()) {
+    return getAs(m_headers, id, def);
   }
 
   template <class T>
-  T getParamAs(const std::string &key, const T &def = T()) {
+  bool checkGetParamAs(StringView key, T &val, const T &def = T()) {
+    return checkGetAs(m_params, key, val, def);
+  }
+
+  template <class T> T getParamAs(StringView key, const T &def = T()) {
     return getAs(m_params, key, def);
   }
 
   template <class T>
-  bool checkGetCookieAs(const std::string &key, T &val, const T &def = T()) {
+  bool checkGetCookieAs(StringView key, T &val, const T &def = T()) {
     return checkGetAs(m_cookies, key, val, def);
   }
 
-  template <class T>
-  T getCookieAs(const std::string &key, const T &def = T()) {
+  template <class T> T getCookieAs(StringView key, const T &def = T()) {
     return getAs(m_cookies, key, def);
   }
 
   std::ostream &dump(std::ostream &os) const;
   std::string to_string() const;
 
+private:
+  // 拷贝一份由请求持有, deque追加时不会移动已有元素, 返回的视图一直有效
+  StringView save(StringView v);
+  void setValue(MapType &m, StringView key, StringView val);
+
 private:
   http_method m_method;
   uint8_t m_version;
   bool m_close;
 
-  std::string m_path;
-  std::string m_query;
-  std::string m_fragment;
-  std::string m_body;
+  StringView m_path;
+  StringView m_query;
+  StringView m_fragment;
+  StringView m_body;
 
   MapType m_headers;
   MapType m_params;
   MapType m_cookies;
+
+  std::string m_bodyStorage;
+  std::deque<std::string> m_storage;
+  Stream::ptr m_bodyStream;
 };
 
-class HttpResponse {
+// body可以是字符串, ByteArray或者文件, 发送时都不拷贝
+// 可能持有body文件的fd, 不能拷贝
+class HttpResponse : Noncopyable {
 public:
   using ptr = std::shared_ptr<HttpResponse>;
-  using MapType = std::map<std::string, std::string, CaseInsensitiveLess>;
+  using MapType = HeaderMap<std::string, 8>;
   HttpResponse(uint8_t version = 0x11, bool close = true);
+  ~HttpResponse();
 
   http_status status() const { return m_status; }
   uint8_t version() const { return m_version; }
@@ -291,10 +321,34 @@ public:
   bool isClose() const { return m_close; }
   void setClose(bool v) { m_close = v; }
 
-  void body(const std::string &v) { m_body = v; }
+  void body(const std::string &v) {
+    clearBody();
+    m_body = v;
+  }
+  void body(std::string &&v) {
+    clearBody();
+    m_body = std::move(v);
+  }
+  // 从ba当前位置到末尾的数据作为body, 发送时直接引用ba的内存块
+  void body(ByteArray::ptr ba);
+  // 发送时用sendfile发出fd中[offset, offset + length)的内容
+  // owner为true时由响应负责关闭fd, 否则调用方保证发送完成之前fd有效
+  void bodyFile(int fd, uint64_t offset, uint64_t length, bool owner = false);
+
+  ByteArray::ptr bodyArray() const { return m_bodyArray; }
+  int bodyFd() const { return m_bodyFd; }
+  uint64_t bodyOffset() const { return m_bodyOffset; }
+  // 不管body是哪种形式, 都返回Content-Length
+  uint64_t contentLength() const;
+
+  // body由HttpSession::streamResponse边生成边发送, 头部不写Content-Length
+  // HTTP/1.1使用chunked编码, HTTP/1.0靠关闭连接表示结束
+  bool isStream() const { return m_stream; }
+  void setStream(bool v) { m_stream = v; }
 
   std::string getHeader(const std::string &key,
                         const std::string &def = "") const;
+  std::string getHeader(http_header id, const std::string &def = "") const;
   void setHeader(const std::string &key, const std::string &val);
   void delHeader(const std::string &key);
 
@@ -308,9 +362,24 @@ public:
     return getAs(m_headers, key, def);
   }
 
+  template <class T>
+  bool checkGetHeaderAs(http_header id, T &val, const T &def = T()) {
+    return checkGetAs(m_headers, id, val, def);
+  }
+
+  template <class T> T getHeaderAs(http_header id, const T &def = T()) {
+    return getAs(m_headers, id, def);
+  }
+
+  // 把状态行和头部(包括Content-Length和结尾的空行)追加到buf
+  void serializeHeader(std::string &buf) const;
+
   std::string to_string() const;
   std::ostream &dump(std::ostream &os) const;
 
+private:
+  void clearBody();
+
 private:
   http_status m_status;
   uint8_t m_version;
@@ -319,6 +388,13 @@ private:
   std::string m_body;
   std::string m_reason;
   MapType m_headers;
+
+  ByteArray::ptr m_bodyArray;
+  int m_bodyFd = -1;
+  bool m_bodyFdOwner = false;
+  uint64_t m_bodyOffset = 0;
+  uint64_t m_bodyLength = 0;
+  bool m_stream = false;
 };
 
 std::ostream& operator<<(std::ostream& os, const HttpRequest& req);
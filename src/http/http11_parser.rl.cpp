@@ -91,12 +91,6 @@ int http_parser_init(http_parser *parser) {
 size_t http_parser_execute(http_parser *parser, const char *buffer, size_t len, size_t off)  
 {
   if(len == 0) return 0;
-  /** fix serval datas **/
-  parser->nread = 0;
-  parser->mark = 0;
-  parser->field_len = 0;
-  parser->field_start = 0;
-
 
   const char *p, *pe;
   int cs = parser->cs;
@@ -6626,7 +6620,7 @@ case 347:
 	_out: {}
 	}
 
-#line 299 "/home/dongzx/code/cool/src/http/http11_parser.rl"
+#line 293 "/home/dongzx/code/cool/src/http/http11_parser.rl"
 
   assert(p <= pe && "Buffer overflow after parsing.");
 
@@ -0,0 +1,543 @@
+#include "http_connection.h"
+#include "src/iomanager.h"
+#include "src/log.h"
+#include "src/util.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <poll.h>
+#include <sstream>
+
+namespace cool {
+LOGGER_DEF(g_logger, "system");
+namespace http {
+
+std::string HttpResult::to_string() const {
+  std::stringstream ss;
+  ss << "[HttpResult result=" << (int)result << " error=" << error
+     << " response=" << (response ? response->to_string() : "nullptr") << "]";
+  return ss.str();
+}
+
+HttpConnection::HttpConnection(Socket::ptr sock, bool owner)
+    : SocketStream(sock, owner) {
+  m_createTime = m_lastActive = cool::GetCurrentMS();
+}
+
+int HttpConnection::sendRequest(HttpRequest::ptr req) {
+  std::string data = req->to_string();
+  return writeFixSize(data.c_str(), data.size());
+}
+
+HttpResponse::ptr HttpConnection::error() {
+  int err = errno;
+  close();
+  errno = err;
+  return nullptr;
+}
+
+bool HttpConnection::readLine(StringView &line) {
+  while (true) {
+    const char *begin = &m_buffer[m_pos];
+    const char *end = (const char *)memchr(begin, '\n', m_len - m_pos);
+    if (end) {
+      line = StringView(begin, end - begin);
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      m_pos += end - begin + 1;
+      return true;
+    }
+    if (m_pos > 0) {
+      memmove(&m_buffer[0], &m_buffer[m_pos], m_len - m_pos);
+      m_len -= m_pos;
+      m_pos = 0;
+    }
+    // 一行超过了缓冲区
+    if (m_len + 1 >= m_buffer.size()) {
+      return false;
+    }
+    int rt = read(&m_buffer[m_len], m_buffer.size() - 1 - m_len);
+    if (rt <= 0) {
+      return false;
+    }
+    m_len += rt;
+  }
+}
+
+bool HttpConnection::readData(char *buffer, size_t length) {
+  size_t n = std::min(length, m_len - m_pos);
+  memcpy(buffer, &m_buffer[m_pos], n);
+  m_pos += n;
+  if (n == length) {
+    return true;
+  }
+  return readFixSize(buffer + n, length - n) > 0;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool HttpConnection::readChunkedBody(std::string &body) {
+  uint64_t max_size = HttpResponseParser::GetHttpResponseMaxBodySize();
+  StringView line;
+  while (true) {
+    if (!readLine(line)) {
+      return false;
+    }
+    // 16进制长度, 忽略 ";name=value" 扩展
+    uint64_t size = 0;
+    size_t i = 0;
+    for (int d = 0; i < line.size() && (d = hex_value(line[i])) >= 0; ++i) {
+      if (size >> 60) {
+        return false;
+      }
+      size = size * 16 + d;
+    }
+    if (i == 0 || (i < line.size() && line[i] != ';' && line[i] != ' ' &&
+                   line[i] != '\t')) {
+      LOG_DEBUG(g_logger) << "invalid chunk size: " << line;
+      return false;
+    }
+    if (size == 0) {
+      break;
+    }
+    if (body.size() + size > max_size) {
+      LOG_DEBUG(g_logger) << "http response body too large, length="
+                          << body.size() + size;
+      return false;
+    }
+    size_t old = body.size();
+    body.resize(old + size);
+    if (!readData(&body[old], size) || !readLine(line) || !line.empty()) {
+      return false;
+    }
+  }
+  // 忽略trailer, 直到空行
+  do {
+    if (!readLine(line)) {
+      return false;
+    }
+  } while (!line.empty());
+  return true;
+}
+
+bool HttpConnection::readUntilClose(std::string &body) {
+  uint64_t max_size = HttpResponseParser::GetHttpResponseMaxBodySize();
+  body.assign(&m_buffer[m_pos], m_len - m_pos);
+  m_pos = m_len;
+  while (true) {
+    size_t old = body.size();
+    if (old >= max_size) {
+      return false;
+    }
+    body.resize(std::min(old + m_buffer.size(), max_size));
+    int rt = read(&body[old], body.size() - old);
+    if (rt < 0) {
+      return false;
+    }
+    body.resize(old + rt);
+    if (rt == 0) {
+      return true;
+    }
+  }
+}
+
+HttpResponse::ptr HttpConnection::recvResponse(bool head) {
+  size_t buff_size = HttpResponseParser::GetHttpResponseBufferSize();
+  if (m_buffer.size() < buff_size + 1) {
+    m_buffer.resize(buff_size + 1);
+  }
+  // 上一个响应之后多出来的数据移到开头, 留出解析头部的空间
+  if (m_pos > 0) {
+    memmove(&m_buffer[0], &m_buffer[m_pos], m_len - m_pos);
+    m_len -= m_pos;
+    m_pos = 0;
+  }
+  m_parser.reset();
+  char *data = &m_buffer[0];
+  size_t off = 0;
+  while (true) {
+    if (m_len > off) {
+      data[m_len] = '\0';
+      off = m_parser.execute(data, m_len, off);
+      if (m_parser.hasError()) {
+        LOG_DEBUG(g_logger) << "invalid http response";
+        return error();
+      }
+      if (m_parser.isFinished()) {
+        break;
+      }
+    }
+    if (m_len >= buff_size) {
+      LOG_DEBUG(g_logger) << "http response header too large";
+      return error();
+    }
+    int rt = read(data + m_len, buff_size - m_len);
+    if (rt <= 0) {
+      return error();
+    }
+    m_len += rt;
+  }
+  m_pos = off;
+
+  HttpResponse::ptr rsp = m_parser.m_data;
+  int status = (int)rsp->status();
+  if (head || (status >= 100 && status < 200) || status == 204 ||
+      status == 304) {
+    // 没有body
+  } else if (m_parser.isChunked()) {
+    std::string body;
+    if (!readChunkedBody(body)) {
+      return error();
+    }
+    // body已经解码, 再次发送时按Content-Length
+    rsp->delHeader("Transfer-Encoding");
+    rsp->body(std::move(body));
+  } else if (rsp->headers().find(http_header::CONTENT_LENGTH) !=
+             rsp->headers().end()) {
+    uint64_t length = m_parser.content_length();
+    if (length > HttpResponseParser::GetHttpResponseMaxBodySize()) {
+      LOG_DEBUG(g_logger) << "http response body too large, length="
+                          << length;
+      return error();
+    }
+    std::string body(length, '\0');
+    if (length && !readData(&body[0], length)) {
+      return error();
+    }
+    rsp->body(std::move(body));
+  } else {
+    // 没有长度的body以连接关闭结束
+    std::string body;
+    if (!readUntilClose(body)) {
+      return error();
+    }
+    rsp->body(std::move(body));
+    rsp->setClose(true);
+  }
+
+  ++m_requests;
+  m_lastActive = cool::GetCurrentMS();
+  if (rsp->isClose()) {
+    close();
+  }
+  return rsp;
+}
+
+struct HttpConnectionPool::Waiter {
+  Scheduler *scheduler;
+  Fiber::ptr fiber;
+  bool notified = false;
+};
+
+HttpConnectionPool::HttpConnectionPool(const std::string &host, uint16_t port,
+                                       uint32_t max_size, uint64_t max_idle_ms,
+                                       uint32_t max_request)
+    : m_host(host), m_port(port), m_maxSize(max_size ? max_size : 1),
+      m_maxIdle(max_idle_ms), m_maxRequest(max_request) {}
+
+HttpConnectionPool::~HttpConnectionPool() {
+  if (m_timer) {
+    m_timer->cancel();
+  }
+  for (auto i : m_idle) {
+    delete i;
+  }
+}
+
+size_t HttpConnectionPool::idleCount() {
+  MutexType::Lock lock(m_mutex);
+  return m_idle.size();
+}
+
+size_t HttpConnectionPool::totalCount() {
+  MutexType::Lock lock(m_mutex);
+  return m_total;
+}
+
+bool HttpConnectionPool::isReusable(HttpConnection *conn, uint64_t now) {
+  if (!conn->isConnected() ||
+      (m_maxRequest && conn->requestCount() >= m_maxRequest) ||
+      (m_maxIdle != (uint64_t)-1 && conn->lastActive() + m_maxIdle <= now)) {
+    return false;
+  }
+  // 空闲时有数据可读说明对端已经关闭(或者发来了多余的数据), 都不能再用
+  pollfd pfd;
+  pfd.fd = conn->socket()->socket();
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return ::poll(&pfd, 1, 0) == 0;
+}
+
+void HttpConnectionPool::notifyWaiters(size_t count) {
+  while (count-- && !m_waiters.empty()) {
+    auto w = m_waiters.front();
+    m_waiters.pop_front();
+    w->notified = true;
+    w->scheduler->schedule(w->fiber);
+  }
+}
+
+HttpConnection *HttpConnectionPool::createConnection(uint64_t timeout_ms,
+                                                     HttpResult::Error &err) {
+  Address::ptr addr;
+  {
+    MutexType::Lock lock(m_mutex);
+    addr = m_address;
+  }
+  if (!addr) {
+    IPAddress::ptr ip = Address::LookupAnyIPAddress(m_host);
+    if (!ip) {
+      LOG_ERROR(g_logger) << "get addr fail: " << m_host;
+      err = HttpResult::Error::INVALID_HOST;
+      return nullptr;
+    }
+    ip->port(m_port);
+    addr = ip;
+  }
+  Socket::ptr sock = Socket::CreateTCP(addr);
+  if (!sock->connect(addr, timeout_ms)) {
+    // 下次重新解析, 地址可能已经变了
+    MutexType::Lock lock(m_mutex);
+    m_address.reset();
+    err = HttpResult::Error::CONNECT_FAIL;
+    return nullptr;
+  }
+  MutexType::Lock lock(m_mutex);
+  m_address = addr;
+  return new HttpConnection(sock);
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection(uint64_t timeout_ms,
+                                                      HttpResult::Error *err) {
+  uint64_t now = cool::GetCurrentMS();
+  uint64_t deadline = timeout_ms == (uint64_t)-1 ? -1 : now + timeout_ms;
+  IOManager *iom = IOManager::GetThis();
+  std::vector<HttpConnection *> invalid;
+  HttpConnection *conn = nullptr;
+  bool create = false;
+
+  MutexType::Lock lock(m_mutex);
+  if (!m_timer && iom && m_maxIdle != (uint64_t)-1) {
+    std::weak_ptr<HttpConnectionPool> weak(shared_from_this());
+    m_timer = iom->addConditionTimer(
+        std::max<uint64_t>(m_maxIdle / 2, 100),
+        [weak]() {
+          auto pool = weak.lock();
+          if (pool) {
+            pool->evictIdle();
+          }
+        },
+        weak, true);
+  }
+  while (true) {
+    while (!m_idle.empty()) {
+      HttpConnection *c = m_idle.back();
+      m_idle.pop_back();
+      if (isReusable(c, now)) {
+        conn = c;
+        break;
+      }
+      invalid.push_back(c);
+      --m_total;
+    }
+    if (conn) {
+      break;
+    }
+    if (m_total < m_maxSize) {
+      ++m_total;
+      create = true;
+      break;
+    }
+    now = cool::GetCurrentMS();
+    if (!iom || now >= deadline) {
+      break;
+    }
+    // 连接数已满, 等待归还或者超时
+    std::shared_ptr<Waiter> w(new Waiter);
+    w->scheduler = iom;
+    w->fiber = Fiber::GetThis();
+    m_waiters.push_back(w);
+    Timer::ptr timer;
+    if (deadline != (uint64_t)-1) {
+      timer = iom->addTimer(deadline - now, [this, w]() {
+        MutexType::Lock lock(m_mutex);
+        if (!w->notified) {
+          m_waiters.remove(w);
+          w->notified = true;
+          w->scheduler->schedule(w->fiber);
+        }
+      });
+    }
+    lock.unlock();
+    Fiber::YieldToHold();
+    if (timer) {
+      timer->cancel();
+    }
+    lock.lock();
+    now = cool::GetCurrentMS();
+  }
+  // 关掉的连接空出了名额, 让等待的协程重新检查
+  notifyWaiters(invalid.size());
+  lock.unlock();
+
+  for (auto i : invalid) {
+    delete i;
+  }
+  HttpResult::Error e = HttpResult::Error::POOL_GET_CONNECTION;
+  if (create) {
+    conn = createConnection(timeout_ms, e);
+    if (!conn) {
+      MutexType::Lock lock(m_mutex);
+      --m_total;
+      notifyWaiters(1);
+    }
+  }
+  if (!conn) {
+    if (err) {
+      *err = e;
+    }
+    return nullptr;
+  }
+  return HttpConnection::ptr(
+      conn, std::bind(&HttpConnectionPool::ReleasePtr, std::placeholders::_1,
+                      this));
+}
+
+void HttpConnectionPool::ReleasePtr(HttpConnection *conn,
+                                    HttpConnectionPool *pool) {
+  uint64_t now = cool::GetCurrentMS();
+  {
+    MutexType::Lock lock(pool->m_mutex);
+    if (conn->isConnected() &&
+        (!pool->m_maxRequest || conn->requestCount() < pool->m_maxRequest)) {
+      conn->m_lastActive = now;
+      pool->m_idle.push_back(conn);
+      conn = nullptr;
+    } else {
+      --pool->m_total;
+    }
+    pool->notifyWaiters(1);
+  }
+  delete conn;
+}
+
+void HttpConnectionPool::evictIdle() {
+  uint64_t now = cool::GetCurrentMS();
+  std::vector<HttpConnection *> expired;
+  {
+    MutexType::Lock lock(m_mutex);
+    // 除了空闲超时, 也顺便清理已经被对端关闭的连接
+    for (auto it = m_idle.begin(); it != m_idle.end();) {
+      if (isReusable(*it, now)) {
+        ++it;
+      } else {
+        expired.push_back(*it);
+        it = m_idle.erase(it);
+        --m_total;
+      }
+    }
+    notifyWaiters(expired.size());
+  }
+  for (auto i : expired) {
+    delete i;
+  }
+}
+
+HttpResult::ptr
+HttpConnectionPool::doGet(const std::string &path, uint64_t timeout_ms,
+                          const std::map<std::string, std::string> &headers,
+                          const std::string &body) {
+  return doRequest(http_method::GET, path, timeout_ms, headers, body);
+}
+
+HttpResult::ptr
+HttpConnectionPool::doPost(const std::string &path, uint64_t timeout_ms,
+                           const std::map<std::string, std::string> &headers,
+                           const std::string &body) {
+  return doRequest(http_method::POST, path, timeout_ms, headers, body);
+}
+
+HttpResult::ptr
+HttpConnectionPool::doRequest(http_method method, const std::string &path,
+                              uint64_t timeout_ms,
+                              const std::map<std::string, std::string> &headers,
+                              const std::string &body) {
+  HttpRequest::ptr req(new HttpRequest(0x11, false));
+  req->method(method);
+  size_t pos = path.find('?');
+  req->path(pos == 0 || path.empty() ? StringView("/")
+                                     : StringView(path).substr(0, pos));
+  if (pos != std::string::npos) {
+    req->query(StringView(path).substr(pos + 1));
+  }
+  for (auto &i : headers) {
+    if (equals_ignore_case(i.first, "connection")) {
+      req->setClose(!equals_ignore_case(i.second, "keep-alive"));
+      continue;
+    }
+    req->setHeader(i.first, i.second);
+  }
+  if (!body.empty()) {
+    req->body(body);
+  }
+  return doRequest(req, timeout_ms);
+}
+
+HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req,
+                                              uint64_t timeout_ms) {
+  if (!req->hasHeader("Host")) {
+    req->setHeader("Host", m_port == 80
+                               ? m_host
+                               : m_host + ":" + std::to_string(m_port));
+  }
+  HttpResult::Error err = HttpResult::Error::OK;
+  HttpConnection::ptr conn = getConnection(timeout_ms, &err);
+  if (!conn) {
+    return std::make_shared<HttpResult>(
+        err, nullptr,
+        "get connection fail: " + m_host + ":" + std::to_string(m_port));
+  }
+  Socket::ptr sock = conn->socket();
+  sock->sendTimeout(timeout_ms);
+  sock->recvTimeout(timeout_ms);
+  int rt = conn->sendRequest(req);
+  if (rt == 0) {
+    conn->close();
+    return std::make_shared<HttpResult>(
+        HttpResult::Error::SEND_CLOSE_BY_PEER, nullptr,
+        "send request closed by peer: " + sock->remoteAddress()->to_string());
+  }
+  if (rt < 0) {
+    int e = errno;
+    conn->close();
+    return std::make_shared<HttpResult>(
+        e == ETIMEDOUT ? HttpResult::Error::TIMEOUT
+                       : HttpResult::Error::SEND_SOCKET_ERROR,
+        nullptr, std::string("send request socket error: ") + strerror(e));
+  }
+  HttpResponse::ptr rsp = conn->recvResponse(req->method() == http_method::HEAD);
+  if (!rsp) {
+    int e = errno;
+    return std::make_shared<HttpResult>(
+        e == ETIMEDOUT ? HttpResult::Error::TIMEOUT
+                       : HttpResult::Error::RECV_ERROR,
+        nullptr, std::string("recv response fail: ") + strerror(e));
+  }
+  return std::make_shared<HttpResult>(HttpResult::Error::OK, rsp, "ok");
+}
+
+} /* namespace http */
+} /* namespace cool */
@@ -0,0 +1,152 @@
+#ifndef __COOL_HTTP_CONNECTION_H
+#define __COOL_HTTP_CONNECTION_H
+
+#include "http.h"
+#include "http_parser.h"
+#include "src/address.h"
+#include "src/socket_stream.h"
+#include "src/thread.h"
+#include "src/timer.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cool {
+namespace http {
+
+struct HttpResult {
+  using ptr = std::shared_ptr<HttpResult>;
+  enum class Error {
+    OK = 0,
+    // 解析不到host对应的地址
+    INVALID_HOST,
+    CONNECT_FAIL,
+    // 连接池已满, 等待超时
+    POOL_GET_CONNECTION,
+    SEND_CLOSE_BY_PEER,
+    SEND_SOCKET_ERROR,
+    RECV_ERROR,
+    // 读写超过了timeout_ms
+    TIMEOUT,
+  };
+  HttpResult(Error r, HttpResponse::ptr rsp, const std::string &e)
+      : result(r), response(rsp), error(e) {}
+  std::string to_string() const;
+
+  Error result;
+  HttpResponse::ptr response;
+  std::string error;
+};
+
+class HttpConnectionPool;
+
+// 客户端连接, 发送一个请求后读取完整的响应, 响应要求关闭时关闭连接
+class HttpConnection : public SocketStream {
+  friend class HttpConnectionPool;
+
+public:
+  using ptr = std::shared_ptr<HttpConnection>;
+  HttpConnection(Socket::ptr sock, bool owner = true);
+
+  // 返回值与writeFixSize相同
+  int sendRequest(HttpRequest::ptr req);
+  // body读入内存, 出错时关闭连接返回nullptr, errno为ETIMEDOUT表示超时
+  // head为true表示对应HEAD请求, 响应没有body
+  HttpResponse::ptr recvResponse(bool head = false);
+
+  uint64_t createTime() const { return m_createTime; }
+  uint64_t lastActive() const { return m_lastActive; }
+  uint32_t requestCount() const { return m_requests; }
+
+private:
+  HttpResponse::ptr error();
+  // 读一行, 不包含行尾的\r\n, 返回的视图在下一次读之前有效
+  bool readLine(StringView &line);
+  // 先取缓冲区里剩下的数据, 不够再从连接读
+  bool readData(char *buffer, size_t length);
+  bool readChunkedBody(std::string &body);
+  bool readUntilClose(std::string &body);
+
+private:
+  uint64_t m_createTime;
+  uint64_t m_lastActive;
+  uint32_t m_requests = 0;
+  HttpResponseParser m_parser;
+  // [m_pos, m_len)是读到但还没有处理的数据
+  std::vector<char> m_buffer;
+  size_t m_pos = 0;
+  size_t m_len = 0;
+};
+
+// 同一个host:port的连接池, 连接在响应之后放回池中复用(keep-alive)
+// 同时存在的连接数不超过max_size, 超过时挂起当前协程等待其他请求归还连接
+// 空闲超过max_idle_ms的连接由IOManager的定时器关闭
+// 需要由shared_ptr持有, 并且比取出的连接活得更久
+class HttpConnectionPool
+    : public std::enable_shared_from_this<HttpConnectionPool> {
+public:
+  using ptr = std::shared_ptr<HttpConnectionPool>;
+  using MutexType = Mutex;
+
+  // host用于解析地址和填写Host头部, max_request为一个连接最多处理的请求数(0不限制)
+  HttpConnectionPool(const std::string &host, uint16_t port,
+                     uint32_t max_size = 32, uint64_t max_idle_ms = 30000,
+                     uint32_t max_request = 0);
+  ~HttpConnectionPool();
+
+  // 连接数已满时最多等待timeout_ms, 失败返回nullptr, 原因写入err
+  // 取出的连接析构时自动放回池中
+  HttpConnection::ptr getConnection(uint64_t timeout_ms = -1,
+                                    HttpResult::Error *err = nullptr);
+
+  HttpResult::ptr doGet(const std::string &path, uint64_t timeout_ms,
+                        const std::map<std::string, std::string> &headers = {},
+                        const std::string &body = "");
+  HttpResult::ptr doPost(const std::string &path, uint64_t timeout_ms,
+                         const std::map<std::string, std::string> &headers = {},
+                         const std::string &body = "");
+  HttpResult::ptr
+  doRequest(http_method method, const std::string &path, uint64_t timeout_ms,
+            const std::map<std::string, std::string> &headers = {},
+            const std::string &body = "");
+  // timeout_ms同时用作等待连接, 连接, 发送和每次接收的超时
+  HttpResult::ptr doRequest(HttpRequest::ptr req, uint64_t timeout_ms);
+
+  const std::string &host() const { return m_host; }
+  uint16_t port() const { return m_port; }
+  // 空闲连接数和总连接数(包括正在使用的)
+  size_t idleCount();
+  size_t totalCount();
+
+private:
+  struct Waiter;
+  static void ReleasePtr(HttpConnection *conn, HttpConnectionPool *pool);
+  HttpConnection *createConnection(uint64_t timeout_ms, HttpResult::Error &err);
+  // 空闲连接是否还能继续使用
+  bool isReusable(HttpConnection *conn, uint64_t now);
+  // 释放了count个名额, 唤醒等待的协程, 需要持有锁
+  void notifyWaiters(size_t count);
+  void evictIdle();
+
+private:
+  std::string m_host;
+  uint16_t m_port;
+  uint32_t m_maxSize;
+  uint64_t m_maxIdle;
+  uint32_t m_maxRequest;
+
+  MutexType m_mutex;
+  Address::ptr m_address;
+  // 最近归还的在尾部, 优先复用
+  std::list<HttpConnection *> m_idle;
+  std::list<std::shared_ptr<Waiter>> m_waiters;
+  uint32_t m_total = 0;
+  Timer::ptr m_timer;
+};
+
+} /* namespace http */
+} /* namespace cool */
+
+#endif /* ifndef __COOL_HTTP_CONNECTION_H */
@@ -0,0 +1,68 @@
+#include "http_header.h"
+#include <strings.h>
+
+namespace cool {
+namespace http {
+
+static inline unsigned char to_lower(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+uint32_t header_hash(StringView v) {
+  uint32_t hash = 2166136261u;
+  for (char c : v) {
+    hash ^= to_lower(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool equals_ignore_case(StringView lhs, StringView rhs) {
+  return lhs.size() == rhs.size() &&
+         strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+namespace {
+struct KnownHeader {
+  http_header id;
+  const char *name;
+  uint32_t hash;
+};
+
+static KnownHeader s_headers[] = {
+#define XX(num, name, string) {http_header::name, string, 0},
+    HTTP_HEADER_MAP(XX)
+#undef XX
+};
+static const size_t s_header_count = sizeof(s_headers) / sizeof(s_headers[0]);
+
+struct _KnownHeaderIniter {
+  _KnownHeaderIniter() {
+    for (auto &i : s_headers) {
+      i.hash = header_hash(i.name);
+    }
+  }
+};
+
+static _KnownHeaderIniter _init;
+} // namespace
+
+http_header chars_to_http_header(StringView v, uint32_t hash) {
+  for (auto &i : s_headers) {
+    if (i.hash == hash && equals_ignore_case(i.name, v)) {
+      return i.id;
+    }
+  }
+  return http_header::UNKNOWN;
+}
+
+const char *http_header_to_chars(http_header v) {
+  size_t index = (size_t)v;
+  if (index == 0 || index > s_header_count) {
+    return "<unknow>";
+  }
+  return s_headers[index - 1].name;
+}
+
+} // namespace http
+} // namespace cool
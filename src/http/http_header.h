@@ -0,0 +1,222 @@
+#ifndef __COOL_HTTP_HEADER_H
+#define __COOL_HTTP_HEADER_H
+
+#include <boost/lexical_cast.hpp>
+#include <boost/utility/string_view.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cool {
+namespace http {
+
+using StringView = boost::string_view;
+
+/* Well-known Headers */
+#define HTTP_HEADER_MAP(XX)                        \
+  XX(1, HOST, "Host")                              \
+  XX(2, CONNECTION, "Connection")                  \
+  XX(3, CONTENT_LENGTH, "Content-Length")          \
+  XX(4, CONTENT_TYPE, "Content-Type")              \
+  XX(5, TRANSFER_ENCODING, "Transfer-Encoding")    \
+  XX(6, KEEP_ALIVE, "Keep-Alive")                  \
+  XX(7, USER_AGENT, "User-Agent")                  \
+  XX(8, ACCEPT, "Accept")                          \
+  XX(9, ACCEPT_ENCODING, "Accept-Encoding")        \
+  XX(10, CONTENT_ENCODING, "Content-Encoding")     \
+  XX(11, COOKIE, "Cookie")                         \
+  XX(12, SET_COOKIE, "Set-Cookie")                 \
+  XX(13, DATE, "Date")                             \
+  XX(14, SERVER, "Server")                         \
+  XX(15, EXPECT, "Expect")                         \
+  XX(16, UPGRADE, "Upgrade")                       \
+  XX(17, LOCATION, "Location")
+
+enum class http_header : uint8_t {
+  UNKNOWN = 0,
+#define XX(num, name, string) name = num,
+  HTTP_HEADER_MAP(XX)
+#undef XX
+};
+
+// 大小写无关的FNV-1a
+uint32_t header_hash(StringView v);
+bool equals_ignore_case(StringView lhs, StringView rhs);
+// 不是常用头部时返回UNKNOWN
+http_header chars_to_http_header(StringView v, uint32_t hash);
+const char *http_header_to_chars(http_header v);
+
+// 整数直接解析, 不分配内存也不抛异常, 溢出或者有多余字符时返回false
+template <class T>
+typename std::enable_if<std::is_integral<T>::value &&
+                            !std::is_same<T, bool>::value,
+                        bool>::type
+parse_value(StringView v, T &val) {
+  size_t i = 0;
+  size_t n = v.size();
+  while (i < n && (v[i] == ' ' || v[i] == '\t')) {
+    ++i;
+  }
+  while (n > i && (v[n - 1] == ' ' || v[n - 1] == '\t')) {
+    --n;
+  }
+  bool neg = false;
+  if (i < n && (v[i] == '+' || v[i] == '-')) {
+    neg = v[i] == '-';
+    if (neg && !std::is_signed<T>::value) {
+      return false;
+    }
+    ++i;
+  }
+  if (i == n) {
+    return false;
+  }
+  using U = typename std::make_unsigned<T>::type;
+  U limit = (U)std::numeric_limits<T>::max() + (neg ? 1 : 0);
+  U rt = 0;
+  for (; i < n; ++i) {
+    unsigned d = (unsigned char)v[i] - '0';
+    if (d > 9 || rt > (U)((limit - d) / 10)) {
+      return false;
+    }
+    rt = rt * 10 + d;
+  }
+  val = neg ? (T)(0 - rt) : (T)rt;
+  return true;
+}
+
+template <class T>
+typename std::enable_if<!std::is_integral<T>::value ||
+                            std::is_same<T, bool>::value,
+                        bool>::type
+parse_value(StringView v, T &val) {
+  try {
+    val = boost::lexical_cast<T>(v.data(), v.size());
+    return true;
+  } catch (...) {}
+  return false;
+}
+
+// 头部个数不超过N时不分配内存的扁平容器, 按插入顺序保存
+// 插入时算好大小写无关的hash和常用头部id, 查找先比hash再比字符串
+template <class T, size_t N = 16> class HeaderMap {
+public:
+  struct Entry {
+    T first;
+    T second;
+    uint32_t hash = 0;
+    http_header id = http_header::UNKNOWN;
+  };
+  using key_type = T;
+  using value_type = Entry;
+  using iterator = Entry *;
+  using const_iterator = const Entry *;
+
+  iterator begin() { return data(); }
+  iterator end() { return data() + m_size; }
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + m_size; }
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  // 保留已经分配的空间, 供下一个请求复用
+  void clear() {
+    m_size = 0;
+    m_heap.clear();
+  }
+
+  iterator find(StringView key) {
+    uint32_t hash = header_hash(key);
+    for (auto it = begin(); it != end(); ++it) {
+      if (it->hash == hash && equals_ignore_case(it->first, key)) {
+        return it;
+      }
+    }
+    return end();
+  }
+  const_iterator find(StringView key) const {
+    return const_cast<HeaderMap *>(this)->find(key);
+  }
+  iterator find(http_header id) {
+    for (auto it = begin(); it != end(); ++it) {
+      if (it->id == id) {
+        return it;
+      }
+    }
+    return end();
+  }
+  const_iterator find(http_header id) const {
+    return const_cast<HeaderMap *>(this)->find(id);
+  }
+
+  // 已经存在时覆盖原来的值
+  template <class K, class V> void set(K &&key, V &&val) {
+    StringView k(key);
+    uint32_t hash = header_hash(k);
+    for (auto it = begin(); it != end(); ++it) {
+      if (it->hash == hash && equals_ignore_case(it->first, k)) {
+        it->second = std::forward<V>(val);
+        return;
+      }
+    }
+    Entry &e = append();
+    e.id = chars_to_http_header(k, hash);
+    e.hash = hash;
+    e.first = std::forward<K>(key);
+    e.second = std::forward<V>(val);
+  }
+
+  iterator erase(iterator it) {
+    for (auto i = it; i + 1 != end(); ++i) {
+      *i = std::move(*(i + 1));
+    }
+    if (m_heap.empty()) {
+      --m_size;
+    } else {
+      m_heap.pop_back();
+      m_size = m_heap.size();
+    }
+    return it;
+  }
+  size_t erase(StringView key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    erase(it);
+    return 1;
+  }
+
+private:
+  Entry *data() { return m_heap.empty() ? m_inline : &m_heap[0]; }
+  const Entry *data() const { return m_heap.empty() ? m_inline : &m_heap[0]; }
+
+  Entry &append() {
+    if (m_heap.empty() && m_size < N) {
+      return m_inline[m_size++];
+    }
+    if (m_heap.empty()) {
+      m_heap.reserve(N * 2);
+      for (size_t i = 0; i < m_size; ++i) {
+        m_heap.push_back(std::move(m_inline[i]));
+      }
+    }
+    m_heap.emplace_back();
+    m_size = m_heap.size();
+    return m_heap.back();
+  }
+
+private:
+  Entry m_inline[N];
+  // 超过N个之后全部搬到这里
+  std::vector<Entry> m_heap;
+  size_t m_size = 0;
+};
+
+} // namespace http
+} // namespace cool
+
+#endif /* __COOL_HTTP_HEADER_H */
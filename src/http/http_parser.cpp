@@ -18,36 +18,34 @@ static cool::ConfigVar<uint64_t>::ptr g_http_request_buffer_size =
     cool::Config::lookup("http.request.buffer_size", 4 * 1024ul,
                          "http request buffer size");
 static cool::ConfigVar<uint64_t>::ptr g_http_request_max_body_size =
-    cool::Config::lookup("http.request.max_body_size", 64 * 1024 * 1024ul,
+    cool::Config::lookup("http.request.max_body_size", 1024 * 1024 * 1024ul,
                          "http request max body size");
+static cool::ConfigVar<uint64_t>::ptr g_http_request_stream_body_size =
+    cool::Config::lookup("http.request.stream_body_size", 1024 * 1024ul,
+                         "http request body larger than this is streamed");
 
-static uint64_t s_http_request_buffer_size = 0;
-static uint64_t s_http_request_max_body_size = 0;
+static cool::ConfigVar<uint64_t>::ptr g_http_response_buffer_size =
+    cool::Config::lookup("http.response.buffer_size", 4 * 1024ul,
+                         "http response buffer size");
+static cool::ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
+    cool::Config::lookup("http.response.max_body_size", 64 * 1024 * 1024ul,
+                         "http response max body size");
 
+// 直接读取配置, ConfigVar::get_value不加锁, 修改后下一个请求立即生效
 uint64_t HttpRequestParser::GetHttpRequestBufferSize() {
-  return s_http_request_buffer_size;
+  return g_http_request_buffer_size->get_value();
 }
 uint64_t HttpRequestParser::GetHttpRequestMaxBodySize() {
-  return s_http_request_max_body_size;
-}
-
-namespace {
-struct _RequestSizeIniter {
-  _RequestSizeIniter() {
-    s_http_request_buffer_size = g_http_request_buffer_size->get_value();
-    g_http_request_buffer_size->add_listener(
-        [](const uint64_t &ov, const uint64_t &nv) {
-          s_http_request_buffer_size = nv;
-        });
-    s_http_request_max_body_size = g_http_request_max_body_size->get_value();
-    g_http_request_max_body_size->add_listener(
-        [](const uint64_t &ov, const uint64_t &nv) {
-          s_http_request_max_body_size = nv;
-        });
-  }
-};
-
-static _RequestSizeIniter _init;
+  return g_http_request_max_body_size->get_value();
+}
+uint64_t HttpRequestParser::GetHttpRequestStreamBodySize() {
+  return g_http_request_stream_body_size->get_value();
+}
+uint64_t HttpResponseParser::GetHttpResponseBufferSize() {
+  return g_http_response_buffer_size->get_value();
+}
+uint64_t HttpResponseParser::GetHttpResponseMaxBodySize() {
+  return g_http_response_max_body_size->get_value();
 }
 
 void on_request_method(void *data, const char *at, size_t length) {
@@ -67,15 +65,15 @@ void on_request_uri(void *data, const char *at, size_t length) {
 }
 void on_request_fragment(void *data, const char *at, size_t length) {
   auto parser = static_cast<HttpRequestParser *>(data);
-  parser->m_data->fragment(std::string(at, length));
+  parser->m_data->fragmentView(StringView(at, length));
 }
 void on_request_path(void *data, const char *at, size_t length) {
   auto parser = static_cast<HttpRequestParser *>(data);
-  parser->m_data->path(std::string(at, length));
+  parser->m_data->pathView(StringView(at, length));
 }
 void on_request_query(void *data, const char *at, size_t length) {
   auto parser = static_cast<HttpRequestParser *>(data);
-  parser->m_data->query(std::string(at, length));
+  parser->m_data->queryView(StringView(at, length));
 }
 void on_request_version(void *data, const char *at, size_t length) {
   auto parser = static_cast<HttpRequestParser *>(data);
@@ -93,7 +91,17 @@ void on_request_version(void *data, const char *at, size_t length) {
   parser->m_data->version(v);
 }
 
-void on_request_header_done(void *data, const char *at, size_t length) {}
+void on_request_header_done(void *data, const char *at, size_t length) {
+  auto parser = static_cast<HttpRequestParser *>(data);
+  HttpRequest &req = *parser->m_data;
+  // HTTP/1.1默认keep-alive, HTTP/1.0默认关闭
+  StringView conn = req.getHeader(http_header::CONNECTION);
+  if (conn.empty()) {
+    req.setClose(req.version() != 0x11);
+  } else {
+    req.setClose(!equals_ignore_case(conn, "keep-alive"));
+  }
+}
 
 void on_request_http_field(void *data, const char *field, size_t flen,
                            const char *value, size_t vlen) {
@@ -103,7 +111,8 @@ void on_request_http_field(void *data, const char *field, size_t flen,
     // parser->m_error = 1002;
     return;
   }
-  parser->m_data->setHeader(std::string(field, flen), std::string(value, vlen));
+  parser->m_data->setHeaderView(StringView(field, flen),
+                                StringView(value, vlen));
 }
 
 HttpRequestParser::HttpRequestParser() : m_error(0) {
@@ -121,13 +130,36 @@ HttpRequestParser::HttpRequestParser() : m_error(0) {
 }
 
 uint64_t HttpRequestParser::content_length() {
-  return m_data->getHeaderAs<uint64_t>("content-length", 0);
+  return m_data->getHeaderAs<uint64_t>(http_header::CONTENT_LENGTH, 0);
+}
+
+// chunked必须是最后一个编码, 如 "gzip, chunked"
+static bool is_chunked(StringView v) {
+  while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) {
+    v.remove_suffix(1);
+  }
+  return v.size() >= 7 &&
+         equals_ignore_case(v.substr(v.size() - 7), "chunked") &&
+         (v.size() == 7 || v[v.size() - 8] == ',' || v[v.size() - 8] == ' ');
+}
+
+bool HttpRequestParser::isChunked() {
+  return is_chunked(m_data->getHeader(http_header::TRANSFER_ENCODING));
 }
 
-size_t HttpRequestParser::execute(char *data, size_t len) {
-  size_t offset = http_parser_execute(&m_parser, data, len, 0);
-  memmove(data, data + offset, (len - offset));
-  return offset;
+void HttpRequestParser::reset() {
+  // 上一个请求还被别人持有时不能原地清空
+  if (m_data.use_count() > 1) {
+    m_data.reset(new cool::http::HttpRequest);
+  } else {
+    m_data->reset();
+  }
+  m_error = 0;
+  http_parser_init(&m_parser);
+}
+
+size_t HttpRequestParser::execute(char *data, size_t len, size_t off) {
+  return http_parser_execute(&m_parser, data, len, off);
 }
 
 int HttpRequestParser::isFinished() { return http_parser_finish(&m_parser); }
@@ -166,7 +198,17 @@ void on_response_version(void *data, const char *at, size_t length) {
   parser->m_data->version(v);
 }
 
-void on_response_header_done(void *data, const char *at, size_t length) {}
+void on_response_header_done(void *data, const char *at, size_t length) {
+  auto parser = static_cast<HttpResponseParser *>(data);
+  HttpResponse &rsp = *parser->m_data;
+  // 与请求相同, HTTP/1.1默认keep-alive
+  auto it = rsp.headers().find(http_header::CONNECTION);
+  if (it == rsp.headers().end()) {
+    rsp.setClose(rsp.version() != 0x11);
+  } else {
+    rsp.setClose(!equals_ignore_case(it->second, "keep-alive"));
+  }
+}
 
 void on_response_last_chunk(void *data, const char *at, size_t length) {}
 
@@ -195,13 +237,22 @@ HttpResponseParser::HttpResponseParser() : m_error(0) {
 }
 
 uint64_t HttpResponseParser::content_length() {
-  return m_data->getHeaderAs<uint64_t>("content-length", 0);
+  return m_data->getHeaderAs<uint64_t>(http_header::CONTENT_LENGTH, 0);
+}
+
+bool HttpResponseParser::isChunked() {
+  auto it = m_data->headers().find(http_header::TRANSFER_ENCODING);
+  return it != m_data->headers().end() && is_chunked(it->second);
+}
+
+void HttpResponseParser::reset() {
+  m_data.reset(new cool::http::HttpResponse);
+  m_error = 0;
+  httpclient_parser_init(&m_parser);
 }
 
-size_t HttpResponseParser::execute(char *data, size_t len) {
-  size_t offset = httpclient_parser_execute(&m_parser, data, len, 0);
-  memmove(data, data + offset, (len - offset));
-  return offset;
+size_t HttpResponseParser::execute(char *data, size_t len, size_t off) {
+  return httpclient_parser_execute(&m_parser, data, len, off);
 }
 
 int HttpResponseParser::isFinished() {
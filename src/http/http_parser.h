@@ -14,16 +14,24 @@ public:
   using ptr = std::shared_ptr<HttpRequestParser>;
   HttpRequestParser();
 
-  size_t execute(char *data, size_t len);
+  // data从头累积读到的数据, off是上一次的返回值, 返回已经解析到的位置
+  // 不移动数据, 解析出的路径和头部都是指向data的视图
+  size_t execute(char *data, size_t len, size_t off = 0);
+  // 复用解析器解析同一个连接上的下一个请求
+  void reset();
   int isFinished();
   int hasError();
 
   // HttpRequest::ptr data() const { return m_data; }
 
   uint64_t content_length();
+  // Transfer-Encoding 以 chunked 结尾
+  bool isChunked();
 public:
   static uint64_t GetHttpRequestBufferSize();
   static uint64_t GetHttpRequestMaxBodySize();
+  // 超过这个大小的body或者chunked编码的body不读入内存, 通过bodyStream读取
+  static uint64_t GetHttpRequestStreamBodySize();
 
 public:
   int m_error; // 0: valid, 1000: invalid method, 1001: invalid version, 1002 invalid field
@@ -40,12 +48,20 @@ public:
   using ptr = std::shared_ptr<HttpResponseParser>;
   HttpResponseParser();
 
-  size_t execute(char *data, size_t len);
+  // 与HttpRequestParser::execute相同, data需要以'\0'结尾
+  size_t execute(char *data, size_t len, size_t off = 0);
+  // 解析同一个连接上的下一个响应, 已经解析出的响应交给调用方, 这里重新分配
+  void reset();
   int isFinished();
   int hasError();
 
   // HttpResponse::ptr data() const { return m_data; }
   uint64_t content_length();
+  bool isChunked();
+
+public:
+  static uint64_t GetHttpResponseBufferSize();
+  static uint64_t GetHttpResponseMaxBodySize();
 
 public:
   HttpResponse::ptr m_data;
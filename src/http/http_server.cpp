@@ -31,8 +31,12 @@ void HttpServer::handle_client(Socket::ptr client) {
     // LOG_DEBUG(g_logger) << "request: " << std::endl << *req;
     // LOG_DEBUG(g_logger) << "response: " << std::endl << *rsp;
 
-    session->sendResponse(rsp);
-  } while (m_is_keep_alive);
+    // 流水线中后面还有请求时先不发, 和后面的响应合并成一次写
+    bool more = !rsp->isClose() && session->hasBufferedRequest();
+    if (session->sendResponse(rsp, !more) < 0 || rsp->isClose()) {
+      break;
+    }
+  } while (true);
   session->close();
 }
 
@@ -1,81 +1,463 @@
 #include "http_parser.h"
 #include "http_session.h"
 #include "src/log.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <memory>
-#include <sstream>
 #include <string>
 
 namespace cool {
 LOGGER_DEF(g_logger, "system");
 namespace http {
 
+HttpRequestBodyStream::HttpRequestBodyStream(HttpSession *session,
+                                             uint64_t length, bool chunked)
+    : m_session(session), m_chunked(chunked),
+      m_state(chunked ? CHUNK_SIZE : (length ? DATA : DONE)),
+      m_left(chunked ? 0 : length) {}
+
+int HttpRequestBodyStream::read(void *buffer, size_t length) {
+  while (m_state != DATA) {
+    if (m_state == DONE) {
+      return 0;
+    }
+    if (m_state == ERROR || !nextChunk()) {
+      m_state = ERROR;
+      return -1;
+    }
+  }
+  if (length == 0) {
+    return 0;
+  }
+  int rt = m_session ? m_session->readBody(
+                           buffer, std::min<uint64_t>(length, m_left))
+                     : -1;
+  if (rt <= 0) {
+    m_state = ERROR;
+    return -1;
+  }
+  m_left -= rt;
+  m_total += rt;
+  if (m_left == 0) {
+    m_state = m_chunked ? CHUNK_END : DONE;
+  }
+  return rt;
+}
+
+int HttpRequestBodyStream::read(ByteArray::ptr ba, size_t length) {
+  std::vector<iovec> iovs;
+  if (ba->getWriteBuffers(iovs, length) == 0) {
+    return 0;
+  }
+  int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+  if (rt > 0) {
+    ba->position(ba->position() + rt);
+  }
+  return rt;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+bool HttpRequestBodyStream::nextChunk() {
+  StringView line;
+  if (!m_session || !m_session->readLine(line)) {
+    return false;
+  }
+  switch (m_state) {
+  case CHUNK_END:
+    // chunk数据后面紧跟\r\n
+    if (!line.empty()) {
+      return false;
+    }
+    m_state = CHUNK_SIZE;
+    return true;
+  case CHUNK_SIZE: {
+    // 16进制长度, 后面可能有 ";name=value" 扩展, 忽略
+    uint64_t size = 0;
+    size_t i = 0;
+    for (int d = 0; i < line.size() && (d = hex_value(line[i])) >= 0; ++i) {
+      if (size >> 60) {
+        return false;
+      }
+      size = size * 16 + d;
+    }
+    if (i == 0 || (i < line.size() && line[i] != ';' && line[i] != ' ' &&
+                   line[i] != '\t')) {
+      LOG_DEBUG(g_logger) << "invalid chunk size: " << line;
+      return false;
+    }
+    if (m_total + size > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+      LOG_DEBUG(g_logger) << "http request body too large, length="
+                          << m_total + size;
+      return false;
+    }
+    if (size == 0) {
+      m_state = TRAILER;
+    } else {
+      m_left = size;
+      m_state = DATA;
+    }
+    return true;
+  }
+  case TRAILER:
+    // 忽略trailer中的头部, 直到空行
+    if (line.empty()) {
+      m_state = DONE;
+    }
+    return true;
+  default:
+    return false;
+  }
+}
+
+void HttpRequestBodyStream::close() {
+  char buf[4096];
+  while (m_state != DONE && m_state != ERROR) {
+    if (read(buf, sizeof(buf)) < 0) {
+      break;
+    }
+  }
+}
+
+HttpResponseBodyStream::HttpResponseBodyStream(HttpSession *session,
+                                               bool chunked)
+    : m_session(session), m_chunked(chunked) {}
+
+int HttpResponseBodyStream::write(const void *buffer, size_t length) {
+  if (length == 0) {
+    return 0;
+  }
+  m_iovs.clear();
+  iovec iov;
+  iov.iov_base = (void *)buffer;
+  iov.iov_len = length;
+  m_iovs.push_back(iov);
+  return writeChunk(length);
+}
+
+int HttpResponseBodyStream::write(ByteArray::ptr ba, size_t length) {
+  m_iovs.clear();
+  uint64_t n = ba->getReadBuffers(m_iovs, length);
+  if (n == 0) {
+    return 0;
+  }
+  int rt = writeChunk(n);
+  if (rt > 0) {
+    ba->position(ba->position() + rt);
+  }
+  return rt;
+}
+
+int HttpResponseBodyStream::writeChunk(size_t length) {
+  if (m_closed || !m_session || !m_good) {
+    return -1;
+  }
+  if (m_chunked) {
+    iovec iov;
+    iov.iov_base = m_chunkHead;
+    iov.iov_len = snprintf(m_chunkHead, sizeof(m_chunkHead), "%zx\r\n", length);
+    m_iovs.insert(m_iovs.begin(), iov);
+    iov.iov_base = (void *)"\r\n";
+    iov.iov_len = 2;
+    m_iovs.push_back(iov);
+  }
+  int64_t rt = m_session->writeFixSize(&m_iovs[0], m_iovs.size());
+  if (rt <= 0) {
+    m_good = false;
+    return -1;
+  }
+  return length;
+}
+
+void HttpResponseBodyStream::close() {
+  if (m_closed) {
+    return;
+  }
+  m_closed = true;
+  if (m_chunked && m_session && m_good) {
+    static const char s_last_chunk[] = "0\r\n\r\n";
+    m_good =
+        m_session->writeFixSize(s_last_chunk, sizeof(s_last_chunk) - 1) > 0;
+  }
+}
+
 HttpSession::HttpSession(Socket::ptr sock, bool owner)
     : SocketStream(sock, owner) {}
 
+HttpSession::~HttpSession() {
+  // servlet可能还持有body流, 会话没了之后流的读写都返回错误
+  if (m_requestBody) {
+    m_requestBody->m_session = nullptr;
+  }
+  if (m_responseBody) {
+    m_responseBody->m_session = nullptr;
+  }
+}
+
+// 排队的响应超过这么多个或者头部超过这么大时先发出去
+static const size_t s_max_pending_responses = 16;
+static const size_t s_max_pending_bytes = 64 * 1024;
+
 HttpRequest::ptr HttpSession::recvRequest() {
-  HttpRequestParser::ptr parser(new HttpRequestParser);
+  HttpRequest::ptr req = parseRequest();
+  if (!req) {
+    // 出错之前已经处理完的请求, 响应还要发出去
+    flush();
+    close();
+  }
+  return req;
+}
+
+HttpRequest::ptr HttpSession::parseRequest() {
   uint64_t buf_size = HttpRequestParser::GetHttpRequestBufferSize();
-  // uint64_t buf_size = 100;
-
-  std::shared_ptr<char> buffer(new char[buf_size],
-                               [](char *ptr) { delete[] ptr; });
-  char *data = buffer.get();
-  int offset = 0;
-  do {
-    int len = read(data + offset, buf_size - offset);
-    if (len <= 0) {
-      close();
-      LOG_DEBUG(g_logger) << "read len <= 0";
+  if (m_buffer.size() < buf_size) {
+    m_buffer.resize(buf_size);
+  }
+  buf_size = m_buffer.size();
+
+  // 上一个请求的body没有被servlet读完时先读完丢掉, 否则会被当成下一个请求
+  if (m_requestBody) {
+    m_requestBody->close();
+    bool finished = m_requestBody->isFinished();
+    m_requestBody->m_session = nullptr;
+    m_requestBody.reset();
+    if (!finished) {
       return nullptr;
     }
-    len += offset;
-    size_t nparse = parser->execute(data, len);
-    if (parser->hasError()) {
-      close();
-      LOG_DEBUG(g_logger) << "parser execute haserror";
-      return nullptr;
+  }
+  if (m_responseBody) {
+    m_responseBody->close();
+    m_responseBody->m_session = nullptr;
+    m_responseBody.reset();
+  }
+  m_parser.reset();
+
+  // 先解析上一次读进来但还没处理的数据(流水线中的后续请求)
+  size_t nparse = 0;
+  if (m_pos < m_len) {
+    nparse = m_parser.execute(&m_buffer[m_pos], m_len - m_pos, 0);
+  }
+  while (!m_parser.hasError() && !m_parser.isFinished()) {
+    if (m_pos > 0) {
+      // 要继续读了, 把没处理完的数据搬到开头, 之前请求的视图从这里开始失效
+      // 已经解析出的头部也指向旧位置, 搬完之后从头重新解析
+      memmove(&m_buffer[0], &m_buffer[m_pos], m_len - m_pos);
+      m_len -= m_pos;
+      m_pos = 0;
+      m_parser.reset();
+      nparse = 0;
     }
-    offset = len - nparse;
-    if (offset == (int)buf_size) {
-      close();
-      LOG_DEBUG(g_logger) << "offset == (int)buf_size";
+    if (m_len == buf_size) {
+      LOG_DEBUG(g_logger) << "http request header too large";
       return nullptr;
     }
-    if (parser->isFinished()) {
-      break;
+    // 等待后续请求之前, 排队的响应必须先发出去
+    if (flush() < 0) {
+      return nullptr;
     }
-  } while (true);
-  int64_t length = parser->content_length();
-  if (length > 0) {
-    std::string body;
-    body.resize(length);
-    if (length >= offset) {
-      body.append(data, offset);
-    } else {
-      body.append(data, length);
+    int rt = read(&m_buffer[m_len], buf_size - m_len);
+    if (rt <= 0) {
+      LOG_DEBUG(g_logger) << "read len <= 0";
+      return nullptr;
     }
-    length -= offset;
+    m_len += rt;
+    nparse = m_parser.execute(&m_buffer[0], m_len, nparse);
+  }
+  if (m_parser.hasError()) {
+    LOG_DEBUG(g_logger) << "parser execute haserror";
+    return nullptr;
+  }
 
+  char *data = &m_buffer[m_pos];
+  size_t len = m_len - m_pos;
+  HttpRequest::ptr req = m_parser.m_data;
+  uint64_t length = m_parser.content_length();
+  if (length > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+    LOG_DEBUG(g_logger) << "http request body too large, length=" << length;
+    return nullptr;
+  }
+  if (m_parser.isChunked() ||
+      length > HttpRequestParser::GetHttpRequestStreamBodySize()) {
+    // body不读入内存, 读缓冲区之后要用来读body, 请求中的视图先拷贝出来
+    req->detach();
+    m_pos += nparse;
+    m_requestBody.reset(
+        new HttpRequestBodyStream(this, length, m_parser.isChunked()));
+    req->bodyStream(m_requestBody);
+    return req;
+  }
+  size_t offset = len - nparse;
+  if (offset >= length) {
+    // body已经完整地在读缓冲区里, 直接引用, 后面的数据留给下一个请求
     if (length > 0) {
-      if (readFixSize(&body[body.size()], length) <= 0) {
-        close();
-        LOG_DEBUG(g_logger)
-            << "readFixSize(&body[body.size()], length) <= 0";
-        return nullptr;
+      req->bodyView(StringView(data + nparse, length));
+    }
+    m_pos += nparse + length;
+    return req;
+  }
+  std::string body;
+  body.resize(length);
+  memcpy(&body[0], data + nparse, offset);
+  m_pos = m_len = 0;
+  if (flush() < 0 || readFixSize(&body[offset], length - offset) <= 0) {
+    LOG_DEBUG(g_logger) << "readFixSize(&body[offset], length) <= 0";
+    return nullptr;
+  }
+  req->body(std::move(body));
+  return req;
+}
+
+int HttpSession::readBody(void *buffer, size_t length) {
+  if (m_pos == m_len) {
+    m_pos = m_len = 0;
+    if (flush() < 0) {
+      return -1;
+    }
+    // 大块数据直接读到调用方的内存里
+    if (length >= m_buffer.size()) {
+      return read(buffer, length);
+    }
+    int rt = read(&m_buffer[0], m_buffer.size());
+    if (rt <= 0) {
+      return rt;
+    }
+    m_len = rt;
+  }
+  size_t n = std::min(length, m_len - m_pos);
+  memcpy(buffer, &m_buffer[m_pos], n);
+  m_pos += n;
+  return n;
+}
+
+bool HttpSession::readLine(StringView &line) {
+  while (true) {
+    for (size_t i = m_pos; i + 1 < m_len; ++i) {
+      if (m_buffer[i] == '\r' && m_buffer[i + 1] == '\n') {
+        line = StringView(&m_buffer[m_pos], i - m_pos);
+        m_pos = i + 2;
+        return true;
       }
     }
-    parser->m_data->body(body);
+    if (m_pos > 0) {
+      memmove(&m_buffer[0], &m_buffer[m_pos], m_len - m_pos);
+      m_len -= m_pos;
+      m_pos = 0;
+    }
+    if (m_len == m_buffer.size()) {
+      LOG_DEBUG(g_logger) << "http line too long";
+      return false;
+    }
+    if (flush() < 0) {
+      return false;
+    }
+    int rt = read(&m_buffer[m_len], m_buffer.size() - m_len);
+    if (rt <= 0) {
+      return false;
+    }
+    m_len += rt;
   }
-  return parser->m_data;
 }
 
-int HttpSession::sendResponse(HttpResponse::ptr rsp) {
-  std::stringstream ss;
-  ss << *rsp;
-  std::string data = ss.str();
-  return writeFixSize(data.c_str(), data.size());
+HttpResponseBodyStream::ptr
+HttpSession::streamResponse(HttpResponse::ptr rsp) {
+  rsp->setStream(true);
+  if (rsp->version() < 0x11) {
+    // 没有chunked编码, 只能靠关闭连接表示body结束
+    rsp->setClose(true);
+  }
+  rsp->serializeHeader(m_writeBuffer);
+  m_pending.push_back(rsp);
+  m_headerEnds.push_back(m_writeBuffer.size());
+  if (flush() < 0) {
+    return nullptr;
+  }
+  m_responseBody.reset(new HttpResponseBodyStream(this, rsp->version() >= 0x11));
+  return m_responseBody;
+}
+
+int64_t HttpSession::sendResponse(HttpResponse::ptr rsp, bool flush_now) {
+  if (rsp->isStream()) {
+    // 头部已经在streamResponse中发出, 这里只结束body
+    if (!m_responseBody && !streamResponse(rsp)) {
+      return -1;
+    }
+    m_responseBody->close();
+    bool good = m_responseBody->isGood();
+    m_responseBody->m_session = nullptr;
+    m_responseBody.reset();
+    return good ? 0 : -1;
+  }
+  rsp->serializeHeader(m_writeBuffer);
+  m_pending.push_back(rsp);
+  m_headerEnds.push_back(m_writeBuffer.size());
+  if (flush_now || m_pending.size() >= s_max_pending_responses ||
+      m_writeBuffer.size() >= s_max_pending_bytes) {
+    return flush();
+  }
+  return 0;
+}
+
+int64_t HttpSession::flush() {
+  if (m_pending.empty()) {
+    return 0;
+  }
+  int64_t total = 0;
+  int64_t rt = 1;
+  size_t begin = 0;
+  m_iovs.clear();
+  for (size_t i = 0; i < m_pending.size() && rt > 0; ++i) {
+    HttpResponse::ptr &rsp = m_pending[i];
+    iovec iov;
+    iov.iov_base = &m_writeBuffer[begin];
+    iov.iov_len = m_headerEnds[i] - begin;
+    begin = m_headerEnds[i];
+    m_iovs.push_back(iov);
+    if (rsp->isStream()) {
+      continue;
+    }
+    if (rsp->bodyArray()) {
+      rsp->bodyArray()->getReadBuffers(m_iovs);
+    } else if (rsp->bodyFd() < 0 && !rsp->body().empty()) {
+      iov.iov_base = (void *)rsp->body().data();
+      iov.iov_len = rsp->body().size();
+      m_iovs.push_back(iov);
+    }
+    if (rsp->bodyFd() < 0 || rsp->contentLength() == 0) {
+      continue;
+    }
+    // 文件内容用sendfile发送, 先把前面攒下的发掉, 头部不要单独发成一个包
+    rt = writeFixSize(&m_iovs[0], m_iovs.size(), MSG_MORE);
+    m_iovs.clear();
+    if (rt > 0) {
+      total += rt;
+      rt = sendFileFixSize(rsp->bodyFd(), rsp->bodyOffset(),
+                           rsp->contentLength());
+      total += rt > 0 ? rt : 0;
+    }
+  }
+  if (rt > 0 && !m_iovs.empty()) {
+    rt = writeFixSize(&m_iovs[0], m_iovs.size());
+    total += rt > 0 ? rt : 0;
+  }
+  m_iovs.clear();
+  m_pending.clear();
+  m_headerEnds.clear();
+  m_writeBuffer.clear();
+  return rt > 0 ? total : -1;
 }
 
 } /* namespace http */
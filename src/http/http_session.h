@@ -2,20 +2,124 @@
 #define __COOL_HTTP_SESSION_H
 
 #include "http.h"
+#include "http_parser.h"
 #include "src/socket_stream.h"
 #include <memory>
+#include <vector>
 
 namespace cool {
 namespace http {
 
+class HttpSession;
+
+// 从连接上流式读取请求body, 支持Content-Length和chunked编码
+class HttpRequestBodyStream : public Stream {
+public:
+  using ptr = std::shared_ptr<HttpRequestBodyStream>;
+  HttpRequestBodyStream(HttpSession *session, uint64_t length, bool chunked);
+
+  // 返回0表示body已经读完, 出错返回-1
+  virtual int read(void *buffer, size_t length) override;
+  virtual int read(ByteArray::ptr ba, size_t length) override;
+  virtual int write(const void *buffer, size_t length) override { return -1; }
+  virtual int write(ByteArray::ptr ba, size_t length) override { return -1; }
+  // 读完并丢弃剩下的body, 连接才能继续处理下一个请求
+  virtual void close() override;
+
+  bool isFinished() const { return m_state == DONE; }
+  // 已经读到的body字节数
+  uint64_t total() const { return m_total; }
+
+private:
+  friend class HttpSession;
+  enum State { DATA, CHUNK_SIZE, CHUNK_END, TRAILER, DONE, ERROR };
+  bool nextChunk();
+
+private:
+  HttpSession *m_session;
+  bool m_chunked;
+  State m_state;
+  // 当前chunk(或者整个body)还没读的字节数
+  uint64_t m_left;
+  uint64_t m_total = 0;
+};
+
+// 流式发送响应body, HTTP/1.1每次write编码成一个chunk
+class HttpResponseBodyStream : public Stream {
+public:
+  using ptr = std::shared_ptr<HttpResponseBodyStream>;
+  HttpResponseBodyStream(HttpSession *session, bool chunked);
+
+  virtual int read(void *buffer, size_t length) override { return -1; }
+  virtual int read(ByteArray::ptr ba, size_t length) override { return -1; }
+  virtual int write(const void *buffer, size_t length) override;
+  virtual int write(ByteArray::ptr ba, size_t length) override;
+  // 写出结尾的空chunk
+  virtual void close() override;
+
+  bool isClosed() const { return m_closed; }
+  // 写结尾时出错返回false
+  bool isGood() const { return m_good; }
+
+private:
+  friend class HttpSession;
+  // 发出m_iovs中的数据, HTTP/1.1时前后加上chunk的长度行和结尾
+  int writeChunk(size_t length);
+
+private:
+  HttpSession *m_session;
+  bool m_chunked;
+  bool m_closed = false;
+  bool m_good = true;
+  char m_chunkHead[24];
+  std::vector<iovec> m_iovs;
+};
+
 class HttpSession : public SocketStream {
 public:
   using ptr = std::shared_ptr<HttpSession>;
   HttpSession(Socket::ptr sock, bool owner = true);
+  ~HttpSession();
+  // 返回的请求引用本连接的读缓冲区, 在下一次recvRequest之前有效
+  // 一次读到的多个请求(HTTP/1.1流水线)会留在缓冲区里, 依次返回
   HttpRequest::ptr recvRequest();
-  int sendResponse(HttpResponse::ptr rsp);
+  // 头部写入连接内复用的缓冲区, 和body一起用一次writev发出, body不拷贝
+  // flush为false时只排队, 和后面的响应合并发送, 返回0; 出错返回-1
+  int64_t sendResponse(HttpResponse::ptr rsp, bool flush = true);
+  // 发出所有排队的响应, 返回发出的字节数, recvRequest在阻塞读之前会自动调用
+  int64_t flush();
+  // 缓冲区里还有没处理的数据, 通常是流水线中的下一个请求
+  bool hasBufferedRequest() const { return m_pos < m_len; }
+
+  // 开始流式发送rsp: 先发出之前排队的响应和rsp的头部, 之后对返回的流write
+  // 的数据直接发出. 流在close或者sendResponse(rsp)时结束, 出错返回nullptr
+  HttpResponseBodyStream::ptr streamResponse(HttpResponse::ptr rsp);
+
+private:
+  friend class HttpRequestBodyStream;
+  friend class HttpResponseBodyStream;
+  HttpRequest::ptr parseRequest();
+  // 读请求body: 先取读缓冲区中的数据, 没有时从socket读
+  int readBody(void *buffer, size_t length);
+  // 读一行, line不含结尾的\r\n, 在下一次读之前有效
+  bool readLine(StringView &line);
 
 private:
+  // 连接内复用的读缓冲区和解析器, keep-alive的后续请求不再分配
+  // [m_pos, m_len) 是已经读到但还没处理的数据
+  std::vector<char> m_buffer;
+  size_t m_pos = 0;
+  size_t m_len = 0;
+  HttpRequestParser m_parser;
+  // 连接内复用的响应头缓冲区和iovec数组
+  std::string m_writeBuffer;
+  std::vector<iovec> m_iovs;
+  // 排队等待合并发送的响应, 和它们的头部在m_writeBuffer中的结束位置
+  std::vector<HttpResponse::ptr> m_pending;
+  std::vector<size_t> m_headerEnds;
+  // 当前请求和响应的body流
+  HttpRequestBodyStream::ptr m_requestBody;
+  HttpResponseBodyStream::ptr m_responseBody;
 };
 
 } /* namespace http */
@@ -0,0 +1,172 @@
+#include "router.h"
+
+namespace cool {
+namespace http {
+
+struct Router::Node {
+  // 从父节点到这里的静态字符串, 根节点和参数节点为空
+  std::string prefix;
+  // 静态子节点prefix的首字符, 和children一一对应
+  std::string indices;
+  std::vector<std::unique_ptr<Node>> children;
+  // :name 参数子节点
+  std::string paramName;
+  std::unique_ptr<Node> param;
+  // *name 通配, 匹配剩下的全部
+  std::string wildName;
+  ServletPtr wild;
+  // 在这里结束的路由
+  ServletPtr servlet;
+};
+
+Router::Router() : m_root(new Node) {}
+
+Router::~Router() {}
+
+Router::Node *Router::insertStatic(Node *n, StringView s) {
+  while (!s.empty()) {
+    size_t idx = n->indices.find(s[0]);
+    if (idx == std::string::npos) {
+      Node *child = new Node;
+      child->prefix.assign(s.data(), s.size());
+      n->indices.push_back(s[0]);
+      n->children.emplace_back(child);
+      return child;
+    }
+    Node *child = n->children[idx].get();
+    size_t l = 0;
+    while (l < child->prefix.size() && l < s.size() &&
+           child->prefix[l] == s[l]) {
+      ++l;
+    }
+    if (l < child->prefix.size()) {
+      // 公共前缀比原来的边短, 拆成两段
+      std::unique_ptr<Node> split(new Node);
+      split->prefix = child->prefix.substr(0, l);
+      child->prefix.erase(0, l);
+      split->indices.push_back(child->prefix[0]);
+      split->children.push_back(std::move(n->children[idx]));
+      n->children[idx] = std::move(split);
+      child = n->children[idx].get();
+    }
+    s.remove_prefix(l);
+    n = child;
+  }
+  return n;
+}
+
+bool Router::insert(const std::string &pattern, ServletPtr slt) {
+  Node *n = m_root.get();
+  size_t i = 0;
+  while (i < pattern.size()) {
+    char c = pattern[i];
+    if (c == ':' && i > 0 && pattern[i - 1] == '/') {
+      size_t end = pattern.find('/', i);
+      if (end == std::string::npos) {
+        end = pattern.size();
+      }
+      std::string name = pattern.substr(i + 1, end - i - 1);
+      if (name.empty()) {
+        return false;
+      }
+      if (!n->param) {
+        n->param.reset(new Node);
+        n->paramName = name;
+      } else if (n->paramName != name) {
+        // 同一位置只能有一个参数名
+        return false;
+      }
+      n = n->param.get();
+      i = end;
+      continue;
+    }
+    if (c == '*') {
+      std::string name = pattern.substr(i + 1);
+      if (name.find_first_of("/:*") != std::string::npos) {
+        return false;
+      }
+      n->wildName = name;
+      n->wild = slt;
+      return true;
+    }
+    size_t end = i + 1;
+    while (end < pattern.size() && pattern[end] != '*' &&
+           !(pattern[end] == ':' && pattern[end - 1] == '/')) {
+      ++end;
+    }
+    n = insertStatic(n, StringView(pattern).substr(i, end - i));
+    i = end;
+  }
+  n->servlet = slt;
+  return true;
+}
+
+const Router::ServletPtr *Router::match(const Node *n, StringView path,
+                                        Params *params) {
+  if (path.empty()) {
+    if (n->servlet) {
+      return &n->servlet;
+    }
+  } else {
+    size_t idx = n->indices.find(path[0]);
+    if (idx != std::string::npos) {
+      const Node *child = n->children[idx].get();
+      if (path.starts_with(child->prefix)) {
+        const ServletPtr *rt =
+            match(child, path.substr(child->prefix.size()), params);
+        if (rt) {
+          return rt;
+        }
+      }
+    }
+    if (n->param) {
+      StringView seg = path.substr(0, path.find('/'));
+      if (!seg.empty()) {
+        size_t saved = params ? params->size : 0;
+        if (params && params->size < Params::MAX) {
+          params->items[params->size++] =
+              std::make_pair(StringView(n->paramName), seg);
+        }
+        const ServletPtr *rt =
+            match(n->param.get(), path.substr(seg.size()), params);
+        if (rt) {
+          return rt;
+        }
+        if (params) {
+          params->size = saved;
+        }
+      }
+    }
+  }
+  if (n->wild) {
+    if (params && !n->wildName.empty() && params->size < Params::MAX) {
+      params->items[params->size++] =
+          std::make_pair(StringView(n->wildName), path);
+    }
+    return &n->wild;
+  }
+  return nullptr;
+}
+
+Router::ServletPtr Router::match(StringView path, Params *params) const {
+  if (params) {
+    params->size = 0;
+  }
+  const ServletPtr *rt = match(m_root.get(), path, params);
+  return rt ? *rt : nullptr;
+}
+
+bool Router::IsRouteGlob(StringView glob) {
+  if (glob.empty() || glob.back() != '*') {
+    return false;
+  }
+  StringView head = glob.substr(0, glob.size() - 1);
+  if (head.find_first_of("*?[\\") != StringView::npos) {
+    return false;
+  }
+  // 路由表里 "/:" 开头的段是参数, fnmatch里是普通字符
+  return head.find("/:") == StringView::npos;
+}
+
+} // namespace http
+} // namespace cool
@@ -0,0 +1,56 @@
+#ifndef __COOL_HTTP_ROUTER_H
+#define __COOL_HTTP_ROUTER_H
+
+#include "http_header.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cool {
+namespace http {
+
+class Servlet;
+
+// 压缩前缀树(radix tree)路由表, 构建完成后只读, 更新时由ServletDispatch整体替换
+// 支持的模式:
+//   /user/list      静态路径
+//   /user/:id       参数段, 匹配到下一个'/'为止, 不能为空
+//   /static/*       结尾的通配符, 匹配剩下的任意字符(可以为空)
+//   /files/*path    同上, 剩下的部分作为参数path
+// 优先级: 静态 > 参数 > 通配, 同一位置匹配失败时回溯
+class Router {
+public:
+  using ServletPtr = std::shared_ptr<Servlet>;
+  // 匹配到的参数, 键指向路由表内部, 值指向被匹配的路径
+  struct Params {
+    static const size_t MAX = 8;
+    std::pair<StringView, StringView> items[MAX];
+    size_t size = 0;
+  };
+
+  Router();
+  ~Router();
+
+  // 重复的模式覆盖之前的servlet, 模式不合法时返回false
+  bool insert(const std::string &pattern, ServletPtr slt);
+  // 没有匹配时返回nullptr, params可以为nullptr
+  ServletPtr match(StringView path, Params *params = nullptr) const;
+
+  // glob是否可以转成路由表中的模式(只有结尾一个'*', 没有其他通配字符)
+  static bool IsRouteGlob(StringView glob);
+
+private:
+  struct Node;
+  static Node *insertStatic(Node *node, StringView s);
+  static const ServletPtr *match(const Node *node, StringView path,
+                                 Params *params);
+
+private:
+  std::unique_ptr<Node> m_root;
+};
+
+} // namespace http
+} // namespace cool
+
+#endif /* __COOL_HTTP_ROUTER_H */
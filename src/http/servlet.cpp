@@ -1,6 +1,7 @@
 #include "servlet.h"
 #include "src/log.h"
 #include <fnmatch.h>
+#include <stdint.h>
 #include <string>
 #include <utility>
 
@@ -8,6 +9,23 @@ namespace cool {
 LOGGER_DEF(g_logger, "system");
 namespace http {
 
+namespace {
+// glob_router中的servlet, 命中之后和先添加的fnmatch glob比较顺序
+class RoutedGlob : public Servlet {
+public:
+  RoutedGlob(Servlet::ptr slt, size_t order)
+      : Servlet("RoutedGlob"), servlet(slt), order(order) {}
+  int32_t handle(cool::http::HttpRequest::ptr request,
+                 cool::http::HttpResponse::ptr response,
+                 cool::http::HttpSession::ptr session) override {
+    return servlet->handle(request, response, session);
+  }
+
+  Servlet::ptr servlet;
+  size_t order;
+};
+} // namespace
+
 FunctionServlet::FunctionServlet(callback cb)
     : Servlet("FunctionServlet"), m_cb(cb) {}
 
@@ -19,12 +37,23 @@ int32_t FunctionServlet::handle(cool::http::HttpRequest::ptr request,
 
 ServletDispatch::ServletDispatch() : Servlet("ServletDispatch") {
   m_default.reset(new NotFoundServlet);
+  rebuild();
 }
 
+ServletDispatch::~ServletDispatch() {}
+
 int32_t ServletDispatch::handle(cool::http::HttpRequest::ptr request,
                                 cool::http::HttpResponse::ptr response,
                                 cool::http::HttpSession::ptr session) {
-  auto slt = get_matched_servlet(request->path());
+  Servlet::ptr slt;
+  {
+    Rcu::ReadLock lock;
+    Router::Params params;
+    slt = get_matched_servlet(request->path(), &params);
+    for (size_t i = 0; i < params.size; ++i) {
+      request->setParam(params.items[i].first, params.items[i].second);
+    }
+  }
   if (slt) {
     slt->handle(request, response, session);
   }
@@ -34,12 +63,14 @@ int32_t ServletDispatch::handle(cool::http::HttpRequest::ptr request,
 void ServletDispatch::add_servlet(const std::string &uri, Servlet::ptr slt) {
   RWMutexType::WriteLock lock{m_mutex};
   m_datas[uri] = slt;
+  rebuild();
 }
 
 void ServletDispatch::add_servlet(const std::string &uri,
                                   FunctionServlet::callback cb) {
   RWMutexType::WriteLock lock{m_mutex};
   m_datas[uri].reset(new FunctionServlet(cb));
+  rebuild();
 }
 
 void ServletDispatch::add_glob_servlet(const std::string &uri,
@@ -52,6 +83,7 @@ void ServletDispatch::add_glob_servlet(const std::string &uri,
     }
   }
   m_globs.push_back(std::make_pair(uri, slt));
+  rebuild();
 }
 
 void ServletDispatch::add_glob_servlet(const std::string &uri,
@@ -62,6 +94,7 @@ void ServletDispatch::add_glob_servlet(const std::string &uri,
 void ServletDispatch::del_servlet(const std::string &uri) {
   RWMutexType::WriteLock lock{m_mutex};
   m_datas.erase(uri);
+  rebuild();
 }
 
 void ServletDispatch::del_glob_servlet(const std::string &uri) {
@@ -72,6 +105,7 @@ void ServletDispatch::del_glob_servlet(const std::string &uri) {
       break;
     }
   }
+  rebuild();
 }
 
 Servlet::ptr ServletDispatch::get_servlet(const std::string &uri) {
@@ -90,19 +124,66 @@ Servlet::ptr ServletDispatch::get_glob_servlet(const std::string &uri) {
   return nullptr;
 }
 
-Servlet::ptr ServletDispatch::get_matched_servlet(const std::string &uri) {
+Servlet::ptr ServletDispatch::get_default_servlet() {
   RWMutexType::ReadLock lock{m_mutex};
-  auto mit = m_datas.find(uri);
-  if (mit != m_datas.end()) {
-    return mit->second;
+  return m_default;
+}
+
+void ServletDispatch::set_default_servlet(Servlet::ptr v) {
+  RWMutexType::WriteLock lock{m_mutex};
+  m_default = v;
+  rebuild();
+}
+
+Servlet::ptr ServletDispatch::get_matched_servlet(StringView uri,
+                                                  Router::Params *params) {
+  Rcu::ReadLock lock;
+  const Routes *routes = m_routes.get();
+  Servlet::ptr slt = routes->router.match(uri, params);
+  if (slt) {
+    return slt;
   }
-  for (auto it = m_globs.begin(); it != m_globs.end(); ++it) {
-    // LOG_DEBUG(g_logger) << "first :" << it->first << " uri :" << uri;
-    if (0 == fnmatch(it->first.c_str(), uri.c_str(), 0)) {
-      return it->second;
+  // 路由表中的glob没有参数, 命中时只需要检查在它之前添加的fnmatch glob
+  size_t order = SIZE_MAX;
+  Servlet::ptr routed = routes->glob_router.match(uri);
+  if (routed) {
+    RoutedGlob *glob = static_cast<RoutedGlob *>(routed.get());
+    slt = glob->servlet;
+    order = glob->order;
+  }
+  if (!routes->globs.empty() && routes->globs.front().order < order) {
+    // fnmatch需要'\0'结尾
+    std::string path(uri.data(), uri.size());
+    for (auto &i : routes->globs) {
+      if (i.order > order) {
+        break;
+      }
+      if (0 == fnmatch(i.pattern.c_str(), path.c_str(), 0)) {
+        return i.servlet;
+      }
     }
   }
-  return m_default;
+  return slt ? slt : routes->def;
+}
+
+void ServletDispatch::rebuild() {
+  std::unique_ptr<Routes> routes(new Routes);
+  for (size_t i = 0; i < m_globs.size(); ++i) {
+    const std::string &pattern = m_globs[i].first;
+    if (Router::IsRouteGlob(pattern)) {
+      routes->glob_router.insert(
+          pattern, Servlet::ptr(new RoutedGlob(m_globs[i].second, i)));
+    } else {
+      routes->globs.push_back(Glob{pattern, m_globs[i].second, i});
+    }
+  }
+  for (auto &i : m_datas) {
+    if (!routes->router.insert(i.first, i.second)) {
+      LOG_ERROR(g_logger) << "invalid servlet path: " << i.first;
+    }
+  }
+  routes->def = m_default;
+  m_routes.reset(routes.release());
 }
 
 NotFoundServlet::NotFoundServlet() : Servlet("NotFoundServlet") {}
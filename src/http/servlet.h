@@ -3,6 +3,7 @@
 
 #include "http.h"
 #include "http_session.h"
+#include "router.h"
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -10,6 +11,7 @@
 #include <unordered_map>
 #include <utility>
 #include <vector>
+#include "src/rcu.h"
 #include "src/thread.h"
 
 namespace cool {
@@ -45,12 +47,18 @@ private:
   callback m_cb;
 };
 
+// add_servlet的路径支持 /user/:id 参数段和结尾的 *name 通配, 匹配到的参数通过
+// request->getParam读取. add_servlet的路径优先于glob. glob之间按添加顺序,
+// 先添加的先匹配, 其中能转换成前缀的glob(如/cool/*)放进单独的路由表, 互相之间
+// 取最长的前缀
+// 查找使用RCU保护的只读快照, 不加锁; 每次修改在写锁内重建快照后整体替换
 class ServletDispatch : public Servlet {
 public:
   using ptr = std::shared_ptr<ServletDispatch>;
   using RWMutexType = RWMutex;
 
   ServletDispatch ();
+  ~ServletDispatch ();
   virtual int32_t handle(cool::http::HttpRequest::ptr request,
                          cool::http::HttpResponse::ptr response,
                          cool::http::HttpSession::ptr session) override;
@@ -66,10 +74,33 @@ public:
   Servlet::ptr get_servlet(const std::string &uri);
   Servlet::ptr get_glob_servlet(const std::string &uri);
 
-  Servlet::ptr get_default_servlet() const { return m_default; }
-  void set_default_servlet(Servlet::ptr v) { m_default = v; }
+  Servlet::ptr get_default_servlet();
+  void set_default_servlet(Servlet::ptr v);
 
-  Servlet::ptr get_matched_servlet(const std::string &uri);
+  // params不为空时写入匹配到的路径参数, 参数的键指向路由快照,
+  // 需要在调用方的Rcu::ReadLock范围内使用
+  Servlet::ptr get_matched_servlet(StringView uri,
+                                   Router::Params *params = nullptr);
+
+private:
+  struct Glob {
+    std::string pattern;
+    Servlet::ptr servlet;
+    // 在m_globs中的下标, 即添加的顺序
+    size_t order;
+  };
+  // 构建之后只读的路由快照
+  struct Routes {
+    // add_servlet添加的路径
+    Router router;
+    // 能转换成前缀的glob, servlet是记录了添加顺序的包装
+    Router glob_router;
+    // 不能放进路由表的glob, 按添加顺序
+    std::vector<Glob> globs;
+    Servlet::ptr def;
+  };
+  // 持有写锁时调用
+  void rebuild();
 
 private:
   // uri(/xxx) -> servlet
@@ -80,6 +111,7 @@ private:
   Servlet::ptr m_default;
 
   RWMutexType m_mutex;
+  RcuPtr<Routes> m_routes;
 };
 
 class NotFoundServlet : public Servlet {
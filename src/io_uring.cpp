@@ -0,0 +1,198 @@
+#include "io_uring.h"
+#include "log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace cool {
+static Logger::ptr g_logger = LOG_NAME("system");
+
+static int io_uring_setup(unsigned entries, io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      nullptr, 0);
+}
+static int io_uring_register(int fd, unsigned opcode, const void *arg,
+                             unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IoUring::IoUring(unsigned entries) {
+  if (!init(entries)) {
+    LOG_INFO(g_logger) << "io_uring init failed, errstr=" << strerror(errno);
+    release();
+  }
+}
+
+IoUring::~IoUring() { release(); }
+
+bool IoUring::init(unsigned entries) {
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CLAMP;
+  m_fd = io_uring_setup(entries, &p);
+  if (m_fd < 0) {
+    return false;
+  }
+
+  m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+  }
+  void *sq = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) {
+    return false;
+  }
+  m_sqRing = sq;
+  if (single_mmap) {
+    m_cqRing = m_sqRing;
+  } else {
+    void *cq = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) {
+      return false;
+    }
+    m_cqRing = cq;
+  }
+  m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  m_sqes = (io_uring_sqe *)sqes;
+
+  char *sq_ptr = (char *)m_sqRing;
+  m_sqHead = (unsigned *)(sq_ptr + p.sq_off.head);
+  m_sqTail = (unsigned *)(sq_ptr + p.sq_off.tail);
+  m_sqArray = (unsigned *)(sq_ptr + p.sq_off.array);
+  m_sqFlags = (unsigned *)(sq_ptr + p.sq_off.flags);
+  m_sqMask = *(unsigned *)(sq_ptr + p.sq_off.ring_mask);
+  m_sqEntries = p.sq_entries;
+  m_sqeTail = *m_sqTail;
+
+  char *cq_ptr = (char *)m_cqRing;
+  m_cqHead = (unsigned *)(cq_ptr + p.cq_off.head);
+  m_cqTail = (unsigned *)(cq_ptr + p.cq_off.tail);
+  m_cqMask = *(unsigned *)(cq_ptr + p.cq_off.ring_mask);
+  m_cqes = (io_uring_cqe *)(cq_ptr + p.cq_off.cqes);
+
+  m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_eventFd < 0) {
+    return false;
+  }
+  return io_uring_register(m_fd, IORING_REGISTER_EVENTFD, &m_eventFd, 1) == 0;
+}
+
+void IoUring::release() {
+  if (m_sqes) {
+    munmap(m_sqes, m_sqesSize);
+    m_sqes = nullptr;
+  }
+  if (m_cqRing && m_cqRing != m_sqRing) {
+    munmap(m_cqRing, m_cqRingSize);
+  }
+  m_cqRing = nullptr;
+  if (m_sqRing) {
+    munmap(m_sqRing, m_sqRingSize);
+    m_sqRing = nullptr;
+  }
+  if (m_eventFd >= 0) {
+    close(m_eventFd);
+    m_eventFd = -1;
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+bool IoUring::supports(const uint8_t *ops, size_t count) {
+  if (m_fd < 0) {
+    return false;
+  }
+  size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  std::vector<char> buf(len, 0);
+  io_uring_probe *probe = (io_uring_probe *)&buf[0];
+  if (io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, 256)) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (ops[i] > probe->last_op ||
+        !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IoUring::reserve(unsigned count) {
+  unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  if (m_sqEntries - (m_sqeTail - head) >= count) {
+    return true;
+  }
+  submit();
+  head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  return m_sqEntries - (m_sqeTail - head) >= count;
+}
+
+io_uring_sqe *IoUring::getSqe() {
+  if (!reserve(1)) {
+    return nullptr;
+  }
+  io_uring_sqe *sqe = &m_sqes[m_sqeTail & m_sqMask];
+  m_sqArray[m_sqeTail & m_sqMask] = m_sqeTail & m_sqMask;
+  ++m_sqeTail;
+  ++m_pending;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int IoUring::submit() {
+  // 发布队尾之后SQE对内核可见
+  __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+  unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  unsigned to_submit = m_sqeTail - head;
+  if (to_submit == 0) {
+    m_pending = 0;
+    return 0;
+  }
+  int rt = 0;
+  do {
+    rt = io_uring_enter(m_fd, to_submit, 0, 0);
+  } while (rt < 0 && errno == EINTR);
+  if (rt < 0) {
+    // EAGAIN/EBUSY 时SQE留在队列里, 下次提交时内核会继续取
+    return -errno;
+  }
+  m_pending = m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  return rt;
+}
+
+bool IoUring::flushOverflow() {
+  int rt = 0;
+  do {
+    rt = io_uring_enter(m_fd, 0, 0, IORING_ENTER_GETEVENTS);
+  } while (rt < 0 && errno == EINTR);
+  return rt >= 0 && *m_cqHead != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+}
+
+int IoUring::registerBuffers(const iovec *iovs, unsigned count) {
+  if (io_uring_register(m_fd, IORING_REGISTER_BUFFERS, iovs, count)) {
+    return -errno;
+  }
+  return 0;
+}
+
+} // namespace cool
@@ -0,0 +1,106 @@
+#ifndef __COOL_IO_URING_H
+#define __COOL_IO_URING_H
+
+#include "noncopyable.h"
+#include "thread.h"
+#include <atomic>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace cool {
+
+// io_uring 的最小封装, 直接使用系统调用, 不依赖 liburing
+// 提交队列和完成队列各有一把锁, 允许多个线程共享同一个 ring
+class IoUring : Noncopyable {
+public:
+  using MutexType = SpinLock;
+
+  // entries 会被内核向上取整为2的幂, 超过上限时截断
+  IoUring(unsigned entries);
+  ~IoUring();
+
+  // 内核不支持或者创建失败时返回false
+  bool isValid() const { return m_fd >= 0; }
+  // 有新的完成事件时可读, 用于挂到epoll上
+  int eventFd() const { return m_eventFd; }
+
+  // 检查需要的操作码是否都被当前内核支持
+  bool supports(const uint8_t *ops, size_t count);
+
+  // 以下接口需要持有 sqMutex()
+  // 保证提交队列至少还有count个空位, 不够时先把已有的提交给内核
+  // 链接在一起的多个SQE需要先reserve, 避免链条被中途提交
+  bool reserve(unsigned count);
+  // 取一个清零的SQE, 提交队列满且无法提交时返回nullptr
+  io_uring_sqe *getSqe();
+  // 把所有填好的SQE提交给内核, 返回提交的个数, 出错时返回-errno
+  int submit();
+
+  // 已经填好但还没有被内核取走的SQE个数, 不需要加锁
+  unsigned pending() const { return m_pending; }
+
+  // 取出所有完成事件, 需要持有 cqMutex()
+  template <class Func> unsigned reap(Func func) {
+    unsigned count = 0;
+    while (true) {
+      unsigned head = *m_cqHead;
+      unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head, ++count) {
+        io_uring_cqe *cqe = &m_cqes[head & m_cqMask];
+        func(cqe->user_data, cqe->res);
+      }
+      __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+      // 完成队列满时内核把多出来的事件暂存起来, 需要主动取回
+      if (!(__atomic_load_n(m_sqFlags, __ATOMIC_ACQUIRE) &
+            IORING_SQ_CQ_OVERFLOW) ||
+          !flushOverflow()) {
+        return count;
+      }
+    }
+  }
+
+  // 注册固定缓冲区, 之后可以用 READ_FIXED/WRITE_FIXED 按下标引用
+  int registerBuffers(const iovec *iovs, unsigned count);
+
+  MutexType &sqMutex() { return m_sqMutex; }
+  MutexType &cqMutex() { return m_cqMutex; }
+
+private:
+  bool init(unsigned entries);
+  void release();
+  bool flushOverflow();
+
+private:
+  int m_fd = -1;
+  int m_eventFd = -1;
+
+  void *m_sqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  void *m_cqRing = nullptr;
+  size_t m_cqRingSize = 0;
+  io_uring_sqe *m_sqes = nullptr;
+  size_t m_sqesSize = 0;
+
+  unsigned *m_sqHead = nullptr;
+  unsigned *m_sqTail = nullptr;
+  unsigned *m_sqArray = nullptr;
+  unsigned *m_sqFlags = nullptr;
+  unsigned m_sqMask = 0;
+  unsigned m_sqEntries = 0;
+  // 本地的队尾, submit时才发布给内核
+  unsigned m_sqeTail = 0;
+  std::atomic<unsigned> m_pending = {0};
+
+  unsigned *m_cqHead = nullptr;
+  unsigned *m_cqTail = nullptr;
+  unsigned m_cqMask = 0;
+  io_uring_cqe *m_cqes = nullptr;
+
+  MutexType m_sqMutex;
+  MutexType m_cqMutex;
+};
+
+} // namespace cool
+
+#endif /* __COOL_IO_URING_H */
@@ -1,4 +1,6 @@
 #include "iomanager.h"
+#include "config.h"
+#include "io_uring.h"
 #include "log.h"
 #include "macro.h"
 #include "src/fiber.h"
@@ -7,12 +9,51 @@
 #include <cstring>
 #include <fcntl.h>
 #include <memory>
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
 namespace cool {
 static cool::Logger::ptr g_logger = LOG_NAME("system");
 
+static cool::ConfigVar<bool>::ptr g_reactor_per_thread =
+    cool::Config::lookup("iomanager.reactor_per_thread", false,
+                         "one epoll per worker thread");
+static cool::ConfigVar<int>::ptr g_epoll_batch_size = cool::Config::lookup(
+    "iomanager.epoll_batch_size", 64, "max events per epoll_wait");
+static cool::ConfigVar<std::string>::ptr g_backend = cool::Config::lookup(
+    "iomanager.backend", std::string("epoll"), "epoll or io_uring");
+static cool::ConfigVar<int>::ptr g_uring_entries = cool::Config::lookup(
+    "iomanager.uring_entries", 256, "submission queue size per io_uring");
+static cool::ConfigVar<int>::ptr g_uring_submit_batch =
+    cool::Config::lookup("iomanager.uring_submit_batch", 16,
+                         "max queued io_uring requests before submitting");
+
+// io_uring后端用到的操作, 内核缺少任何一个都退回epoll
+static const uint8_t s_uring_ops[] = {
+    IORING_OP_RECV,         IORING_OP_SEND,          IORING_OP_RECVMSG,
+    IORING_OP_SENDMSG,      IORING_OP_ACCEPT,        IORING_OP_POLL_ADD,
+    IORING_OP_LINK_TIMEOUT, IORING_OP_ASYNC_CANCEL,  IORING_OP_READ_FIXED,
+    IORING_OP_WRITE_FIXED};
+
+// 挂起在io_uring上的请求, 放在发起协程的栈上, 完成之前协程不会返回
+struct IOManager::UringRequest {
+  io_uring_sqe sqe;
+  __kernel_timespec ts;
+  uint64_t timeout_ms = ~0ull;
+  bool poll_first = false;
+  Event event = NONE;
+  FdContext *fd_ctx = nullptr;
+  Scheduler *scheduler = nullptr;
+  Fiber::ptr fiber;
+  int thread_id = -1;
+  IoUring *ring = nullptr; // 已经放入的ring, 还在批次里时为nullptr
+  bool cancelled = false;
+  int res = 0;
+  UringRequest *next = nullptr;
+};
+
 IOManager::FdContext::EventContext &
 IOManager::FdContext::getContext(Event event) {
   switch (event) {
@@ -28,74 +69,100 @@ void IOManager::FdContext::resetContext(EventContext &ctx) {
   ctx.scheduler = nullptr;
   ctx.fiber.reset();
   ctx.cb = nullptr;
+  ctx.thread_id = -1;
 }
 void IOManager::FdContext::triggerEvent(IOManager::Event event) {
   ASSERT(events & event);
   events = (Event)(events & ~event);
   EventContext &ctx = getContext(event);
   if (ctx.cb) {
-    ctx.scheduler->schedule(&ctx.cb);
+    ctx.scheduler->schedule(&ctx.cb, ctx.thread_id);
   } else {
-    ctx.scheduler->schedule(&ctx.fiber);
+    ctx.scheduler->schedule(&ctx.fiber, ctx.thread_id);
   }
   ctx.scheduler = nullptr;
+  ctx.thread_id = -1;
 }
 
-IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
-    : Scheduler(threads, use_caller, name) {
-  m_epfd = epoll_create(5000);
-  ASSERT(m_epfd > 0);
+IOManager::Reactor::Reactor() {
+  epfd = epoll_create(5000);
+  ASSERT(epfd > 0);
 
-  int rt = pipe(m_tickleFds);
-  ASSERT(!rt);
+  tickleFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ASSERT(tickleFd >= 0);
 
   epoll_event event;
   memset(&event, 0, sizeof(epoll_event));
   event.events = EPOLLIN | EPOLLET;
-  event.data.fd = m_tickleFds[0];
+  event.data.fd = tickleFd;
 
-  rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
+  int rt = epoll_ctl(epfd, EPOLL_CTL_ADD, tickleFd, &event);
   ASSERT(!rt);
-
-  rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
-  ASSERT(!rt);
-
-  resizeContext(32);
-
-  start();
 }
-IOManager::~IOManager() {
-  stop();
-  close(m_epfd);
-  close(m_tickleFds[0]);
-  close(m_tickleFds[1]);
-
-  for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-    delete m_fdContexts[i];
+IOManager::Reactor::~Reactor() {
+  close(epfd);
+  close(tickleFd);
+}
+void IOManager::Reactor::tickle() {
+  if (ticklePending.exchange(true)) {
+    return;
   }
+  uint64_t one = 1;
+  int rt = write(tickleFd, &one, sizeof(one));
+  ASSERT(rt == sizeof(one));
 }
 
-void IOManager::resizeContext(size_t size) {
-  m_fdContexts.resize(size);
-  for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-    if (!m_fdContexts[i]) {
-      m_fdContexts[i] = new FdContext;
-      m_fdContexts[i]->fd = i;
+IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
+    : Scheduler(threads, use_caller, name),
+      m_fdContexts([](FdContext &ctx, int fd) { ctx.fd = fd; }) {
+  size_t n = g_reactor_per_thread->get_value() ? workerCount() : 1;
+  for (size_t i = 0; i < n; ++i) {
+    m_reactors.emplace_back(new Reactor());
+  }
+
+  if (g_backend->get_value() == "io_uring") {
+    m_useUring = true;
+    unsigned entries = std::max(g_uring_entries->get_value(), 8);
+    for (auto &r : m_reactors) {
+      r->uring.reset(new IoUring(entries));
+      if (!r->uring->isValid() ||
+          !r->uring->supports(s_uring_ops, sizeof(s_uring_ops))) {
+        m_useUring = false;
+        break;
+      }
+      epoll_event event;
+      memset(&event, 0, sizeof(epoll_event));
+      event.events = EPOLLIN | EPOLLET;
+      event.data.fd = r->uring->eventFd();
+      int rt = epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->uring->eventFd(), &event);
+      ASSERT(!rt);
     }
+    if (!m_useUring) {
+      LOG_WARN(g_logger) << "io_uring is not supported, fall back to epoll";
+      for (auto &r : m_reactors) {
+        r->uring.reset();
+      }
+    }
+    m_uringBatch = std::max(g_uring_submit_batch->get_value(), 1);
+    m_uringBatches.resize(workerCount());
   }
+
+  m_fdContexts.getOrCreate(0);
+
+  start();
+}
+IOManager::~IOManager() { stop(); }
+
+IOManager::Reactor &IOManager::currentReactor() {
+  int idx = m_reactors.size() > 1 ? workerIndex() : 0;
+  return *m_reactors[idx >= 0 ? idx : 0];
 }
 
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-  FdContext *fd_ctx = nullptr;
-  RWMutexType::ReadLock lock{m_mutex};
-  if ((int)m_fdContexts.size() > fd) {
-    fd_ctx = m_fdContexts[fd];
-    lock.unlock();
-  } else {
-    lock.unlock();
-    RWMutexType::WriteLock lock2{m_mutex};
-    resizeContext(fd * 1.5);
-    fd_ctx = m_fdContexts[fd];
+  FdContext *fd_ctx = m_fdContexts.getOrCreate(fd);
+  if (!fd_ctx) {
+    LOG_ERROR(g_logger) << "addEvent fd out of range fd = " << fd;
+    return -1;
   }
 
   FdContext::MutexType::Lock lock2{fd_ctx->mutex};
@@ -104,14 +171,24 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     // << ",event = " << event << ",fd_ctx.event= " << fd_ctx->events;
     ASSERT(!(fd_ctx->events & event));
   }
+  if (fd_ctx->reactor < 0) {
+    // fd留在第一次注册它的线程上, 非工作线程注册时轮流分配
+    int idx = m_reactors.size() > 1 ? workerIndex() : 0;
+    if (idx < 0) {
+      idx = m_nextReactor++ % m_reactors.size();
+    }
+    fd_ctx->reactor = idx;
+  }
+  // epoll_ctl本身是线程安全的, 其他线程的注册直接转到所属线程的epoll上
+  int epfd = m_reactors[fd_ctx->reactor]->epfd;
   int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
   epoll_event epevent;
   epevent.events = EPOLLET | fd_ctx->events | event;
   epevent.data.ptr = fd_ctx;
 
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+  int rt = epoll_ctl(epfd, op, fd, &epevent);
   if (rt) {
-    LOG_ERROR(g_logger) << "epoll_ctl" << m_epfd << ",[" << errno
+    LOG_ERROR(g_logger) << "epoll_ctl" << epfd << ",[" << errno
                         << "]:" << strerror(errno);
     return -1;
   }
@@ -124,6 +201,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
   // ASSERT(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
 
   event_ctx.scheduler = Scheduler::GetThis();
+  event_ctx.thread_id = Scheduler::GetPinnedThread();
   if (cb) {
     event_ctx.cb.swap(cb);
   } else {
@@ -134,12 +212,10 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
 }
 
 bool IOManager::delEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock{m_mutex};
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext *fd_ctx = m_fdContexts.get(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext *fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2{fd_ctx->mutex};
   if (!(fd_ctx->events & event)) {
@@ -152,7 +228,7 @@ bool IOManager::delEvent(int fd, Event event) {
   epevent.events = EPOLLET | new_events;
   epevent.data.ptr = fd_ctx;
 
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+  int rt = epoll_ctl(m_reactors[fd_ctx->reactor]->epfd, op, fd, &epevent);
   if (rt) {
     LOG_ERROR(g_logger) << "epoll_ctl";
     return false;
@@ -166,16 +242,15 @@ bool IOManager::delEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock{m_mutex};
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext *fd_ctx = m_fdContexts.get(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext *fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2{fd_ctx->mutex};
+  bool cancelled = m_useUring && cancelUring(fd_ctx->getContext(event));
   if (!(fd_ctx->events & event)) {
-    return false;
+    return cancelled;
   }
 
   Event new_events = (Event)(fd_ctx->events & ~event);
@@ -184,7 +259,7 @@ bool IOManager::cancelEvent(int fd, Event event) {
   epevent.events = EPOLLET | new_events;
   epevent.data.ptr = fd_ctx;
 
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+  int rt = epoll_ctl(m_reactors[fd_ctx->reactor]->epfd, op, fd, &epevent);
   if (rt) {
     LOG_ERROR(g_logger) << "epoll_ctl";
     return false;
@@ -196,16 +271,21 @@ bool IOManager::cancelEvent(int fd, Event event) {
 }
 
 bool IOManager::cancekAll(int fd) {
-  RWMutexType::ReadLock lock{m_mutex};
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext *fd_ctx = m_fdContexts.get(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext *fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2{fd_ctx->mutex};
+  bool cancelled = false;
+  if (m_useUring) {
+    cancelled = cancelUring(fd_ctx->read);
+    cancelled = cancelUring(fd_ctx->write) || cancelled;
+  }
   if (!fd_ctx->events) {
-    return false;
+    // 没有注册的事件时fd不在任何epoll里, 同样解除和线程的绑定
+    fd_ctx->reactor = -1;
+    return cancelled;
   }
 
   int op = EPOLL_CTL_DEL;
@@ -213,7 +293,7 @@ bool IOManager::cancekAll(int fd) {
   epevent.events = 0;
   epevent.data.ptr = fd_ctx;
 
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+  int rt = epoll_ctl(m_reactors[fd_ctx->reactor]->epfd, op, fd, &epevent);
   if (rt) {
     LOG_ERROR(g_logger) << "epoll_ctl";
     return false;
@@ -228,6 +308,242 @@ bool IOManager::cancekAll(int fd) {
     --m_pendingEventCount;
   }
   ASSERT(fd_ctx->events == 0);
+  // 句柄即将关闭, 重新使用时可以注册到别的线程
+  fd_ctx->reactor = -1;
+  return true;
+}
+
+int IOManager::uringCall(int fd, Event event, const io_uring_sqe &sqe,
+                         uint64_t timeout_ms, bool poll_first) {
+  int idx = workerIndex();
+  if (!m_useUring || idx < 0) {
+    return -ENOTSUP;
+  }
+  FdContext *fd_ctx = m_fdContexts.getOrCreate(fd);
+  if (!fd_ctx) {
+    return -EBADF;
+  }
+
+  UringRequest req;
+  req.sqe = sqe;
+  req.timeout_ms = timeout_ms;
+  req.poll_first = poll_first;
+  req.event = event;
+  req.fd_ctx = fd_ctx;
+  req.scheduler = Scheduler::GetThis();
+  req.fiber = Fiber::GetThis();
+  req.thread_id = Scheduler::GetPinnedThread();
+  {
+    FdContext::MutexType::Lock lock{fd_ctx->mutex};
+    FdContext::EventContext &event_ctx = fd_ctx->getContext(event);
+    if (event_ctx.uring) {
+      LOG_ERROR(g_logger) << "uringCall assert fd = " << fd;
+      ASSERT(!event_ctx.uring);
+    }
+    event_ctx.uring = &req;
+  }
+  ++m_pendingEventCount;
+
+  // 先攒在本线程的批次里, 协程切出之后由调度循环统一提交
+  UringBatch &batch = m_uringBatches[idx];
+  if (batch.tail) {
+    batch.tail->next = &req;
+  } else {
+    batch.head = &req;
+  }
+  batch.tail = &req;
+  ++batch.count;
+
+  Fiber::YieldToHold();
+  if (req.res == -ECANCELED && timeout_ms != ~0ull && !req.cancelled) {
+    return -ETIMEDOUT;
+  }
+  return req.res;
+}
+
+bool IOManager::registerBuffers(const iovec *iovs, unsigned count) {
+  if (!m_useUring) {
+    return false;
+  }
+  for (auto &r : m_reactors) {
+    int rt = r->uring->registerBuffers(iovs, count);
+    if (rt) {
+      LOG_ERROR(g_logger) << "io_uring register buffers errno=" << -rt
+                          << " errstr=" << strerror(-rt);
+      return false;
+    }
+  }
+  return true;
+}
+
+ssize_t IOManager::readFixed(int fd, void *buf, size_t len, int buf_index) {
+  if (!m_useUring) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_READ_FIXED;
+  sqe.fd = fd;
+  sqe.off = (uint64_t)-1;
+  sqe.addr = (uint64_t)buf;
+  sqe.len = len;
+  sqe.buf_index = buf_index;
+  // socket上的READ_FIXED遇到非阻塞句柄会直接返回EAGAIN, 先等可读
+  int rt = uringCall(fd, READ, sqe, ~0ull, true);
+  if (rt < 0) {
+    errno = -rt;
+    return -1;
+  }
+  return rt;
+}
+
+ssize_t IOManager::writeFixed(int fd, const void *buf, size_t len,
+                              int buf_index) {
+  if (!m_useUring) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  io_uring_sqe sqe;
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = IORING_OP_WRITE_FIXED;
+  sqe.fd = fd;
+  sqe.off = (uint64_t)-1;
+  sqe.addr = (uint64_t)buf;
+  sqe.len = len;
+  sqe.buf_index = buf_index;
+  int rt = uringCall(fd, WRITE, sqe, ~0ull, true);
+  if (rt < 0) {
+    errno = -rt;
+    return -1;
+  }
+  return rt;
+}
+
+void IOManager::submitUring(bool force) {
+  int idx = workerIndex();
+  if (!m_useUring || idx < 0) {
+    return;
+  }
+  IoUring &ring = *currentReactor().uring;
+  UringBatch &batch = m_uringBatches[idx];
+  if (!batch.count) {
+    // 上次提交时内核忙没有取走的SQE
+    if (force && ring.pending()) {
+      IoUring::MutexType::Lock lock{ring.sqMutex()};
+      ring.submit();
+    }
+    return;
+  }
+  if (!force && batch.count < m_uringBatch && ++batch.ticks < m_uringBatch &&
+      hasReadyTask()) {
+    return;
+  }
+
+  UringRequest *req = batch.head;
+  batch = UringBatch();
+  while (req) {
+    UringRequest *next = req->next;
+    // 锁的顺序总是fd_ctx->mutex -> sqMutex, 与cancelUring一致
+    FdContext::MutexType::Lock lock{req->fd_ctx->mutex};
+    if (req->cancelled) {
+      lock.unlock();
+      completeUring(req, -ECANCELED);
+      req = next;
+      continue;
+    }
+    IoUring::MutexType::Lock lock2{ring.sqMutex()};
+    bool has_timeout = req->timeout_ms != ~0ull;
+    // 链接在一起的SQE必须在同一次提交中
+    if (!ring.reserve(1 + req->poll_first + has_timeout)) {
+      lock2.unlock();
+      lock.unlock();
+      completeUring(req, -EBUSY);
+      req = next;
+      continue;
+    }
+    if (req->poll_first) {
+      io_uring_sqe *sqe = ring.getSqe();
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = req->sqe.fd;
+      sqe->poll32_events = req->event == READ ? POLLIN : POLLOUT;
+      sqe->flags = IOSQE_IO_LINK;
+      sqe->user_data = (uint64_t)req | 1;
+    }
+    io_uring_sqe *sqe = ring.getSqe();
+    *sqe = req->sqe;
+    sqe->user_data = (uint64_t)req;
+    if (has_timeout) {
+      sqe->flags |= IOSQE_IO_LINK;
+      req->ts.tv_sec = req->timeout_ms / 1000;
+      req->ts.tv_nsec = req->timeout_ms % 1000 * 1000000;
+      io_uring_sqe *timeout_sqe = ring.getSqe();
+      timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+      timeout_sqe->addr = (uint64_t)&req->ts;
+      timeout_sqe->len = 1;
+      timeout_sqe->user_data = 0;
+    }
+    req->ring = &ring;
+    req = next;
+  }
+
+  IoUring::MutexType::Lock lock{ring.sqMutex()};
+  int rt = ring.submit();
+  if (rt < 0 && rt != -EAGAIN && rt != -EBUSY) {
+    LOG_ERROR(g_logger) << "io_uring submit errno=" << -rt
+                        << " errstr=" << strerror(-rt);
+  }
+}
+
+void IOManager::reapUring(IoUring &ring) {
+  IoUring::MutexType::Lock lock{ring.cqMutex()};
+  ring.reap([this](uint64_t user_data, int res) {
+    // 0 是超时和取消请求, 低位为1的是前置的POLL_ADD, 只关心被链接的操作本身
+    if (user_data == 0 || (user_data & 1)) {
+      return;
+    }
+    completeUring((UringRequest *)user_data, res);
+  });
+}
+
+void IOManager::completeUring(UringRequest *req, int res) {
+  {
+    FdContext::MutexType::Lock lock{req->fd_ctx->mutex};
+    req->fd_ctx->getContext(req->event).uring = nullptr;
+  }
+  req->res = res;
+  Scheduler *scheduler = req->scheduler;
+  Fiber::ptr fiber;
+  fiber.swap(req->fiber);
+  int thread_id = req->thread_id;
+  // 协程被调度之后req所在的栈随时可能失效, 不能再访问
+  scheduler->schedule(&fiber, thread_id);
+  --m_pendingEventCount;
+}
+
+bool IOManager::cancelUring(FdContext::EventContext &ctx) {
+  UringRequest *req = ctx.uring;
+  if (!req || req->cancelled) {
+    return false;
+  }
+  req->cancelled = true;
+  IoUring *ring = req->ring;
+  if (!ring) {
+    // 还在发起线程的批次里, 提交时会直接以ECANCELED完成
+    return true;
+  }
+  IoUring::MutexType::Lock lock{ring->sqMutex()};
+  for (int i = 0; i < (req->poll_first ? 2 : 1); ++i) {
+    io_uring_sqe *sqe = ring->getSqe();
+    if (!sqe) {
+      break;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)req | i;
+    sqe->user_data = 0;
+  }
+  ring->submit();
   return true;
 }
 
@@ -238,30 +554,58 @@ void IOManager::tickle() {
   if (!hasIdleThreads()) {
     return;
   }
-  int rt = write(m_tickleFds[1], "T", 1);
-  ASSERT(rt == 1);
+  if (m_reactors.size() == 1) {
+    m_reactors[0]->tickle();
+    return;
+  }
+  int idx = idleWorker();
+  if (idx >= 0) {
+    m_reactors[idx]->tickle();
+  }
+}
+void IOManager::tickleWorker(size_t index) {
+  if (m_reactors.size() == 1) {
+    tickle();
+    return;
+  }
+  if (index < m_reactors.size()) {
+    m_reactors[index]->tickle();
+  }
 }
 bool IOManager::stopping() {
   uint64_t timeout = 0;
   return stopping(timeout);
 }
 
-bool IOManager::stopping(uint64_t timeout) {
+bool IOManager::stopping(uint64_t &timeout) {
   timeout = getNextTimer();
   return timeout == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
 }
 
 void IOManager::idle() {
-  epoll_event *events = new epoll_event[64]();
-  std::shared_ptr<epoll_event> shared_events(
-      events, [](epoll_event *ptrs) { delete[] ptrs; });
+  Reactor &reactor = currentReactor();
+  int uring_fd = reactor.uring ? reactor.uring->eventFd() : -1;
+  int batch = std::max(g_epoll_batch_size->get_value(), 1);
+  std::vector<epoll_event> events(batch);
 
   while (true) {
     uint64_t next_timeout = 0;
     if (stopping(next_timeout)) {
       LOG_DEBUG(g_logger) << "name=" << name() << " idle stopping exit";
+      // 一次唤醒只会叫醒一个epoll_wait的线程, 退出前接力唤醒下一个
+      if (m_reactors.size() == 1) {
+        tickle();
+      } else {
+        for (auto &r : m_reactors) {
+          if (r.get() != &reactor) {
+            r->tickle();
+          }
+        }
+      }
       break;
     }
+    // 阻塞之前把攒下的请求都交给内核
+    submitUring(true);
     int rt = 0;
     do {
       static const int MAX_TIMEOUT = 3000;
@@ -270,7 +614,11 @@ void IOManager::idle() {
       } else {
         next_timeout = (uint64_t)MAX_TIMEOUT;
       }
-      rt = epoll_wait(m_epfd, events, 64, (int)next_timeout);
+      // 进入idle之后才到达的任务可能没有tickle到自己, 不能阻塞
+      if (hasReadyTask()) {
+        next_timeout = 0;
+      }
+      rt = epoll_wait(reactor.epfd, &events[0], batch, (int)next_timeout);
       if (rt < 0 && errno == EINTR) {
 
       } else {
@@ -287,10 +635,19 @@ void IOManager::idle() {
 
     for (int i = 0; i < rt; ++i) {
       epoll_event &event = events[i];
-      if (event.data.fd == m_tickleFds[0]) {
-        uint8_t dummy;
-        while (read(m_tickleFds[0], &dummy, 1) == 1)
-          ;
+      if (event.data.fd == reactor.tickleFd) {
+        // 先读再清标记: 先清的话, 两步之间的tickle写入会被这次read读走,
+        // 标记却留在true, 之后的tickle都不会再写eventfd
+        // 清标记之前的tickle不会再写, 它们的任务在回到调度循环时取走
+        uint64_t dummy;
+        read(reactor.tickleFd, &dummy, sizeof(dummy));
+        reactor.ticklePending = false;
+        continue;
+      }
+      if (event.data.fd == uring_fd) {
+        uint64_t dummy;
+        read(uring_fd, &dummy, sizeof(dummy));
+        reapUring(*reactor.uring);
         continue;
       }
       FdContext *fd_ctx = (FdContext *)event.data.ptr;
@@ -305,7 +662,9 @@ void IOManager::idle() {
       if (event.events & EPOLLOUT) {
         real_events |= WRITE;
       }
-      if ((fd_ctx->events & real_events) == NONE) {
+      // ERR/HUP会同时报告读写, 只触发注册过的事件
+      real_events &= fd_ctx->events;
+      if (real_events == NONE) {
         continue;
       }
 
@@ -313,7 +672,7 @@ void IOManager::idle() {
       int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
       event.events = EPOLLET | left_events;
 
-      int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
+      int rt2 = epoll_ctl(reactor.epfd, op, fd_ctx->fd, &event);
       if (rt2) {
         LOG_ERROR(g_logger) << "epoll_ctl";
         continue;
@@ -337,4 +696,10 @@ void IOManager::idle() {
 }
 
 void IOManager::onTimerInsertAtFront() { tickle(); }
+
+void IOManager::flushPending() {
+  if (m_useUring) {
+    submitUring(false);
+  }
+}
 } // namespace cool
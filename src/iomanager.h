@@ -1,17 +1,24 @@
 #ifndef __COOL_IOMANAGER_H
 #define __COOL_IOMANAGER_H
 
+#include "fd_table.h"
 #include "fiber.h"
 #include "scheduler.h"
 #include "timer.h"
 #include <atomic>
 #include <functional>
 #include <memory>
+#include <sys/uio.h>
+#include <vector>
+
+struct io_uring_sqe;
+
 namespace cool {
+class IoUring;
+
 class IOManager : public Scheduler, public TimerManager {
 public:
   using ptr = std::shared_ptr<IOManager>;
-  using RWMutexType = RWMutex;
 
   enum Event {
     NONE = 0x0,
@@ -31,23 +38,41 @@ public:
 
   static IOManager *GetThis();
 
+  // iomanager.backend=io_uring 且内核支持时为true, 否则使用epoll
+  bool isUring() const { return m_useUring; }
+  // 把一个操作交给io_uring执行, 当前协程挂起直到完成, 返回cqe的res(失败为-errno)
+  // 超时返回-ETIMEDOUT, 被cancelEvent/cancekAll取消时返回-ECANCELED
+  // poll_first 先等句柄就绪再执行, 用于内核不会自己等待的操作(如READ_FIXED)
+  // 不在工作线程上时返回-ENOTSUP, SQ满时返回-EBUSY, 调用方可以改用epoll
+  // 同一事件已有未完成的请求时与addEvent重复注册一样断言
+  int uringCall(int fd, Event event, const io_uring_sqe &sqe,
+                uint64_t timeout_ms = ~0ull, bool poll_first = false);
+  // 在所有ring上注册固定缓冲区, 之后按下标用readFixed/writeFixed读写
+  bool registerBuffers(const iovec *iovs, unsigned count);
+  // 使用注册过的缓冲区读写socket, 失败返回-1并设置errno, 非io_uring后端为ENOTSUP
+  ssize_t readFixed(int fd, void *buf, size_t len, int buf_index);
+  ssize_t writeFixed(int fd, const void *buf, size_t len, int buf_index);
+
 protected:
   void tickle() override;
+  void tickleWorker(size_t index) override;
   bool stopping() override;
-  bool stopping(uint64_t timeout);
+  bool stopping(uint64_t &timeout);
   void idle() override;
 
-  void resizeContext(size_t size);
-
   void onTimerInsertAtFront() override;
+  void flushPending() override;
 
 private:
+  struct UringRequest;
   struct FdContext {
     using MutexType = Mutex;
     struct EventContext {
       Scheduler *scheduler;     // 待执行的scheduler
       Fiber::ptr fiber;         // 事件协程
       std::function<void()> cb; // 事件的回调函数
+      UringRequest *uring = nullptr; // 正在io_uring中执行的请求
+      int thread_id = -1;            // 等待的任务指定的线程, 唤醒后回到这里
     };
 
     EventContext &getContext(Event event);
@@ -58,14 +83,50 @@ private:
     EventContext read;          // 读事件
     EventContext write;         // 写事件
     Event events = Event::NONE; // 已经注册的事件
+    int reactor = -1;           // 注册到的reactor下标
     MutexType mutex;            // 锁
   };
-  int m_epfd = 0;
-  int m_tickleFds[2];
+  // 一个epoll实例和它的唤醒句柄
+  struct Reactor {
+    Reactor();
+    ~Reactor();
+    void tickle();
+
+    int epfd = -1;
+    int tickleFd = -1;
+    // 已经写过eventfd但还没有被idle线程读走, 期间的tickle合并为一次
+    std::atomic<bool> ticklePending = {false};
+    // io_uring后端时每个reactor一个ring, 完成事件通过它的eventfd通知epoll
+    std::unique_ptr<IoUring> uring;
+  };
+  // 当前线程idle时等待的reactor
+  Reactor &currentReactor();
+
+  // 把当前线程攒下的io_uring请求填入ring, force或攒够一批时提交给内核
+  void submitUring(bool force);
+  // 取出ring上的完成事件并唤醒对应的协程
+  void reapUring(IoUring &ring);
+  void completeUring(UringRequest *req, int res);
+  // 取消fd上正在io_uring中执行的请求, 需要持有fd_ctx->mutex
+  bool cancelUring(FdContext::EventContext &ctx);
+  // 工作线程攒下的还没有放入ring的请求, 只被所属线程访问
+  struct UringBatch {
+    UringRequest *head = nullptr;
+    UringRequest *tail = nullptr;
+    unsigned count = 0;
+    unsigned ticks = 0;
+  };
+
+  // 默认所有线程共享一个reactor, 开启iomanager.reactor_per_thread后每个工作线程一个
+  std::vector<std::unique_ptr<Reactor>> m_reactors;
+  std::atomic<uint32_t> m_nextReactor = {0};
+  bool m_useUring = false;
+  unsigned m_uringBatch = 1;
+  std::vector<UringBatch> m_uringBatches;
 
   std::atomic<size_t> m_pendingEventCount = {0};
-  RWMutexType m_mutex;
-  std::vector<FdContext *> m_fdContexts;
+  // 按fd索引的事件上下文, 查找和扩容都不加锁
+  FdTable<FdContext> m_fdContexts;
 };
 } // namespace cool
 
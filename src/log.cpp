@@ -1,11 +1,22 @@
 #include "config.h"
 #include "log.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <dirent.h>
+#include <fcntl.h>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <yaml-cpp/node/node.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <yaml-cpp/node/parse.h>
+#include <zlib.h>
 namespace cool {
 // LogLevel
 LogLevel::Level LogLevel::from_string(const std::string &v) {
@@ -42,13 +53,36 @@ const char *LogLevel::to_string(LogLevel::Level level) {
   }
 }
 // LogEvent
-LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *file,
+LogEvent::LogEvent(Logger *logger, LogLevel::Level level, const char *file,
                    uint32_t line, uint32_t elapse, uint32_t thread_id,
-                   std::string thread_name, uint32_t fiber_id, uint64_t time)
+                   const std::string &thread_name, uint32_t fiber_id,
+                   uint64_t time)
     : m_file(file), m_line(line), m_elapse(elapse), m_thread_id(thread_id),
-      m_thread_name(thread_name), m_fiber_id(fiber_id), m_time(time),
+      m_thread_name(&thread_name), m_fiber_id(fiber_id), m_time(time),
       m_logger(logger), m_level(level) {}
 
+void LogEvent::reset(Logger *logger, LogLevel::Level level, const char *file,
+                     uint32_t line, uint32_t elapse, uint32_t thread_id,
+                     const std::string &thread_name, uint32_t fiber_id,
+                     uint64_t time) {
+  m_file = file;
+  m_line = line;
+  m_elapse = elapse;
+  m_thread_id = thread_id;
+  m_thread_name = &thread_name;
+  m_fiber_id = fiber_id;
+  m_time = time;
+  m_logger = logger;
+  m_level = level;
+  // 保留已经分配的缓冲区, 恢复上一条日志可能改过的流格式
+  m_ss.str(std::string());
+  m_ss.clear();
+  m_ss.flags(std::ios_base::dec | std::ios_base::skipws);
+  m_ss.precision(6);
+  m_ss.width(0);
+  m_ss.fill(' ');
+}
+
 /**
  * @brief 格式化输出，使用不定参数
  *
@@ -69,132 +103,152 @@ void LogEvent::format(const char *fmt, va_list al) {
     free(buf);
   }
 }
+size_t LogEvent::copy_content(char *buf, size_t len) {
+  std::streambuf *sb = m_ss.rdbuf();
+  size_t size = sb->pubseekoff(0, std::ios_base::cur, std::ios_base::out);
+  if (len > 0) {
+    sb->pubseekpos(0, std::ios_base::in);
+    sb->sgetn(buf, std::min(len, size));
+  }
+  return size;
+}
 
 // LogEventWrap
 LogEventWrap::LogEventWrap(LogEvent::ptr e) : m_event(e) {}
+static thread_local LogEvent::ptr t_log_event;
+LogEventWrap::LogEventWrap(Logger *logger, LogLevel::Level level,
+                           const char *file, uint32_t line) {
+  LogEvent::ptr &cached = t_log_event;
+  if (cached && cached.use_count() == 1) {
+    cached->reset(logger, level, file, line, 0, thread_id(), Thread::GetName(),
+                  fiber_id(), time(0));
+    m_event = cached;
+    return;
+  }
+  m_event.reset(new LogEvent(logger, level, file, line, 0, thread_id(),
+                             Thread::GetName(), fiber_id(), time(0)));
+  if (!cached) {
+    cached = m_event;
+  }
+}
 LogEventWrap::~LogEventWrap() { m_event->get_logger()->log(m_event); }
 std::stringstream &LogEventWrap::get_ss() { return m_event->get_ss(); }
 
-// LogFormatter::FormatItem
-class MessageFormatItem : public LogFormatter::FormatItem {
-public:
-  MessageFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_content();
-  }
-};
-class LevelFormatItem : public LogFormatter::FormatItem {
-public:
-  LevelFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    // os << LogLevel::to_string(level);
-    os << LogLevel::to_string(event->get_level());
-  }
-};
-class ElapseFormatItem : public LogFormatter::FormatItem {
-public:
-  ElapseFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_elapse();
-  }
-};
-class ThreadIdFormatItem : public LogFormatter::FormatItem {
-public:
-  ThreadIdFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_thread_id();
-  }
-};
-class ThreadNameFormatItem : public LogFormatter::FormatItem {
-public:
-  ThreadNameFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_thread_name();
-  }
-};
-class NameFormatItem : public LogFormatter::FormatItem {
-public:
-  NameFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_logger()->get_name();
-  }
-};
-class FiberIdFormatItem : public LogFormatter::FormatItem {
-public:
-  FiberIdFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_fiber_id();
-  }
-};
-class DateTimeFormatItem : public LogFormatter::FormatItem {
-public:
-  DateTimeFormatItem(const std::string &format = "%Y-%m-%d %H:%M:%S")
-      : m_format(format) {
-    if (m_format.empty()) {
-      m_format = "%Y-%m-%d %H:%M:%S";
+// LogFormatter
+namespace {
+
+// 写入调用者的缓冲区, 放不下的部分只计长度
+struct FormatBuffer {
+  FormatBuffer(char *b, size_t l) : buf(b), len(l) {}
+  void append(const char *data, size_t n) {
+    if (pos < len) {
+      memcpy(buf + pos, data, std::min(n, len - pos));
     }
+    pos += n;
   }
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    struct tm tm;
-    time_t time = event->get_time();
-    localtime_r(&time, &tm);
-    char buf[64];
-    strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-    os << buf;
+  void append(const std::string &str) { append(str.data(), str.size()); }
+  void append(const char *str) { append(str, strlen(str)); }
+  void append(uint64_t v) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    do {
+      *--p = '0' + v % 10;
+      v /= 10;
+    } while (v);
+    append(p, tmp + sizeof(tmp) - p);
   }
 
-private:
-  std::string m_format;
-};
-class FilenameFormatItem : public LogFormatter::FormatItem {
-public:
-  FilenameFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_file();
-  }
+  char *buf;
+  size_t len;
+  size_t pos = 0;
 };
-class LineFormatItem : public LogFormatter::FormatItem {
-public:
-  LineFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << event->get_line();
-  }
-};
-class NewLineFormatItem : public LogFormatter::FormatItem {
-public:
-  NewLineFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << std::endl;
-  }
-};
-class TabFormatItem : public LogFormatter::FormatItem {
-public:
-  TabFormatItem(const std::string &str = "") {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << "\t";
-  }
+
+// 日志时间只精确到秒, 每个线程缓存上一秒格式化好的时间
+struct DateCache {
+  uint64_t time = -1;
+  std::string format;
+  char buf[64];
+  size_t len = 0;
 };
-class StringFormatItem : public LogFormatter::FormatItem {
-public:
-  StringFormatItem(const std::string &str) : m_string(str) {}
-  virtual void format(std::ostream &os, LogEvent::ptr event) override {
-    os << m_string;
+static thread_local DateCache t_date_cache;
+
+static void append_date(FormatBuffer &fb, const std::string &format,
+                        uint64_t t) {
+  DateCache &cache = t_date_cache;
+  if (cache.time != t || cache.format != format) {
+    struct tm tm;
+    time_t time = t;
+    localtime_r(&time, &tm);
+    cache.len = strftime(cache.buf, sizeof(cache.buf), format.c_str(), &tm);
+    cache.time = t;
+    cache.format = format;
   }
+  fb.append(cache.buf, cache.len);
+}
 
-private:
-  std::string m_string;
-};
+} // namespace
 
-// LogFormatter
 LogFormatter::LogFormatter(const std::string &pattern) : m_pattern(pattern) {
   init();
 }
+size_t LogFormatter::format(char *buf, size_t len, LogEvent::ptr event) {
+  FormatBuffer fb(buf, len);
+  for (auto &i : m_ops) {
+    switch (i.type) {
+    case Op::LITERAL:
+      fb.append(i.arg);
+      break;
+    case Op::MESSAGE:
+      fb.pos += event->copy_content(
+          fb.pos < len ? buf + fb.pos : nullptr, fb.pos < len ? len - fb.pos : 0);
+      break;
+    case Op::LEVEL:
+      fb.append(LogLevel::to_string(event->get_level()));
+      break;
+    case Op::ELAPSE:
+      fb.append((uint64_t)event->get_elapse());
+      break;
+    case Op::NAME:
+      fb.append(event->get_logger()->get_name());
+      break;
+    case Op::THREAD_ID:
+      fb.append((uint64_t)event->get_thread_id());
+      break;
+    case Op::THREAD_NAME:
+      fb.append(event->get_thread_name());
+      break;
+    case Op::FIBER_ID:
+      fb.append((uint64_t)event->get_fiber_id());
+      break;
+    case Op::DATETIME:
+      append_date(fb, i.arg, event->get_time());
+      break;
+    case Op::FILENAME:
+      fb.append(event->get_file());
+      break;
+    case Op::LINE:
+      fb.append((uint64_t)event->get_line());
+      break;
+    }
+  }
+  return fb.pos;
+}
 std::string LogFormatter::format(LogEvent::ptr event) {
-  std::stringstream ss;
-  for (auto &i : m_items) {
-    i->format(ss, event);
+  char buf[1024];
+  size_t n = format(buf, sizeof(buf), event);
+  if (n <= sizeof(buf)) {
+    return std::string(buf, n);
+  }
+  std::string str(n, '\0');
+  format(&str[0], n, event);
+  return str;
+}
+void LogFormatter::addLiteral(const std::string &str) {
+  if (!m_ops.empty() && m_ops.back().type == Op::LITERAL) {
+    m_ops.back().arg += str;
+  } else {
+    m_ops.push_back(Op(Op::LITERAL, str));
   }
-  return ss.str();
 }
 // %xxx %xxx{xxx} %%
 void LogFormatter::init() {
@@ -211,6 +265,7 @@ void LogFormatter::init() {
     if ((i + 1) < m_pattern.size()) {
       if (m_pattern[i + 1] == '%') {
         nstr.append(1, '%');
+        ++i;
         continue;
       }
     }
@@ -265,44 +320,34 @@ void LogFormatter::init() {
   if (!nstr.empty()) {
     vec.push_back(std::make_tuple(nstr, "", 0));
   }
-  static std::map<std::string,
-                  std::function<FormatItem::ptr(const std::string &str)>>
-      s_format_items = {
-#define XX(str, C)                                                          \
-  {                                                                         \
-    str, [](const std::string &fmt) { return FormatItem::ptr(new C(fmt)); } \
-  }
-          XX("m", MessageFormatItem),
-          XX("p", LevelFormatItem),
-          XX("r", ElapseFormatItem),
-          XX("c", NameFormatItem),
-          XX("t", ThreadIdFormatItem),
-          XX("n", NewLineFormatItem),
-          XX("d", DateTimeFormatItem),
-          XX("f", FilenameFormatItem),
-          XX("l", LineFormatItem),
-          XX("T", TabFormatItem),
-          XX("F", FiberIdFormatItem),
-          XX("N", ThreadNameFormatItem)
-#undef XX
-      };
+  static std::map<std::string, Op::Type> s_ops = {
+      {"m", Op::MESSAGE},   {"p", Op::LEVEL},       {"r", Op::ELAPSE},
+      {"c", Op::NAME},      {"t", Op::THREAD_ID},   {"d", Op::DATETIME},
+      {"f", Op::FILENAME},  {"l", Op::LINE},        {"F", Op::FIBER_ID},
+      {"N", Op::THREAD_NAME},
+  };
   for (auto &i : vec) {
+    const std::string &str = std::get<0>(i);
     if (std::get<2>(i) == 0) {
-      m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+      addLiteral(str);
+    } else if (str == "n") {
+      addLiteral("\n");
+    } else if (str == "T") {
+      addLiteral("\t");
     } else {
-      auto it = s_format_items.find(std::get<0>(i));
-      if (it == s_format_items.end()) {
-        m_items.push_back(FormatItem::ptr(
-            new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
+      auto it = s_ops.find(str);
+      if (it == s_ops.end()) {
+        addLiteral("<<error_format %" + str + ">>");
         m_error = true;
+      } else if (it->second == Op::DATETIME) {
+        m_ops.push_back(Op(Op::DATETIME, std::get<1>(i).empty()
+                                             ? "%Y-%m-%d %H:%M:%S"
+                                             : std::get<1>(i)));
       } else {
-        m_items.push_back(it->second(std::get<1>(i)));
+        m_ops.push_back(Op(it->second));
       }
     }
-    // std::cout << "{" << std::get<0>(i) << "} - {" << std::get<1>(i) << "} -
-    // {" << std::get<2>(i) << "}" << std::endl;
   }
-  // std::cout << m_items.size() << std::endl;
 }
 // LogAppender
 // get and set
@@ -315,18 +360,597 @@ LogFormatter::ptr LogAppender::get_formatter() {
   return m_formatter;
 }
 
-FileLogAppender::FileLogAppender(const std::string &filename)
-    : m_filename(filename) {
-  m_filestream.open(m_filename, std::ios_base::app);
+// 先格式化到栈上的缓冲区, 放不下时才分配内存
+template <class Func>
+static void format_event(LogFormatter::ptr formatter, LogEvent::ptr event,
+                         Func cb) {
+  char buf[4096];
+  size_t n = formatter->format(buf, sizeof(buf), event);
+  if (n <= sizeof(buf)) {
+    cb(buf, n);
+  } else {
+    std::string str = formatter->format(event);
+    cb(str.data(), str.size());
+  }
 }
+
+void StdoutLogAppender::log(LogEvent::ptr event) {
+  MutexType::Lock lock(m_mutex);
+  format_event(m_formatter, event, [](const char *data, size_t len) {
+    std::cout.write(data, len);
+  });
+}
+
+void StdoutLogAppender::write(const char *data, size_t len) {
+  MutexType::Lock lock(m_mutex);
+  std::cout.write(data, len);
+}
+void StdoutLogAppender::flush() {
+  MutexType::Lock lock(m_mutex);
+  std::cout.flush();
+}
+
+// FileLogAppender
+namespace {
+
+// 日志文件的切分, 压缩和清理都在这个线程做, 写日志的线程只放进队列
+class LogFileRotator {
+public:
+  static LogFileRotator *GetInstance() {
+    static LogFileRotator *s_rotator = new LogFileRotator;
+    return s_rotator;
+  }
+
+  void request(std::weak_ptr<FileLogAppender> appender) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(appender);
+    if (!m_thread) {
+      m_thread.reset(
+          new Thread(std::bind(&LogFileRotator::run, this), "log_rotate"));
+    }
+    m_cond.notify_one();
+  }
+
+private:
+  void run() {
+    while (true) {
+      std::weak_ptr<FileLogAppender> appender;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return !m_queue.empty(); });
+        appender = m_queue.front();
+        m_queue.pop_front();
+      }
+      if (auto a = appender.lock()) {
+        a->rotate();
+      }
+    }
+  }
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::list<std::weak_ptr<FileLogAppender>> m_queue;
+  Thread::ptr m_thread;
+};
+
+static int open_log_file(const std::string &filename, uint64_t *size) {
+  int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    std::cout << "log file open error: " << filename << " errno=" << errno
+              << " " << strerror(errno) << std::endl;
+    return -1;
+  }
+  struct stat st;
+  *size = fstat(fd, &st) == 0 ? st.st_size : 0;
+  return fd;
+}
+
+// 压缩成filename.gz, 成功后删除原文件
+static bool gzip_file(const std::string &filename) {
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  std::string gzname = filename + ".gz";
+  gzFile gz = gzopen(gzname.c_str(), "wb");
+  if (!gz) {
+    ::close(fd);
+    return false;
+  }
+  char buf[64 * 1024];
+  ssize_t n = 0;
+  bool ok = true;
+  while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+    if (gzwrite(gz, buf, n) != n) {
+      ok = false;
+      break;
+    }
+  }
+  ok = gzclose(gz) == Z_OK && ok && n == 0;
+  ::close(fd);
+  if (!ok) {
+    std::cout << "log gzip error: " << filename << std::endl;
+    ::unlink(gzname.c_str());
+    return false;
+  }
+  ::unlink(filename.c_str());
+  return true;
+}
+
+} // namespace
+
+FileLogAppender::RotatePeriod
+FileLogAppender::PeriodFromString(const std::string &v) {
+  if (v == "hourly") {
+    return HOURLY;
+  }
+  if (v == "daily") {
+    return DAILY;
+  }
+  return NONE;
+}
+
+const char *FileLogAppender::PeriodToString(RotatePeriod period) {
+  switch (period) {
+  case HOURLY:
+    return "hourly";
+  case DAILY:
+    return "daily";
+  default:
+    return "none";
+  }
+}
+
+FileLogAppender::FileLogAppender(const std::string &filename,
+                                 uint64_t max_size, RotatePeriod period,
+                                 uint32_t max_files, bool compress)
+    : m_filename(filename), m_maxSize(max_size), m_period(period),
+      m_maxFiles(max_files), m_compress(compress) {
+  m_fd = open_log_file(m_filename, &m_size);
+  m_nextRotate = nextRotateTime(time(0));
+}
+
+FileLogAppender::~FileLogAppender() {
+  flushLocked();
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
 void FileLogAppender::log(LogEvent::ptr event) {
   MutexType::Lock lock(m_mutex);
-  m_filestream << m_formatter->format(event) << std::flush;
+  format_event(m_formatter, event, [this](const char *data, size_t len) {
+    writeLocked(data, len);
+    flushLocked();
+  });
 }
 
-void StdoutLogAppender::log(LogEvent::ptr event) {
+void FileLogAppender::write(const char *data, size_t len) {
+  MutexType::Lock lock(m_mutex);
+  writeLocked(data, len);
+}
+
+void FileLogAppender::flush() {
   MutexType::Lock lock(m_mutex);
-  std::cout << m_formatter->format(event);
+  flushLocked();
+}
+
+void FileLogAppender::writeLocked(const char *data, size_t len) {
+  m_buffer.append(data, len);
+  m_size += len;
+  checkRotate();
+}
+
+void FileLogAppender::flushLocked() {
+  size_t pos = 0;
+  while (m_fd >= 0 && pos < m_buffer.size()) {
+    ssize_t n = ::write(m_fd, m_buffer.data() + pos, m_buffer.size() - pos);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    pos += n;
+  }
+  m_buffer.clear();
+}
+
+void FileLogAppender::checkRotate() {
+  if (m_rotating || (m_maxSize == 0 && m_nextRotate == 0)) {
+    return;
+  }
+  if ((m_maxSize && m_size >= m_maxSize) ||
+      (m_nextRotate && (uint64_t)time(0) >= m_nextRotate)) {
+    m_rotating = true;
+    LogFileRotator::GetInstance()->request(shared_from_this());
+  }
+}
+
+uint64_t FileLogAppender::nextRotateTime(time_t now) const {
+  if (m_period == NONE) {
+    return 0;
+  }
+  struct tm tm;
+  localtime_r(&now, &tm);
+  tm.tm_min = 0;
+  tm.tm_sec = 0;
+  if (m_period == HOURLY) {
+    tm.tm_hour += 1;
+  } else {
+    tm.tm_hour = 0;
+    tm.tm_mday += 1;
+  }
+  tm.tm_isdst = -1;
+  return mktime(&tm);
+}
+
+void FileLogAppender::rotate() {
+  time_t now = time(0);
+  struct tm tm;
+  localtime_r(&now, &tm);
+  char suffix[32];
+  strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tm);
+  std::string rotated = m_filename + suffix;
+  for (int i = 1; access(rotated.c_str(), F_OK) == 0 ||
+                  access((rotated + ".gz").c_str(), F_OK) == 0;
+       ++i) {
+    rotated = m_filename + suffix + "." + std::to_string(i);
+  }
+  // 重命名之后写日志的线程还在写旧的fd, 内容进入重命名后的文件
+  bool renamed = ::rename(m_filename.c_str(), rotated.c_str()) == 0;
+  if (!renamed && errno != ENOENT) {
+    std::cout << "log rotate error: rename " << m_filename << " to " << rotated
+              << " errno=" << errno << " " << strerror(errno) << std::endl;
+  }
+  uint64_t size = 0;
+  int fd = open_log_file(m_filename, &size);
+  int old = -1;
+  {
+    MutexType::Lock lock(m_mutex);
+    flushLocked();
+    if (fd >= 0) {
+      old = m_fd;
+      m_fd = fd;
+    }
+    // 打开失败时继续写旧文件, 等下一次切分再重试
+    m_size = size;
+    m_nextRotate = nextRotateTime(now);
+    m_rotating = false;
+  }
+  if (old >= 0) {
+    ::close(old);
+  }
+  if (renamed && m_compress) {
+    gzip_file(rotated);
+  }
+  if (m_maxFiles) {
+    removeOldFiles();
+  }
+}
+
+bool FileLogAppender::reopen() {
+  uint64_t size = 0;
+  int fd = open_log_file(m_filename, &size);
+  if (fd < 0) {
+    return false;
+  }
+  MutexType::Lock lock(m_mutex);
+  flushLocked();
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+  m_fd = fd;
+  m_size = size;
+  return true;
+}
+
+void FileLogAppender::removeOldFiles() {
+  size_t pos = m_filename.rfind('/');
+  std::string dir = pos == std::string::npos ? "."
+                    : pos == 0              ? "/"
+                                            : m_filename.substr(0, pos);
+  std::string prefix =
+      (pos == std::string::npos ? m_filename : m_filename.substr(pos + 1)) +
+      ".";
+  DIR *d = opendir(dir.c_str());
+  if (!d) {
+    return;
+  }
+  // 切分出来的文件名为 filename.YYYYmmdd-HHMMSS[.N][.gz], 按修改时间排序
+  std::vector<std::pair<uint64_t, std::string>> files;
+  struct dirent *dp = nullptr;
+  while ((dp = readdir(d)) != nullptr) {
+    std::string name = dp->d_name;
+    if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) ||
+        !isdigit(name[prefix.size()])) {
+      continue;
+    }
+    std::string path = dir + "/" + name;
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+      files.push_back(std::make_pair(
+          st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec, path));
+    }
+  }
+  closedir(d);
+  if (files.size() <= m_maxFiles) {
+    return;
+  }
+  std::sort(files.begin(), files.end());
+  for (size_t i = 0; i < files.size() - m_maxFiles; ++i) {
+    ::unlink(files[i].second.c_str());
+  }
+}
+
+// AsyncLogAppender
+static ConfigVar<uint64_t>::ptr g_log_async_buffer_size =
+    Config::lookup("log.async.buffer_size", (uint64_t)(1024 * 1024),
+                   "per thread async log buffer size");
+static ConfigVar<std::string>::ptr g_log_async_overflow = Config::lookup(
+    "log.async.overflow", std::string("block"), "async log buffer full: block or drop");
+static ConfigVar<uint32_t>::ptr g_log_async_flush_interval =
+    Config::lookup("log.async.flush_interval", (uint32_t)100,
+                   "async log flush interval ms");
+
+namespace {
+
+// 缓冲区中每条日志前的头部, 整条按16字节对齐, 头部不会被缓冲区末尾截断
+struct AsyncLogRecord {
+  // 日志长度, WRAP表示跳到缓冲区开头
+  uint32_t size;
+  uint32_t reserved;
+  LogAppender *appender;
+};
+static const uint32_t ASYNC_LOG_WRAP = 0xFFFFFFFF;
+static const size_t ASYNC_LOG_ALIGN = 16;
+
+static size_t async_log_align(size_t len) {
+  return (len + ASYNC_LOG_ALIGN - 1) & ~(ASYNC_LOG_ALIGN - 1);
+}
+
+// 单生产者单消费者环形缓冲区, head/tail只增不减, 对capacity取模得到位置
+struct AsyncLogRing {
+  AsyncLogRing(size_t cap) : buffer(new char[cap]), capacity(cap) {}
+  ~AsyncLogRing() { delete[] buffer; }
+
+  char *buffer;
+  size_t capacity;
+  // 消费者读到的位置
+  std::atomic<uint64_t> head = {0};
+  // 生产者写到的位置
+  std::atomic<uint64_t> tail = {0};
+  // 所属线程已经退出, 取空之后由消费者释放
+  std::atomic<bool> closed = {false};
+};
+
+struct AsyncLogRingHolder {
+  ~AsyncLogRingHolder() {
+    if (ring) {
+      ring->closed.store(true, std::memory_order_release);
+      ring = nullptr;
+    }
+  }
+  AsyncLogRing *ring = nullptr;
+};
+static thread_local AsyncLogRingHolder t_async_log_ring;
+
+class AsyncLogWriter {
+public:
+  using MutexType = Mutex;
+  enum PushResult { PUSHED, DROPPED, TOO_LARGE };
+
+  // 不析构, 进程退出时由atexit停止后台线程并写出剩下的日志
+  static AsyncLogWriter *GetInstance() {
+    static AsyncLogWriter *s_writer = new AsyncLogWriter;
+    return s_writer;
+  }
+
+  PushResult push(LogAppender *appender, const char *data, size_t len);
+  // 写出所有缓冲区, 然后每个输出器flush一次
+  void drain();
+  // 写出之前的日志后直接写, 用于FATAL和超过缓冲区一半的日志
+  void writeDirect(LogAppender *appender, const char *data, size_t len);
+  void start();
+  uint64_t dropped() const { return m_dropped; }
+
+private:
+  AsyncLogWriter() {}
+  AsyncLogRing *newRing();
+  void notify() { m_cond.notify_one(); }
+  void drainLocked();
+  void run();
+  static void Stop();
+
+private:
+  // 保护m_rings
+  MutexType m_mutex;
+  std::vector<AsyncLogRing *> m_rings;
+  // 同一时间只有一个消费者
+  MutexType m_drainMutex;
+  std::mutex m_waitMutex;
+  std::condition_variable m_cond;
+  std::atomic<bool> m_stop = {false};
+  std::atomic<uint64_t> m_dropped = {0};
+  Thread::ptr m_thread;
+};
+
+AsyncLogRing *AsyncLogWriter::newRing() {
+  size_t cap = async_log_align(g_log_async_buffer_size->get_value());
+  if (cap < ASYNC_LOG_ALIGN * 64) {
+    cap = ASYNC_LOG_ALIGN * 64;
+  }
+  AsyncLogRing *ring = new AsyncLogRing(cap);
+  MutexType::Lock lock(m_mutex);
+  m_rings.push_back(ring);
+  return ring;
+}
+
+AsyncLogWriter::PushResult AsyncLogWriter::push(LogAppender *appender,
+                                                const char *data, size_t len) {
+  AsyncLogRing *ring = t_async_log_ring.ring;
+  if (!ring) {
+    ring = t_async_log_ring.ring = newRing();
+  }
+  size_t cap = ring->capacity;
+  size_t need = async_log_align(sizeof(AsyncLogRecord) + len);
+  if (need > cap / 2) {
+    return TOO_LARGE;
+  }
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  size_t offset = tail % cap;
+  // 剩下的空间放不下时跳到开头, 保证一条日志是连续的
+  size_t skip = cap - offset < need ? cap - offset : 0;
+  while (true) {
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    if (cap - (tail - head) >= skip + need) {
+      break;
+    }
+    if (g_log_async_overflow->get_value() == "drop") {
+      ++m_dropped;
+      return DROPPED;
+    }
+    if (m_stop) {
+      // 后台线程已经退出, 自己写出
+      drain();
+      continue;
+    }
+    notify();
+    sched_yield();
+  }
+  if (skip) {
+    AsyncLogRecord *wrap = (AsyncLogRecord *)(ring->buffer + offset);
+    wrap->size = ASYNC_LOG_WRAP;
+    tail += skip;
+    offset = 0;
+  }
+  AsyncLogRecord *rec = (AsyncLogRecord *)(ring->buffer + offset);
+  rec->size = len;
+  rec->appender = appender;
+  memcpy(rec + 1, data, len);
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  ring->tail.store(tail + need, std::memory_order_release);
+  // 超过一半才唤醒后台线程, 其他时候等它定时醒来
+  if (tail + need - head > cap / 2) {
+    notify();
+  }
+  return PUSHED;
+}
+
+void AsyncLogWriter::drain() {
+  MutexType::Lock lock(m_drainMutex);
+  drainLocked();
+}
+
+void AsyncLogWriter::drainLocked() {
+  std::vector<AsyncLogRing *> rings;
+  {
+    MutexType::Lock lock(m_mutex);
+    rings = m_rings;
+  }
+  std::vector<LogAppender *> touched;
+  std::vector<AsyncLogRing *> finished;
+  for (auto ring : rings) {
+    // 先读closed, 之后读到的tail一定包含线程退出前写的全部日志
+    bool closed = ring->closed.load(std::memory_order_acquire);
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    while (head < tail) {
+      size_t offset = head % ring->capacity;
+      AsyncLogRecord *rec = (AsyncLogRecord *)(ring->buffer + offset);
+      if (rec->size == ASYNC_LOG_WRAP) {
+        head += ring->capacity - offset;
+      } else {
+        rec->appender->write((const char *)(rec + 1), rec->size);
+        if (std::find(touched.begin(), touched.end(), rec->appender) ==
+            touched.end()) {
+          touched.push_back(rec->appender);
+        }
+        head += async_log_align(sizeof(AsyncLogRecord) + rec->size);
+      }
+      ring->head.store(head, std::memory_order_release);
+    }
+    if (closed) {
+      finished.push_back(ring);
+    }
+  }
+  for (auto i : touched) {
+    i->flush();
+  }
+  if (!finished.empty()) {
+    MutexType::Lock lock(m_mutex);
+    for (auto ring : finished) {
+      m_rings.erase(std::find(m_rings.begin(), m_rings.end(), ring));
+      delete ring;
+    }
+  }
+}
+
+void AsyncLogWriter::writeDirect(LogAppender *appender, const char *data,
+                                 size_t len) {
+  MutexType::Lock lock(m_drainMutex);
+  drainLocked();
+  appender->write(data, len);
+  appender->flush();
+}
+
+void AsyncLogWriter::start() {
+  MutexType::Lock lock(m_mutex);
+  if (m_thread) {
+    return;
+  }
+  m_thread.reset(new Thread(std::bind(&AsyncLogWriter::run, this), "log_async"));
+  atexit(&AsyncLogWriter::Stop);
+}
+
+void AsyncLogWriter::run() {
+  while (!m_stop) {
+    {
+      std::unique_lock<std::mutex> lock(m_waitMutex);
+      m_cond.wait_for(lock, std::chrono::milliseconds(
+                                g_log_async_flush_interval->get_value()));
+    }
+    drain();
+  }
+}
+
+void AsyncLogWriter::Stop() {
+  AsyncLogWriter *writer = GetInstance();
+  writer->m_stop = true;
+  writer->notify();
+  writer->m_thread->join();
+  writer->drain();
+}
+
+} // namespace
+
+AsyncLogAppender::AsyncLogAppender(LogAppender::ptr appender)
+    : m_appender(appender) {
+  AsyncLogWriter::GetInstance()->start();
+}
+
+AsyncLogAppender::~AsyncLogAppender() { Flush(); }
+
+void AsyncLogAppender::log(LogEvent::ptr event) {
+  // 在调用线程格式化, 后台线程只做写入
+  LogAppender *appender = m_appender.get();
+  format_event(get_formatter(), event,
+               [appender, event](const char *data, size_t len) {
+    AsyncLogWriter *writer = AsyncLogWriter::GetInstance();
+    // FATAL日志不丢弃, 和之前的日志一起写完才返回
+    if (event->get_level() >= LogLevel::FATAL ||
+        writer->push(appender, data, len) == AsyncLogWriter::TOO_LARGE) {
+      writer->writeDirect(appender, data, len);
+    }
+  });
+}
+
+void AsyncLogAppender::Flush() { AsyncLogWriter::GetInstance()->drain(); }
+
+uint64_t AsyncLogAppender::GetDropped() {
+  return AsyncLogWriter::GetInstance()->dropped();
 }
 
 // Logger
@@ -417,8 +1041,18 @@ struct LogAppenderDefine {
   // LogLevel::Level level = LogLevel::UNKNOWN;
   std::string formatter;
   std::string file;
+  // 由AsyncLogAppender包装, 后台线程写出
+  bool async = false;
+  // 文件切分, 见FileLogAppender
+  uint64_t max_size = 0;
+  FileLogAppender::RotatePeriod rotate = FileLogAppender::NONE;
+  uint32_t max_files = 0;
+  bool compress = false;
   bool operator==(const LogAppenderDefine &oth) const {
-    return type == oth.type && formatter == oth.formatter && file == oth.file;
+    return type == oth.type && formatter == oth.formatter &&
+           file == oth.file && async == oth.async &&
+           max_size == oth.max_size && rotate == oth.rotate &&
+           max_files == oth.max_files && compress == oth.compress;
   }
 };
 struct LogDefine {
@@ -471,6 +1105,19 @@ public:
               continue;
             }
             lad.file = a["file"].as<std::string>();
+            if (a["max_size"].IsDefined()) {
+              lad.max_size = a["max_size"].as<uint64_t>();
+            }
+            if (a["rotate"].IsDefined()) {
+              lad.rotate = FileLogAppender::PeriodFromString(
+                  a["rotate"].as<std::string>());
+            }
+            if (a["max_files"].IsDefined()) {
+              lad.max_files = a["max_files"].as<uint32_t>();
+            }
+            if (a["compress"].IsDefined()) {
+              lad.compress = a["compress"].as<bool>();
+            }
             if (a["formatter"].IsDefined()) {
               lad.formatter = a["formatter"].as<std::string>();
             }
@@ -481,6 +1128,9 @@ public:
                       << std::endl;
             continue;
           }
+          if (a["async"].IsDefined()) {
+            lad.async = a["async"].as<bool>();
+          }
           ld.appenders.push_back(lad);
         }
       }
@@ -506,9 +1156,24 @@ public:
         if (a.type == 1) {
           na["type"] = "FileLogAppender";
           na["file"] = a.file;
+          if (a.max_size) {
+            na["max_size"] = a.max_size;
+          }
+          if (a.rotate != FileLogAppender::NONE) {
+            na["rotate"] = FileLogAppender::PeriodToString(a.rotate);
+          }
+          if (a.max_files) {
+            na["max_files"] = a.max_files;
+          }
+          if (a.compress) {
+            na["compress"] = true;
+          }
         } else if (a.type == 2) {
           na["type"] = "StdoutLogAppender";
         }
+        if (a.async) {
+          na["async"] = true;
+        }
         // na["level"] = LogLevel::to_string(a.level);
         if (!a.formatter.empty()) {
           na["formatter"] = a.formatter;
@@ -551,10 +1216,14 @@ struct LogIniter {
         for (auto &a : i.appenders) {
           cool::LogAppender::ptr ap;
           if (a.type == 1) {
-            ap.reset(new FileLogAppender(a.file));
+            ap.reset(new FileLogAppender(a.file, a.max_size, a.rotate,
+                                         a.max_files, a.compress));
           } else if (a.type == 2) {
             ap.reset(new StdoutLogAppender);
           }
+          if (a.async) {
+            ap.reset(new AsyncLogAppender(ap));
+          }
           if (!a.formatter.empty()) {
             ap->set_formatter(LogFormatter::ptr(new LogFormatter(a.formatter)));
           }
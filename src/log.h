@@ -24,27 +24,34 @@
 #include <utility>
 #include <vector>
 
+// 低于这个级别的日志在编译期去掉, 构建时用-DCOOL_LOG_MIN_LEVEL=2去掉DEBUG
+#ifndef COOL_LOG_MIN_LEVEL
+#define COOL_LOG_MIN_LEVEL 1
+#endif
+
 // 普通封装，用法：LOG_ERROR(logger) << "test macro error";
-#define LOG_LEVEL(logger, level_)                                   \
-  if (logger->get_level() <= level_)                                    \
-  cool::LogEventWrap(                                               \
-      cool::LogEvent::ptr(new cool::LogEvent(                       \
-          logger, level_, __FILE__, __LINE__, 0, cool::thread_id(), \
-          cool::Thread::GetName(), cool::fiber_id(), time(0))))     \
-      .get_ss()
+// logger可以是Logger::ptr或者Logger*, 只求值一次, 级别不够时不构造事件
+#define LOG_LEVEL(logger, level_)                                      \
+  if (level_ < COOL_LOG_MIN_LEVEL) {                                   \
+  } else                                                               \
+    for (cool::Logger *__cool_logger = &*(logger);                     \
+         __cool_logger && __cool_logger->get_level() <= level_;        \
+         __cool_logger = nullptr)                                      \
+  cool::LogEventWrap(__cool_logger, level_, __FILE__, __LINE__).get_ss()
 #define LOG_DEBUG(logger) LOG_LEVEL(logger, cool::LogLevel::DEBUG)
 #define LOG_ERROR(logger) LOG_LEVEL(logger, cool::LogLevel::ERROR)
 #define LOG_INFO(logger) LOG_LEVEL(logger, cool::LogLevel::INFO)
 #define LOG_WARN(logger) LOG_LEVEL(logger, cool::LogLevel::WARN)
 #define LOG_FATAL(logger) LOG_LEVEL(logger, cool::LogLevel::FATAL)
 // FMT封装，用法：LOG_FMT_ERROR(logger, "test macro fmt error %s", "sss");
-#define LOG_FMT_LEVEL(logger, level_, fmt, ...)                     \
-  if (logger->get_level() <= level_)                                    \
-  cool::LogEventWrap(                                               \
-      cool::LogEvent::ptr(new cool::LogEvent(                       \
-          logger, level_, __FILE__, __LINE__, 0, cool::thread_id(), \
-          cool::Thread::GetName(), cool::fiber_id(), time(0))))     \
-      .get_event()                                                  \
+#define LOG_FMT_LEVEL(logger, level_, fmt, ...)                        \
+  if (level_ < COOL_LOG_MIN_LEVEL) {                                   \
+  } else                                                               \
+    for (cool::Logger *__cool_logger = &*(logger);                     \
+         __cool_logger && __cool_logger->get_level() <= level_;        \
+         __cool_logger = nullptr)                                      \
+  cool::LogEventWrap(__cool_logger, level_, __FILE__, __LINE__)        \
+      .get_event()                                                     \
       ->format(fmt, __VA_ARGS__)
 #define LOG_FMT_DEBUG(logger, fmt, ...) \
   LOG_FMT_LEVEL(logger, cool::LogLevel::DEBUG, fmt, __VA_ARGS__)
@@ -58,7 +65,14 @@
   LOG_FMT_LEVEL(logger, cool::LogLevel::FATAL, fmt, __VA_ARGS__)
 
 #define LOG_ROOT() cool::LoggerMgr::instance()->get_root()
-#define LOG_NAME(name) cool::LoggerMgr::instance()->get_logger(name);
+#define LOG_NAME(name) cool::LoggerMgr::instance()->get_logger(name)
+// 调用点第一次执行时查找并缓存logger, 之后不再经过LoggerManager的锁
+// 用法：LOG_INFO(LOG_STATIC_NAME("system")) << "xxx";
+#define LOG_STATIC_NAME(name)                                            \
+  ([]() -> cool::Logger * {                                              \
+    static cool::Logger *s_logger = LOG_NAME(name).get();                \
+    return s_logger;                                                     \
+  }())
 
 #define LOGGER_DEF(variable, name) \
   static cool::Logger::ptr variable = LOG_NAME(name);
@@ -85,20 +99,27 @@ class LoggerManager;
 class LogEvent {
 public:
   using ptr = std::shared_ptr<LogEvent>;
-  LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
-           const char *file, uint32_t line, uint32_t elapse, uint32_t thread_id,
-           std::string thread_name, uint32_t fiber_id, uint64_t time);
+  // thread_name只保存引用, 需要比事件活得久, 一般是Thread::GetName()
+  LogEvent(Logger *logger, LogLevel::Level level, const char *file,
+           uint32_t line, uint32_t elapse, uint32_t thread_id,
+           const std::string &thread_name, uint32_t fiber_id, uint64_t time);
   ~LogEvent() {}
+  // 清空内容, 复用为新的事件
+  void reset(Logger *logger, LogLevel::Level level, const char *file,
+             uint32_t line, uint32_t elapse, uint32_t thread_id,
+             const std::string &thread_name, uint32_t fiber_id, uint64_t time);
 
   const char *get_file() const { return m_file; }
   uint32_t get_line() const { return m_line; }
   uint32_t get_elapse() const { return m_elapse; }
   uint32_t get_thread_id() const { return m_thread_id; }
-  const std::string &get_thread_name() const { return m_thread_name; }
+  const std::string &get_thread_name() const { return *m_thread_name; }
   uint32_t get_fiber_id() const { return m_fiber_id; }
   uint32_t get_time() const { return m_time; }
   std::string get_content() const { return m_ss.str(); }
-  std::shared_ptr<Logger> get_logger() const { return m_logger; }
+  // 把内容复制进buf, 最多len字节, 返回内容的总长度, 不产生临时string
+  size_t copy_content(char *buf, size_t len);
+  Logger *get_logger() const { return m_logger; }
   LogLevel::Level get_level() const { return m_level; }
   std::stringstream &get_ss() { return m_ss; }
 
@@ -110,17 +131,20 @@ private:
   uint32_t m_line = 0;        //行号
   uint32_t m_elapse = 0;     //运行时间
   uint32_t m_thread_id = 0;  //线程id
-  std::string m_thread_name; //线程名称
+  const std::string *m_thread_name; //线程名称
   uint32_t m_fiber_id = 0;   //携程id
   uint64_t m_time = 0;       //时间戳
   std::stringstream m_ss;
 
-  std::shared_ptr<Logger> m_logger;
+  Logger *m_logger;
   LogLevel::Level m_level;
 };
 class LogEventWrap {
 public:
   LogEventWrap(LogEvent::ptr e);
+  // 优先复用当前线程缓存的事件, 只有嵌套打日志或者事件被别人持有时才新分配
+  LogEventWrap(Logger *logger, LogLevel::Level level, const char *file,
+               uint32_t line);
   ~LogEventWrap();
   std::stringstream &get_ss();
   LogEvent::ptr get_event() const { return m_event; }
@@ -128,29 +152,46 @@ public:
 private:
   LogEvent::ptr m_event;
 };
-// 日志格式
+// 日志格式, 构造时把pattern编译成指令列表, 格式化时直接写进调用者的缓冲区
 class LogFormatter {
 public:
   using ptr = std::shared_ptr<LogFormatter>;
   LogFormatter(const std::string &pattern);
+  // 最多写len字节(不写结尾的\0), 返回完整日志的长度, 大于len表示被截断
+  size_t format(char *buf, size_t len, LogEvent::ptr event);
   std::string format(LogEvent::ptr event);
   bool get_error() const { return m_error; }
   const std::string set_pattern() const { return m_pattern; }
 
 public:
-  class FormatItem {
-  public:
-    using ptr = std::shared_ptr<FormatItem>;
-    // FormatItem(const std::string& fmt = "") {};
-    virtual ~FormatItem() {}
-    virtual void format(std::ostream &os,
-                        LogEvent::ptr event) = 0;
+  // 一条格式化指令, 相邻的字面量在编译时合并
+  struct Op {
+    enum Type {
+      LITERAL,
+      MESSAGE,
+      LEVEL,
+      ELAPSE,
+      NAME,
+      THREAD_ID,
+      THREAD_NAME,
+      FIBER_ID,
+      DATETIME,
+      FILENAME,
+      LINE,
+    };
+    Op(Type t, const std::string &a = "") : type(t), arg(a) {}
+    Type type;
+    // 字面量的内容或者时间的strftime格式
+    std::string arg;
   };
   void init();
 
+private:
+  void addLiteral(const std::string &str);
+
 private:
   std::string m_pattern;
-  std::vector<FormatItem::ptr> m_items;
+  std::vector<Op> m_ops;
   bool m_error = false;
 };
 // 日志输出
@@ -163,6 +204,9 @@ public:
   virtual ~LogAppender() {}
 
   virtual void log(LogEvent::ptr event) = 0;
+  // 写入已经格式化好的日志, 由异步输出器的后台线程批量调用, 之后调用一次flush
+  virtual void write(const char *data, size_t len) {}
+  virtual void flush() {}
 
   void set_formatter(LogFormatter::ptr val);
   LogFormatter::ptr get_formatter();
@@ -205,19 +249,79 @@ class StdoutLogAppender : public LogAppender {
 public:
   using ptr = std::shared_ptr<StdoutLogAppender>;
   void log(LogEvent::ptr event) override;
+  void write(const char *data, size_t len) override;
+  void flush() override;
 };
 // 输出到文件的输出器
-class FileLogAppender : public LogAppender {
+// 超过max_size字节或者到了整点/零点时切分: 文件重命名为 filename.时间 后重新打开,
+// 切分, 压缩(compress)和只保留最近max_files个旧文件都在后台线程做, 写日志的线程只发请求
+// 开启切分时需要由shared_ptr持有
+class FileLogAppender : public LogAppender,
+                        public std::enable_shared_from_this<FileLogAppender> {
 public:
   using ptr = std::shared_ptr<FileLogAppender>;
+  enum RotatePeriod { NONE = 0, HOURLY, DAILY };
+  static RotatePeriod PeriodFromString(const std::string &v);
+  static const char *PeriodToString(RotatePeriod period);
+
   void log(LogEvent::ptr event) override;
-  FileLogAppender(const std::string &filename);
-  ~FileLogAppender() {m_filestream.close();}
+  void write(const char *data, size_t len) override;
+  void flush() override;
+  // max_size和max_files为0表示不限制
+  FileLogAppender(const std::string &filename, uint64_t max_size = 0,
+                  RotatePeriod period = NONE, uint32_t max_files = 0,
+                  bool compress = false);
+  ~FileLogAppender();
 
+  // 立即切分, 由后台线程调用, 会做文件io
+  void rotate();
+  // 重新打开文件, 文件被外部移走或删除之后使用
+  bool reopen();
+
+private:
+  // 需要持有m_mutex
+  void writeLocked(const char *data, size_t len);
+  void flushLocked();
+  // 需要持有m_mutex, 超过限制时请求后台切分
+  void checkRotate();
+  uint64_t nextRotateTime(time_t now) const;
+  // 删除超过max_files的旧文件
+  void removeOldFiles();
 
 private:
   std::string m_filename;
-  std::ofstream m_filestream;
+  uint64_t m_maxSize;
+  RotatePeriod m_period;
+  uint32_t m_maxFiles;
+  bool m_compress;
+
+  int m_fd = -1;
+  // write写入的数据, flush时一次写到文件
+  std::string m_buffer;
+  uint64_t m_size = 0;
+  uint64_t m_nextRotate = 0;
+  // 已经请求了切分, 还没有完成
+  bool m_rotating = false;
+};
+// 异步输出器: 调用线程只把格式化好的日志放进本线程的环形缓冲区(单生产者单消费者),
+// 后台线程定期取出, 批量写给被包装的输出器后只flush一次
+// 缓冲区满时按log.async.overflow丢弃(drop)或等待(block), FATAL日志不丢弃并且写完才返回
+class AsyncLogAppender : public LogAppender {
+public:
+  using ptr = std::shared_ptr<AsyncLogAppender>;
+  AsyncLogAppender(LogAppender::ptr appender);
+  // 写出缓冲区中还引用被包装输出器的日志
+  ~AsyncLogAppender();
+  void log(LogEvent::ptr event) override;
+  LogAppender::ptr get_appender() const { return m_appender; }
+
+  // 在当前线程把所有线程缓冲区中的日志写出去
+  static void Flush();
+  // 因为缓冲区满被丢弃的日志条数
+  static uint64_t GetDropped();
+
+private:
+  LogAppender::ptr m_appender;
 };
 
 class LoggerManager {
@@ -0,0 +1,79 @@
+#include "rcu.h"
+#include "macro.h"
+#include "thread.h"
+#include <algorithm>
+#include <sched.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cool {
+
+namespace {
+// 每个线程一个读者槽, epoch为0表示不在读临界区
+struct RcuReader;
+
+static Mutex &GetRegistryMutex() {
+  static Mutex s_mutex;
+  return s_mutex;
+}
+
+static std::vector<RcuReader *> &GetRegistry() {
+  static std::vector<RcuReader *> s_readers;
+  return s_readers;
+}
+
+static std::atomic<uint64_t> s_epoch = {1};
+
+struct RcuReader {
+  RcuReader() {
+    Mutex::Lock lock(GetRegistryMutex());
+    GetRegistry().push_back(this);
+  }
+  ~RcuReader() {
+    Mutex::Lock lock(GetRegistryMutex());
+    auto &readers = GetRegistry();
+    readers.erase(std::find(readers.begin(), readers.end(), this));
+  }
+
+  std::atomic<uint64_t> epoch = {0};
+  uint32_t nest = 0;
+};
+
+static thread_local RcuReader t_reader;
+} // namespace
+
+void Rcu::ReadLockEnter() {
+  RcuReader &r = t_reader;
+  if (r.nest++ == 0) {
+    r.epoch.store(s_epoch.load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+    // 槽的写入要先于之后对受保护指针的读取被写者看到
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+void Rcu::ReadLockLeave() {
+  RcuReader &r = t_reader;
+  if (--r.nest == 0) {
+    r.epoch.store(0, std::memory_order_release);
+  }
+}
+
+void Rcu::Synchronize() {
+  ASSERT2(t_reader.nest == 0, "Rcu::Synchronize inside read lock");
+  // 之后进入的读者记录的epoch不小于target, 一定能看到新指针, 不用等
+  uint64_t target = s_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  Mutex::Lock lock(GetRegistryMutex());
+  for (RcuReader *r : GetRegistry()) {
+    while (true) {
+      uint64_t e = r->epoch.load(std::memory_order_acquire);
+      if (e == 0 || e >= target) {
+        break;
+      }
+      sched_yield();
+    }
+  }
+}
+
+} // namespace cool
@@ -0,0 +1,50 @@
+#ifndef __COOL_RCU_H
+#define __COOL_RCU_H
+
+#include "noncopyable.h"
+#include <atomic>
+
+namespace cool {
+
+// 基于epoch的简单RCU, 用于读多写少的数据
+// 读者进入临界区时只写自己线程的槽, 不加锁也不修改共享的计数
+// 写者替换指针后调用synchronize, 等替换前进入的读者都退出后再释放旧对象
+class Rcu {
+public:
+  // 读临界区, 可以嵌套, 区间内不能让出协程, 也不能调用synchronize
+  class ReadLock : Noncopyable {
+  public:
+    ReadLock() { Rcu::ReadLockEnter(); }
+    ~ReadLock() { Rcu::ReadLockLeave(); }
+  };
+
+  static void ReadLockEnter();
+  static void ReadLockLeave();
+  // 等待调用之前进入的所有读临界区结束
+  static void Synchronize();
+};
+
+// RCU保护的指针, 对象发布之后不再修改, 更新时整体替换
+template <class T> class RcuPtr : Noncopyable {
+public:
+  RcuPtr(T *p = nullptr) : m_ptr(p) {}
+  ~RcuPtr() { delete m_ptr.load(std::memory_order_relaxed); }
+
+  // 需要在Rcu::ReadLock范围内使用返回的指针
+  T *get() const { return m_ptr.load(std::memory_order_acquire); }
+  // 发布新对象, 等旧对象的读者都退出后释放它, 多个写者之间由调用方互斥
+  void reset(T *p) {
+    T *old = m_ptr.exchange(p, std::memory_order_acq_rel);
+    if (old) {
+      Rcu::Synchronize();
+      delete old;
+    }
+  }
+
+private:
+  std::atomic<T *> m_ptr;
+};
+
+} // namespace cool
+
+#endif /* ifndef __COOL_RCU_H */
@@ -14,6 +14,29 @@ namespace cool {
 static cool::Logger::ptr g_logger = LOG_NAME("system");
 static thread_local cool::Scheduler *t_scheduler = nullptr;
 static thread_local cool::Fiber *t_fiber = nullptr;
+// 当前线程在所属调度器中的下标, 非工作线程为-1
+static thread_local int t_worker_index = -1;
+static thread_local uint32_t t_steal_seed = 0;
+static thread_local uint32_t t_schedule_tick = 0;
+// 正在执行的任务被指定到的线程
+static thread_local int t_pinned_thread = -1;
+
+static thread_local bool t_task_free_list_destroyed = false;
+// 空闲的任务节点, 用节点自身的内存串成单链表
+struct TaskFreeList {
+  static const size_t MAX_COUNT = 1024;
+  void *head = nullptr;
+  size_t count = 0;
+  ~TaskFreeList() {
+    t_task_free_list_destroyed = true;
+    while (head) {
+      void *next = *(void **)head;
+      ::operator delete(head);
+      head = next;
+    }
+  }
+};
+static thread_local TaskFreeList t_task_free_list;
 
 Scheduler::Scheduler(size_t thread_size, bool use_caller,
                      const std::string &name)
@@ -39,6 +62,12 @@ Scheduler::Scheduler(size_t thread_size, bool use_caller,
 }
 Scheduler::~Scheduler() {
   ASSERT(m_stop);
+  for (auto &w : m_workers) {
+    FiberAndThread *ft = nullptr;
+    while (w->queue.pop(ft)) {
+      FreeTask(ft);
+    }
+  }
   if (GetThis() == this) {
     t_scheduler = nullptr;
   }
@@ -52,12 +81,22 @@ void Scheduler::start() {
   m_stop = false;
   ASSERT(m_threads.empty());
 
+  if (m_workers.empty()) {
+    size_t n = workerCount();
+    for (size_t i = 0; i < n; ++i) {
+      m_workers.emplace_back(new Worker(i));
+    }
+  }
   m_threads.resize(m_thread_count);
   for (size_t i = 0; i < m_thread_count; ++i) {
     m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this),
                                   m_name + "_" + std::to_string(i)));
     m_thread_ids.push_back(m_threads[i]->id());
   }
+  for (size_t i = 0; i < m_thread_ids.size() && i < m_workers.size(); ++i) {
+    m_worker_index[m_thread_ids[i]] = i;
+  }
+  m_workers_ready = true;
   lock.unlock();
   // if (m_root_fiber) {
   //   m_root_fiber->call();
@@ -123,44 +162,42 @@ void Scheduler::run() {
   if (cool::thread_id() != m_root_thread) {
     t_fiber = Fiber::GetThis().get();
   }
+  {
+    MutexType::Lock lock(m_mutex);
+    auto it = m_worker_index.find(cool::thread_id());
+    t_worker_index = it == m_worker_index.end() ? -1 : it->second;
+  }
+  t_steal_seed = cool::thread_id() | 1;
   Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
   Fiber::ptr cb_fiber;
 
   FiberAndThread ft;
+  // 上一个主动让出的协程, 取出下一个任务之后再放回, 让其他任务先执行;
+  // 否则LIFO的本地队列或者优先的收件箱会立刻再取到它
+  FiberAndThread yielded;
   while (true) {
+    flushPending();
     ft.reset();
     bool tickle_me = false;
-    bool is_active = false;
-    {
-      MutexType::Lock lock(m_mutex);
-      auto it = m_fibers.begin();
-      while (it != m_fibers.end()) {
-        if (it->thread_id != -1 && it->thread_id != cool::thread_id()) {
-          ++it;
-          tickle_me = true;
-          continue;
-        }
-        ASSERT(it->fiber || it->cb);
-        if (it->fiber && it->fiber->state() == Fiber::State::EXEC) {
-          ++it;
-          continue;
-        }
-        ft = *it;
-        m_fibers.erase(it);
-        ++m_active_thread_count;
-        is_active = true;
-        break;
-      }
-    }
+    bool is_active = takeTask(ft, tickle_me);
     if (tickle_me) {
       tickle();
     }
+    if (yielded.fiber) {
+      requeueYielded(yielded);
+      if (!is_active) {
+        continue;
+      }
+    }
     if (ft.fiber && (ft.fiber->state() != Fiber::State::TERM ||
                      ft.fiber->state() != Fiber::State::ERROR)) {
+      t_pinned_thread = ft.thread_id;
       ft.fiber->swapIn();
+      t_pinned_thread = -1;
       --m_active_thread_count;
       if (ft.fiber->state() == Fiber::State::READY) {
-        schedule(ft.fiber);
+        yielded.fiber = ft.fiber;
+        yielded.thread_id = ft.thread_id;
         cb_fiber.reset();
       } else if (ft.fiber->state() != Fiber::State::TERM &&
                  ft.fiber->state() != Fiber::State::ERROR) {
@@ -174,11 +211,15 @@ void Scheduler::run() {
         cb_fiber.reset(new Fiber(ft.cb));
         ft.cb = nullptr;
       }
+      int pinned = ft.thread_id;
       ft.reset();
+      t_pinned_thread = pinned;
       cb_fiber->swapIn();
+      t_pinned_thread = -1;
       --m_active_thread_count;
       if (cb_fiber->state() == Fiber::State::READY) {
-        schedule(cb_fiber);
+        yielded.fiber = cb_fiber;
+        yielded.thread_id = pinned;
         cb_fiber.reset();
       } else if (cb_fiber->state() == Fiber::State::ERROR ||
                  cb_fiber->state() == Fiber::State::TERM) {
@@ -195,12 +236,22 @@ void Scheduler::run() {
       if (idle_fiber->state() == Fiber::State::TERM) {
         LOG_DEBUG(g_logger) << "idle fiber term";
         // TODO(fengyu): 后续完善idle [27-08-21] //
+        t_worker_index = -1;
         break;
         // continue;
       }
+      Worker *w = t_worker_index >= 0 && t_worker_index < (int)m_workers.size()
+                      ? m_workers[t_worker_index].get()
+                      : nullptr;
+      if (w) {
+        w->idle = true;
+      }
       ++m_idle_thread_count;
       idle_fiber->swapIn();
       --m_idle_thread_count;
+      if (w) {
+        w->idle = false;
+      }
       if (idle_fiber->state() != Fiber::State::TERM &&
           idle_fiber->state() != Fiber::State::ERROR) {
         idle_fiber->state(Fiber::State::HOLD);
@@ -209,6 +260,219 @@ void Scheduler::run() {
   }
 }
 
+void *Scheduler::AllocTask() {
+  if (t_task_free_list_destroyed || !t_task_free_list.head) {
+    return ::operator new(sizeof(FiberAndThread));
+  }
+  TaskFreeList &list = t_task_free_list;
+  void *p = list.head;
+  list.head = *(void **)p;
+  --list.count;
+  return p;
+}
+
+void Scheduler::FreeTask(FiberAndThread *ft) {
+  ft->~FiberAndThread();
+  if (t_task_free_list_destroyed ||
+      t_task_free_list.count >= TaskFreeList::MAX_COUNT) {
+    ::operator delete(ft);
+    return;
+  }
+  TaskFreeList &list = t_task_free_list;
+  *(void **)ft = list.head;
+  list.head = ft;
+  ++list.count;
+}
+
+Scheduler::WorkQueue *Scheduler::localQueue() {
+  if (t_scheduler != this || t_worker_index < 0 ||
+      t_worker_index >= (int)m_workers.size()) {
+    return nullptr;
+  }
+  return &m_workers[t_worker_index]->queue;
+}
+
+Scheduler::Worker *Scheduler::getWorker(int thread_id) {
+  if (!m_workers_ready) {
+    return nullptr;
+  }
+  auto it = m_worker_index.find(thread_id);
+  return it == m_worker_index.end() ? nullptr : m_workers[it->second].get();
+}
+
+bool Scheduler::takeInboxTask(FiberAndThread &ft, bool &tickle_me) {
+  if (t_scheduler != this || t_worker_index < 0 ||
+      t_worker_index >= (int)m_workers.size()) {
+    return false;
+  }
+  Worker *w = m_workers[t_worker_index].get();
+  if (w->inbox_size == 0) {
+    return false;
+  }
+  MutexType::Lock lock(w->inbox_mutex);
+  for (auto it = w->inbox.begin(); it != w->inbox.end(); ++it) {
+    if (it->fiber && it->fiber->state() == Fiber::State::EXEC) {
+      // 还在别的线程上执行, 等它让出
+      tickle_me = true;
+      continue;
+    }
+    ft = std::move(*it);
+    w->inbox.erase(it);
+    --w->inbox_size;
+    return true;
+  }
+  return false;
+}
+
+bool Scheduler::takeGlobalTask(FiberAndThread &ft, bool &tickle_me) {
+  MutexType::Lock lock(m_mutex);
+  auto it = m_fibers.begin();
+  while (it != m_fibers.end()) {
+    if (it->thread_id != -1 && it->thread_id != cool::thread_id()) {
+      ++it;
+      tickle_me = true;
+      continue;
+    }
+    ASSERT(it->fiber || it->cb);
+    if (it->fiber && it->fiber->state() == Fiber::State::EXEC) {
+      ++it;
+      continue;
+    }
+    ft = *it;
+    m_fibers.erase(it);
+    --m_global_task_count;
+    // 还有剩余的任务, 接力唤醒其他idle线程
+    if (!m_fibers.empty()) {
+      tickle_me = true;
+    }
+    return true;
+  }
+  return false;
+}
+
+bool Scheduler::takeTask(FiberAndThread &ft, bool &tickle_me) {
+  // 本地队列是LIFO, 定期先看一眼全局队列, 防止全局队列里的任务饿死
+  bool global_first = (++t_schedule_tick % 61) == 0;
+  if (takeInboxTask(ft, tickle_me)) {
+    ++m_active_thread_count;
+    return true;
+  }
+  if (global_first && takeGlobalTask(ft, tickle_me)) {
+    ++m_active_thread_count;
+    return true;
+  }
+  FiberAndThread *p = nullptr;
+  WorkQueue *q = localQueue();
+  if (!q || !q->pop(p)) {
+    if ((!global_first && takeGlobalTask(ft, tickle_me)) || stealTask(ft)) {
+      ++m_active_thread_count;
+      return true;
+    }
+    // 别的线程的收件箱里有任务, 而被唤醒的是自己, 继续唤醒直到它的主人醒来
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+      if ((int)i != t_worker_index && m_workers[i]->inbox_size > 0 &&
+          m_workers[i]->idle) {
+        tickleWorker(i);
+        break;
+      }
+    }
+    return false;
+  }
+  ++m_active_thread_count;
+  ft = std::move(*p);
+  FreeTask(p);
+  if (ft.fiber && ft.fiber->state() == Fiber::State::EXEC) {
+    // 还在别的线程上执行, 放回全局队列等它让出
+    {
+      MutexType::Lock lock(m_mutex);
+      m_fibers.push_back(ft);
+      ++m_global_task_count;
+    }
+    ft.reset();
+    tickle_me = true;
+  }
+  return true;
+}
+
+void Scheduler::requeueYielded(FiberAndThread &ft) {
+  bool queued = ft.thread_id == -1 ? scheduleLocal(ft.fiber)
+                                   : scheduleInbox(ft.fiber, ft.thread_id);
+  if (!queued) {
+    scheduleGlobal(ft.fiber, ft.thread_id);
+  }
+  ft.reset();
+}
+
+bool Scheduler::stealTask(FiberAndThread &ft) {
+  size_t n = m_workers.size();
+  if (n == 0) {
+    return false;
+  }
+  // xorshift 随机选择起始的受害者, 避免所有线程都去抢同一个队列
+  t_steal_seed ^= t_steal_seed << 13;
+  t_steal_seed ^= t_steal_seed >> 17;
+  t_steal_seed ^= t_steal_seed << 5;
+  size_t start = t_steal_seed % n;
+  for (size_t i = 0; i < n; ++i) {
+    size_t idx = (start + i) % n;
+    if ((int)idx == t_worker_index) {
+      continue;
+    }
+    FiberAndThread *p = nullptr;
+    if (!m_workers[idx]->queue.steal(p)) {
+      continue;
+    }
+    if (p->fiber && p->fiber->state() == Fiber::State::EXEC) {
+      MutexType::Lock lock(m_mutex);
+      m_fibers.push_back(std::move(*p));
+      ++m_global_task_count;
+      FreeTask(p);
+      continue;
+    }
+    ft = std::move(*p);
+    FreeTask(p);
+    return true;
+  }
+  return false;
+}
+
+bool Scheduler::hasReadyTask() {
+  if (m_global_task_count > 0) {
+    return true;
+  }
+  if (t_scheduler != this || t_worker_index < 0 ||
+      t_worker_index >= (int)m_workers.size()) {
+    return false;
+  }
+  Worker *w = m_workers[t_worker_index].get();
+  return w->inbox_size > 0 || !w->queue.empty();
+}
+
+int Scheduler::workerIndex() const {
+  if (t_scheduler != this || t_worker_index < 0 ||
+      t_worker_index >= (int)m_workers.size()) {
+    return -1;
+  }
+  return t_worker_index;
+}
+
+int Scheduler::idleWorker() {
+  if (!m_workers_ready || m_idle_thread_count == 0) {
+    return -1;
+  }
+  size_t n = m_workers.size();
+  // 轮流选择起点, 避免连续的唤醒都落到同一个线程上
+  size_t start = m_idle_cursor++ % n;
+  int self = workerIndex();
+  for (size_t i = 0; i < n; ++i) {
+    size_t idx = (start + i) % n;
+    if ((int)idx != self && m_workers[idx]->idle) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
 void Scheduler::tickle() { LOG_DEBUG(g_logger) << "tickle"; }
 void Scheduler::idle() {
   LOG_DEBUG(g_logger) << "idle";
@@ -218,9 +482,19 @@ void Scheduler::idle() {
 }
 bool Scheduler::stopping() {
   MutexType::Lock lock(m_mutex);
-  return m_autostop && m_stop && m_fibers.empty() && m_active_thread_count == 0;
+  if (!(m_autostop && m_stop && m_fibers.empty() &&
+        m_active_thread_count == 0)) {
+    return false;
+  }
+  for (auto &w : m_workers) {
+    if (!w->queue.empty() || w->inbox_size > 0) {
+      return false;
+    }
+  }
+  return true;
 }
 
 Scheduler *Scheduler::GetThis() { return t_scheduler; }
 Fiber *Scheduler::GetMainFiber() { return t_fiber; }
+int Scheduler::GetPinnedThread() { return t_pinned_thread; }
 } // namespace cool
@@ -3,11 +3,13 @@
 
 #include "fiber.h"
 #include "thread.h"
+#include "work_steal_queue.h"
 #include <atomic>
 #include <functional>
 #include <list>
 #include <map>
 #include <memory>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -28,9 +30,22 @@ public:
 
   static Scheduler *GetThis();
   static Fiber *GetMainFiber();
+  // 当前任务被指定到的线程id, 没有指定时为-1
+  // 指定了线程的协程挂起后应该被调度回同一个线程, 唤醒它的地方用这个值调用schedule
+  static int GetPinnedThread();
+
+  // 工作线程数(包括use_caller的线程), 构造之后即可使用
+  size_t workerCount() const {
+    return m_thread_count + (m_root_thread != -1 ? 1 : 0);
+  }
+  // 工作线程id, 下标与workerIndex()一致, start()之后可用
+  const std::vector<int> &threadIds() const { return m_thread_ids; }
 
   template <class FiberOrCb>
   void schedule(FiberOrCb fc, int thread_id = -1) {
+    if (thread_id == -1 ? scheduleLocal(fc) : scheduleInbox(fc, thread_id)) {
+      return;
+    }
     bool need_tickle = false;
     {
       MutexType::Lock lock{m_mutex};
@@ -41,12 +56,30 @@ public:
     }
   }
   template <class InputIterator>
-  void schedule(InputIterator begin, InputIterator end) {
+  void schedule(InputIterator begin, InputIterator end, int thread_id = -1) {
+    if (thread_id != -1 && getWorker(thread_id)) {
+      while (begin != end) {
+        scheduleInbox(&*begin, thread_id);
+        ++begin;
+      }
+      return;
+    }
+    if (localQueue()) {
+      // 整批放入本地队列后只唤醒一次
+      while (begin != end) {
+        scheduleLocal(&*begin, false);
+        ++begin;
+      }
+      if (hasIdleThreads()) {
+        tickle();
+      }
+      return;
+    }
     bool need_tickle = false;
     {
       MutexType::Lock lock(m_mutex);
       while (begin != end) {
-        need_tickle = scheduleNoLock(&*begin, -1) || need_tickle;
+        need_tickle = scheduleNoLock(&*begin, thread_id) || need_tickle;
         ++begin;
       }
     }
@@ -57,12 +90,22 @@ public:
 
 protected:
   virtual void tickle();
+  // 唤醒指定的工作线程, 默认不区分线程
+  virtual void tickleWorker(size_t index) { tickle(); }
+  // 每轮调度循环开始时调用, 子类可以在这里批量提交攒下的请求
+  virtual void flushPending() {}
   void run();
   virtual bool stopping();
   virtual void idle();
   void setThis();
 
   bool hasIdleThreads() { return m_idle_thread_count > 0; };
+  // 当前线程进入idle前调用, 有可以执行的任务时不应该阻塞等待
+  bool hasReadyTask();
+  // 当前线程在本调度器中的下标, 不是本调度器的工作线程时返回-1
+  int workerIndex() const;
+  // 找一个正在idle的其他工作线程, 没有时返回-1
+  int idleWorker();
 
   std::vector<int> m_thread_ids;
   size_t m_thread_count = 0;
@@ -73,12 +116,84 @@ protected:
   int m_root_thread = 0;
 
 private:
+  struct FiberAndThread;
+  using WorkQueue = WorkStealQueue<FiberAndThread *>;
+  struct Worker;
+
+  // 当前线程是本调度器的工作线程时返回它的本地队列, 否则返回nullptr
+  WorkQueue *localQueue();
+  // 根据线程id找到对应的工作线程, start()之前或找不到时返回nullptr
+  Worker *getWorker(int thread_id);
+  // 收件箱 -> 本地队列 -> 全局队列 -> 窃取
+  bool takeTask(FiberAndThread &ft, bool &tickle_me);
+  bool takeInboxTask(FiberAndThread &ft, bool &tickle_me);
+  bool takeGlobalTask(FiberAndThread &ft, bool &tickle_me);
+  bool stealTask(FiberAndThread &ft);
+  // 放回主动让出的协程: 指定了线程的进那个线程的收件箱, 其他的进本地队列
+  void requeueYielded(FiberAndThread &ft);
+  // 本地队列节点的线程本地空闲链表, 避免每次调度都分配内存
+  static void *AllocTask();
+  static void FreeTask(FiberAndThread *ft);
+
+  // 工作线程内提交的任务直接放入本地队列, 无需加锁
+  template <class FiberOrCb>
+  bool scheduleLocal(FiberOrCb fc, bool tickle_idle = true) {
+    WorkQueue *q = localQueue();
+    if (!q) {
+      return false;
+    }
+    FiberAndThread *ft = new (AllocTask()) FiberAndThread(fc, -1);
+    if (!ft->fiber && !ft->cb) {
+      FreeTask(ft);
+      return true;
+    }
+    q->push(ft);
+    if (tickle_idle && hasIdleThreads()) {
+      tickle();
+    }
+    return true;
+  }
+  // 指定线程的任务直接投递到该线程的收件箱, 其他线程不会看到它
+  template <class FiberOrCb> bool scheduleInbox(FiberOrCb fc, int thread_id) {
+    Worker *w = getWorker(thread_id);
+    if (!w) {
+      return false;
+    }
+    {
+      MutexType::Lock lock(w->inbox_mutex);
+      FiberAndThread ft(fc, thread_id);
+      if (!ft.fiber && !ft.cb) {
+        return true;
+      }
+      w->inbox.push_back(std::move(ft));
+      ++w->inbox_size;
+    }
+    // 目标线程没有在idle, 它回到调度循环时自然会看到收件箱
+    if (w->idle) {
+      tickleWorker(w->index);
+    }
+    return true;
+  }
+  // 不是本调度器的工作线程时的退路, 指定了线程的任务只能由那个线程取走,
+  // 不需要唤醒别人
+  template <class FiberOrCb>
+  void scheduleGlobal(FiberOrCb fc, int thread_id = -1) {
+    bool need_tickle = false;
+    {
+      MutexType::Lock lock{m_mutex};
+      need_tickle = scheduleNoLock(fc, thread_id);
+    }
+    if (need_tickle && thread_id == -1) {
+      tickle();
+    }
+  }
   template <class FiberOrCb>
   bool scheduleNoLock(FiberOrCb fc, int thread_id) {
     bool need_tickle = m_fibers.empty();
     FiberAndThread ft(fc, thread_id);
     if (ft.fiber || ft.cb) {
       m_fibers.push_back(ft);
+      ++m_global_task_count;
     }
     return need_tickle;
   }
@@ -99,12 +214,29 @@ private:
       thread_id = -1;
     }
   };
+  struct Worker {
+    Worker(size_t i) : index(i) {}
+    size_t index;
+    // 本线程产生的任务, 其他线程可以窃取
+    WorkQueue queue;
+    // 指定到本线程执行的任务, 只有本线程会取
+    MutexType inbox_mutex;
+    std::list<FiberAndThread> inbox;
+    std::atomic<size_t> inbox_size = {0};
+    std::atomic<bool> idle = {false};
+  };
   MutexType m_mutex;
   std::vector<Thread::ptr> m_threads;
   std::string m_name;
   std::list<FiberAndThread> m_fibers;
+  std::atomic<size_t> m_global_task_count = {0};
+  // 每个工作线程一个, 下标与m_thread_ids一致
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  // 线程id -> m_workers下标, start()之后只读
+  std::map<int, size_t> m_worker_index;
+  std::atomic<bool> m_workers_ready = {false};
+  std::atomic<uint32_t> m_idle_cursor = {0};
   Fiber::ptr m_root_fiber;
-  std::map<int, std::list<FiberAndThread>> m_thrFibers;
 };
 
 } // namespace cool
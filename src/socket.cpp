@@ -103,9 +103,20 @@ bool Socket::setOption(int level, int option, const void *val, socklen_t len) {
   return true;
 }
 
+bool Socket::setReusePort(bool v) {
+  if (!isValid()) {
+    newSock();
+    if (UNLIKEY(!isValid())) {
+      return false;
+    }
+  }
+  int val = v ? 1 : 0;
+  return setOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
 Socket::ptr Socket::accept() {
   Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
-  int newsock = ::accept(m_sock, nullptr, nullptr);
+  int newsock = ::accept4(m_sock, nullptr, nullptr, SOCK_CLOEXEC);
   if (newsock == -1) {
     LOG_ERROR(g_logger) << "accept, sockfd: " << m_sock
                         << ", errno: " << strerror(errno);
@@ -117,14 +128,45 @@ Socket::ptr Socket::accept() {
   return nullptr;
 }
 
+size_t Socket::accept(std::vector<Socket::ptr> &socks, size_t max_count) {
+  // 第一个连接走hook, 没有连接时挂起当前协程
+  int newsock = ::accept4(m_sock, nullptr, nullptr, SOCK_CLOEXEC);
+  if (newsock == -1) {
+    LOG_ERROR(g_logger) << "accept, sockfd: " << m_sock
+                        << ", errno: " << strerror(errno);
+    return 0;
+  }
+  // 监听socket是非阻塞的才能继续取, 取空时返回EAGAIN
+  FdCtx::ptr ctx = FdMgr::instance()->get(m_sock);
+  bool drain = ctx && ctx->getSysNonBlock();
+  size_t count = 0;
+  while (newsock != -1) {
+    Socket::ptr sock(new Socket(m_family, m_type, m_protocol));
+    if (sock->init(newsock)) {
+      socks.push_back(sock);
+      ++count;
+    } else {
+      ::close(newsock);
+    }
+    if (!drain || count >= max_count) {
+      break;
+    }
+    newsock =
+        accept4_f(m_sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (newsock != -1) {
+      FdMgr::instance()->addSocket(newsock);
+    }
+  }
+  return count;
+}
+
 bool Socket::init(int sock) {
   FdCtx::ptr ctx = FdMgr::instance()->get(sock);
   if (ctx && ctx->isSocket() && !ctx->isClose()) {
     m_sock = sock;
     m_isConnected = true;
+    // 地址在第一次使用时再获取
     initSock();
-    localAddress();
-    remoteAddress();
     return true;
   }
   return false;
@@ -205,7 +247,7 @@ bool Socket::close() {
   if (!m_isConnected && m_sock == -1) {
     return true;
   }
-  m_isConnected = true;
+  m_isConnected = false;
   if (m_sock != -1) {
     ::close(m_sock);
     m_sock = -1;
@@ -229,6 +271,12 @@ int Socket::send(const iovec *buf, size_t len, int flags) {
   }
   return -1;
 }
+int Socket::sendFile(int fd, off_t *offset, size_t len) {
+  if (isConnected()) {
+    return ::sendfile(m_sock, fd, offset, len);
+  }
+  return -1;
+}
 // TODO(fengyu): you danmu shuo chang yong yu UDP [09-09-21] //
 int Socket::sendTo(const void *buf, size_t len, const Address::ptr to,
                    int flags) {
@@ -389,7 +437,10 @@ bool Socket::cancelAll() { return IOManager::GetThis()->cancekAll(m_sock); }
 
 void Socket::initSock() {
   int val = 1;
-  setOption(SOL_SOCKET, SO_REUSEADDR, val);
+  // 已连接的socket不会再bind, 不需要SO_REUSEADDR
+  if (!m_isConnected) {
+    setOption(SOL_SOCKET, SO_REUSEADDR, val);
+  }
   if (m_type == SOCK_STREAM) {
     setOption(IPPROTO_TCP, TCP_NODELAY, val);
   }
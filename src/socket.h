@@ -7,6 +7,7 @@
 #include <memory>
 #include <ostream>
 #include <sys/socket.h>
+#include <vector>
 
 namespace cool {
 
@@ -58,7 +59,12 @@ public:
     return setOption(level, option, &val, sizeof(T));
   }
 
+  // 需要在bind之前调用, 多个设置了SO_REUSEPORT的socket可以监听同一个端口
+  bool setReusePort(bool v);
+
   Socket::ptr accept();
+  // 一次唤醒取出积压的所有连接(最多max_count个), 返回取到的个数, 0表示出错
+  size_t accept(std::vector<Socket::ptr> &socks, size_t max_count = 64);
 
   bool init(int sock);
   bool bind(const Address::ptr addr);
@@ -71,6 +77,8 @@ public:
   int sendTo(const void *buf, size_t len, const Address::ptr to, int flags = 0);
   int sendTo(const iovec *buf, size_t len, const Address::ptr to,
              int flags = 0);
+  // 用sendfile把文件fd从offset开始的内容发出去, offset会前移
+  int sendFile(int fd, off_t *offset, size_t len);
 
   int recv(void *buf, size_t len, int flags = 0);
   int recv(iovec *buf, size_t len, int flags = 0);
@@ -1,5 +1,7 @@
 #include "socket_stream.h"
 // #include <bits/types/struct_iovec.h>
+#include <algorithm>
+#include <climits>
 #include <vector>
 
 namespace cool {
@@ -55,6 +57,52 @@ int SocketStream::write(ByteArray::ptr ba, size_t length) {
   return rt;
 }
 
+int64_t SocketStream::writeFixSize(iovec *iovs, size_t count, int flags) {
+  if (!isConnected()) {
+    return -1;
+  }
+  int64_t total = 0;
+  while (count > 0) {
+    // 超过IOV_MAX段时sendmsg返回EMSGSIZE, 分批发送, 后面还有时带上MSG_MORE
+    size_t batch = std::min(count, (size_t)IOV_MAX);
+    int rt = m_socket->send(iovs, batch,
+                            batch < count ? (flags | MSG_MORE) : flags);
+    if (rt <= 0) {
+      return rt;
+    }
+    total += rt;
+    size_t n = rt;
+    while (count > 0 && n >= iovs->iov_len) {
+      n -= iovs->iov_len;
+      ++iovs;
+      --count;
+    }
+    if (count > 0) {
+      iovs->iov_base = (char *)iovs->iov_base + n;
+      iovs->iov_len -= n;
+    }
+  }
+  return total;
+}
+
+int64_t SocketStream::sendFileFixSize(int fd, uint64_t offset, uint64_t length) {
+  if (!isConnected()) {
+    return -1;
+  }
+  off_t off = offset;
+  uint64_t left = length;
+  while (left > 0) {
+    // 返回值是int, 每次最多发1G
+    int rt = m_socket->sendFile(fd, &off, std::min<uint64_t>(left, 1 << 30));
+    if (rt <= 0) {
+      // 文件比声明的长度短时返回0
+      return rt;
+    }
+    left -= rt;
+  }
+  return length;
+}
+
 void SocketStream::close() {
   if (m_socket) {
     m_socket->close();
@@ -18,6 +18,13 @@ public:
   virtual int write(ByteArray::ptr ba, size_t length) override;
   virtual void close() override;
 
+  using Stream::writeFixSize;
+  // 用sendmsg发出多段数据, 每次最多IOV_MAX段, 没写完时继续写剩下的,
+  // iovs会被修改. 返回写出的总字节数
+  int64_t writeFixSize(iovec *iovs, size_t count, int flags = 0);
+  // 用sendfile发送文件fd中[offset, offset + length)的内容, 返回length
+  int64_t sendFileFixSize(int fd, uint64_t offset, uint64_t length);
+
   Socket::ptr socket() const {return m_socket;}
   bool isConnected() const;
 protected:
@@ -0,0 +1,178 @@
+#include "stack_allocator.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace cool {
+static Logger::ptr g_logger = LOG_NAME("system");
+
+static ConfigVar<std::string>::ptr g_fiber_stack_allocator =
+    Config::lookup<std::string>("fiber.stack_allocator", "mmap",
+                                "fiber stack allocator, malloc or mmap");
+static ConfigVar<uint32_t>::ptr g_stack_pool_max_count =
+    Config::lookup<uint32_t>("fiber.stack_pool.max_count", 256,
+                             "max cached fiber stacks per thread");
+static ConfigVar<bool>::ptr g_stack_pool_trim = Config::lookup<bool>(
+    "fiber.stack_pool.trim", true, "madvise cached fiber stacks");
+static ConfigVar<uint32_t>::ptr g_stack_pool_resident_size =
+    Config::lookup<uint32_t>("fiber.stack_pool.resident_size", 16 * 1024,
+                             "bytes kept resident at the top of cached stacks");
+
+static MallocStackAllocator s_malloc_allocator;
+static MmapStackAllocator s_mmap_allocator;
+
+static std::atomic<StackAllocator *> s_default_allocator{&s_mmap_allocator};
+// 配置回调和其他线程并发读写, 各自独立, relaxed即可
+static std::atomic<uint32_t> s_pool_max_count{256};
+static std::atomic<bool> s_pool_trim{true};
+static std::atomic<uint32_t> s_pool_resident_size{16 * 1024};
+
+static StackAllocator *select_allocator(const std::string &name) {
+  if (name == "malloc") {
+    return &s_malloc_allocator;
+  }
+  if (name != "mmap") {
+    LOG_ERROR(g_logger) << "unknown fiber.stack_allocator=" << name
+                        << ", use mmap";
+  }
+  return &s_mmap_allocator;
+}
+
+struct _StackAllocatorIniter {
+  _StackAllocatorIniter() {
+    s_default_allocator = select_allocator(g_fiber_stack_allocator->get_value());
+    g_fiber_stack_allocator->add_listener(
+        [](const std::string &old_val, const std::string &new_val) {
+          s_default_allocator = select_allocator(new_val);
+        });
+    s_pool_max_count.store(g_stack_pool_max_count->get_value(),
+                           std::memory_order_relaxed);
+    g_stack_pool_max_count->add_listener(
+        [](const uint32_t &old_val, const uint32_t &new_val) {
+          s_pool_max_count.store(new_val, std::memory_order_relaxed);
+        });
+    s_pool_trim.store(g_stack_pool_trim->get_value(),
+                      std::memory_order_relaxed);
+    g_stack_pool_trim->add_listener(
+        [](const bool &old_val, const bool &new_val) {
+          s_pool_trim.store(new_val, std::memory_order_relaxed);
+        });
+    s_pool_resident_size.store(g_stack_pool_resident_size->get_value(),
+                               std::memory_order_relaxed);
+    g_stack_pool_resident_size->add_listener(
+        [](const uint32_t &old_val, const uint32_t &new_val) {
+          s_pool_resident_size.store(new_val, std::memory_order_relaxed);
+        });
+  }
+};
+static _StackAllocatorIniter s_stack_allocator_initer;
+
+StackAllocator *StackAllocator::GetDefault() { return s_default_allocator; }
+
+void *MallocStackAllocator::alloc(size_t size) { return malloc(size); }
+void MallocStackAllocator::dealloc(void *vp, size_t size) { free(vp); }
+
+static size_t page_size() {
+  static size_t s_page_size = sysconf(_SC_PAGESIZE);
+  return s_page_size;
+}
+
+static size_t round_to_page(size_t size) {
+  size_t page = page_size();
+  return (size + page - 1) / page * page;
+}
+
+static void *map_stack(size_t size) {
+  size_t page = page_size();
+  void *base = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    LOG_ERROR(g_logger) << "mmap stack size=" << size << " errno=" << errno;
+    return nullptr;
+  }
+  if (mprotect(base, page, PROT_NONE) != 0) {
+    LOG_ERROR(g_logger) << "mprotect guard page errno=" << errno;
+  }
+  return (char *)base + page;
+}
+
+static void unmap_stack(void *vp, size_t size) {
+  size_t page = page_size();
+  munmap((char *)vp - page, size + page);
+}
+
+static thread_local bool t_stack_cache_destroyed = false;
+
+// 线程本地的空闲栈, 线程退出时全部归还
+class StackCache {
+public:
+  ~StackCache() {
+    t_stack_cache_destroyed = true;
+    for (auto &i : m_free) {
+      for (auto &vp : i.second) {
+        unmap_stack(vp, i.first);
+      }
+    }
+  }
+  void *get(size_t size) {
+    auto it = m_free.find(size);
+    if (it == m_free.end() || it->second.empty()) {
+      return nullptr;
+    }
+    void *vp = it->second.back();
+    it->second.pop_back();
+    --m_count;
+    return vp;
+  }
+  bool put(void *vp, size_t size) {
+    if (m_count >= s_pool_max_count.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    m_free[size].push_back(vp);
+    ++m_count;
+    return true;
+  }
+  size_t count() const { return m_count; }
+
+private:
+  std::unordered_map<size_t, std::vector<void *>> m_free;
+  size_t m_count = 0;
+};
+
+static thread_local StackCache t_stack_cache;
+
+void *MmapStackAllocator::alloc(size_t size) {
+  size = round_to_page(size);
+  void *vp = t_stack_cache_destroyed ? nullptr : t_stack_cache.get(size);
+  return vp ? vp : map_stack(size);
+}
+
+void MmapStackAllocator::dealloc(void *vp, size_t size) {
+  if (!vp) {
+    return;
+  }
+  size = round_to_page(size);
+  if (t_stack_cache_destroyed || !t_stack_cache.put(vp, size)) {
+    unmap_stack(vp, size);
+    return;
+  }
+  if (s_pool_trim.load(std::memory_order_relaxed)) {
+    // 栈从高地址向低地址增长, 保留栈顶resident_size常驻, 其余物理页归还
+    size_t resident = round_to_page(
+        s_pool_resident_size.load(std::memory_order_relaxed));
+    if (resident < size) {
+      madvise(vp, size - resident, MADV_DONTNEED);
+    }
+  }
+}
+
+size_t MmapStackAllocator::CachedCount() {
+  return t_stack_cache_destroyed ? 0 : t_stack_cache.count();
+}
+
+} // namespace cool
@@ -0,0 +1,40 @@
+#ifndef __COOL_STACK_ALLOCATOR_H
+#define __COOL_STACK_ALLOCATOR_H
+
+#include <cstddef>
+
+namespace cool {
+
+// 协程栈分配器
+class StackAllocator {
+public:
+  virtual ~StackAllocator() {}
+  virtual void *alloc(size_t size) = 0;
+  virtual void dealloc(void *vp, size_t size) = 0;
+
+  // 由配置fiber.stack_allocator决定(malloc/mmap), 返回的对象永不释放
+  static StackAllocator *GetDefault();
+};
+
+// 直接malloc/free
+class MallocStackAllocator : public StackAllocator {
+public:
+  void *alloc(size_t size) override;
+  void dealloc(void *vp, size_t size) override;
+};
+
+// mmap分配, 栈底有一页PROT_NONE保护页, 溢出时直接SIGSEGV而不是踩坏堆
+// 释放的栈放入线程本地的空闲链表复用, 放回时可以用MADV_DONTNEED归还物理页,
+// 只保留栈顶常用的一部分常驻
+class MmapStackAllocator : public StackAllocator {
+public:
+  void *alloc(size_t size) override;
+  void dealloc(void *vp, size_t size) override;
+
+  // 当前线程缓存的空闲栈数量
+  static size_t CachedCount();
+};
+
+} // namespace cool
+
+#endif /* ifndef __COOL_STACK_ALLOCATOR_H */
@@ -3,6 +3,7 @@
 #include "src/iomanager.h"
 #include "src/log.h"
 #include "src/socket.h"
+#include "src/util.h"
 #include "tcp_server.h"
 #include <cerrno>
 #include <cstdint>
@@ -15,10 +16,13 @@ static cool::Logger::ptr g_logger = LOG_NAME("system");
 
 cool_config(g_tcp_server_read_timeout, "tcp_server.read_timeout",
             (uint64_t)60 * 1000 * 2, "tcp server read timeout");
+cool_config(g_tcp_server_reuseport, "tcp_server.reuseport", false,
+            "one SO_REUSEPORT listener per worker thread");
 
 TcpServer::TcpServer(cool::IOManager *worker, cool::IOManager *accept_worker)
     : m_recv_timeout(g_tcp_server_read_timeout->get_value()), m_name("cool v1.0.0"), m_worker(worker),
-      m_accept_worker(accept_worker), m_is_stop(false), m_is_start(false) {}
+      m_accept_worker(accept_worker), m_is_stop(false), m_is_start(false),
+      m_reuseport(g_tcp_server_reuseport->get_value()) {}
 
 bool TcpServer::bind(cool::Address::ptr addr) {
   std::vector<Address::ptr> addrs;
@@ -36,21 +40,33 @@ TcpServer::~TcpServer() {
 
 bool TcpServer::bind(const std::vector<Address::ptr> &addrs,
                      std::vector<Address::ptr> &fails) {
+  m_listen_per_addr = m_reuseport ? m_worker->workerCount() : 1;
   for (auto &addr : addrs) {
-    Socket::ptr sock = Socket::CreateTCP(addr);
-    if (!sock->bind(addr)) {
-      LOG_ERROR(g_logger) << "bind fail, errstr = " << strerror(errno)
-                          << " addr is " << addr->to_string();
-      fails.push_back(addr);
-      continue;
-    }
-    if (!sock->listen()) {
-      LOG_ERROR(g_logger) << "listen fail strerr = " << strerror(errno)
-                          << " addr is " << addr->to_string();
-      fails.push_back(addr);
-      continue;
+    Address::ptr bind_addr = addr;
+    for (size_t i = 0; i < m_listen_per_addr; ++i) {
+      Socket::ptr sock = Socket::CreateTCP(bind_addr);
+      if (m_reuseport && !sock->setReusePort(true)) {
+        LOG_ERROR(g_logger) << "set SO_REUSEPORT fail, errstr = "
+                            << strerror(errno);
+        fails.push_back(addr);
+        break;
+      }
+      if (!sock->bind(bind_addr)) {
+        LOG_ERROR(g_logger) << "bind fail, errstr = " << strerror(errno)
+                            << " addr is " << addr->to_string();
+        fails.push_back(addr);
+        break;
+      }
+      if (!sock->listen()) {
+        LOG_ERROR(g_logger) << "listen fail strerr = " << strerror(errno)
+                            << " addr is " << addr->to_string();
+        fails.push_back(addr);
+        break;
+      }
+      // 端口为0时后续的监听socket要绑定到第一个分配到的端口上
+      bind_addr = sock->localAddress();
+      m_socks.push_back(sock);
     }
-    m_socks.push_back(sock);
   }
   if (!fails.empty()) {
     m_socks.clear();
@@ -63,15 +79,24 @@ bool TcpServer::bind(const std::vector<Address::ptr> &addrs,
 }
 
 void TcpServer::start_accept(Socket::ptr sock) {
+  std::vector<Socket::ptr> clients;
+  std::vector<std::function<void()>> cbs;
   while (!m_is_stop) {
-    Socket::ptr client = sock->accept();
-    if (client) {
+    // 一次唤醒取出积压的所有连接, 整批交给worker
+    clients.clear();
+    if (!sock->accept(clients)) {
+      LOG_ERROR(g_logger) << "accept error, strerr is " << strerror(errno);
+      continue;
+    }
+    cbs.clear();
+    for (auto &client : clients) {
       client->recvTimeout(m_recv_timeout);
-      m_worker->schedule(
+      cbs.push_back(
           std::bind(&TcpServer::handle_client, shared_from_this(), client));
-    } else {
-      LOG_ERROR(g_logger) << "accept error, strerr is " << strerror(errno);
     }
+    // reuseport模式下连接留在accept它的线程上
+    m_worker->schedule(cbs.begin(), cbs.end(),
+                       m_reuseport ? cool::thread_id() : -1);
   }
 }
 
@@ -84,6 +109,16 @@ bool TcpServer::start() {
   //   return true;
   // }
   // m_is_stop = false;
+  if (m_reuseport) {
+    const std::vector<int> &thread_ids = m_worker->threadIds();
+    for (size_t i = 0; i < m_socks.size(); ++i) {
+      size_t idx = i % m_listen_per_addr;
+      m_worker->schedule(
+          std::bind(&TcpServer::start_accept, shared_from_this(), m_socks[i]),
+          idx < thread_ids.size() ? thread_ids[idx] : -1);
+    }
+    return true;
+  }
   for (auto &sock : m_socks) {
     m_accept_worker->schedule(
         std::bind(&TcpServer::start_accept, shared_from_this(), sock));
@@ -97,7 +132,8 @@ void TcpServer::stop() {
   }
   m_is_stop = true;
   auto self = shared_from_this();
-  m_accept_worker->schedule([this, self]() {
+  IOManager *accept_worker = m_reuseport ? m_worker : m_accept_worker;
+  accept_worker->schedule([this, self]() {
     for (auto &sock : m_socks) {
       sock->cancelAll();
       sock->close();
@@ -27,6 +27,12 @@ public:
 
   bool is_stop() const { return m_is_stop; }
 
+  // SO_REUSEPORT模式: 每个地址为worker的每个线程各开一个监听socket,
+  // 由内核分配连接, 连接在accept它的线程上处理, 此时不使用accept_worker
+  // 需要在bind之前设置
+  void setReusePort(bool v) { m_reuseport = v; }
+  bool isReusePort() const { return m_reuseport; }
+
 protected:
   virtual void handle_client(Socket::ptr client);
   virtual void start_accept(Socket::ptr sock);
@@ -41,6 +47,9 @@ private:
   IOManager *m_accept_worker;
   bool m_is_stop;
   bool m_is_start;
+  bool m_reuseport;
+  // reuseport模式下每个地址的监听socket数, 第i个绑定在worker的第i个线程上
+  size_t m_listen_per_addr = 1;
 };
 
 } /* namespace cool */
@@ -1,60 +1,39 @@
 #include "timer.h"
 #include "src/util.h"
+#include <algorithm>
+#include <atomic>
 #include <memory>
 
 namespace cool {
 
-bool Timer::Comparator::operator()(const Timer::ptr &lhs,
-                                   const Timer::ptr &rhs) const {
-  if (!lhs && !rhs) {
-    return false;
-  }
-  if (!lhs) {
-    return true;
-  }
-  if (!rhs) {
-    return false;
-  }
-  if (lhs->m_next < rhs->m_next) {
-    return true;
-  }
-  if (rhs->m_next < lhs->m_next) {
-    return false;
-  }
-  return lhs.get() < rhs.get();
-}
-
 Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring,
              TimerManager *manager)
     : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager) {
   m_next = cool::GetCurrentMS() + m_ms;
 }
 
-Timer::Timer(uint64_t next) : m_next(next) {}
-
 bool Timer::cancel() {
-  TimerManager::RWMutexType::WriteLock lock{m_manager->m_mutex};
-  if (m_cb) {
+  Timer::ptr self;
+  TimerManager::MutexType::Lock lock{m_manager->m_mutex};
+  if (m_level < 0) {
+    return false;
+  }
+  m_manager->unlink(this);
+  if (!m_reusable) {
     m_cb = nullptr;
-    auto it = m_manager->m_timers.find(shared_from_this());
-    m_manager->m_timers.erase(it);
-    return true;
   }
-  return false;
+  self.swap(m_self);
+  return true;
 }
 
 bool Timer::refresh() {
-  TimerManager::RWMutexType::WriteLock lock{m_manager->m_mutex};
-  if (!m_cb) {
+  TimerManager::MutexType::Lock lock{m_manager->m_mutex};
+  if (m_level < 0) {
     return false;
   }
-  auto it = m_manager->m_timers.find(shared_from_this());
-  if (it == m_manager->m_timers.end()) {
-    return false;
-  }
-  m_manager->m_timers.erase(it);
+  m_manager->unlink(this);
   m_next = cool::GetCurrentMS() + m_ms;
-  m_manager->m_timers.insert(shared_from_this());
+  m_manager->link(this);
   return true;
 }
 
@@ -62,15 +41,11 @@ bool Timer::reset(uint64_t ms, bool from_now) {
   if (ms == m_ms && !from_now) {
     return true;
   }
-  TimerManager::RWMutexType::WriteLock lock{m_manager->m_mutex};
-  if (!m_cb) {
+  TimerManager::MutexType::Lock lock{m_manager->m_mutex};
+  if (m_level < 0) {
     return false;
   }
-  auto it = m_manager->m_timers.find(shared_from_this());
-  if (it == m_manager->m_timers.end()) {
-    return false;
-  }
-  m_manager->m_timers.erase(it);
+  m_manager->unlink(this);
   uint64_t start = 0;
   if (from_now) {
     start = cool::GetCurrentMS();
@@ -83,20 +58,62 @@ bool Timer::reset(uint64_t ms, bool from_now) {
   return true;
 }
 
-TimerManager::TimerManager() { m_previous_time = cool::GetCurrentMS(); }
+bool Timer::start(uint64_t ms) {
+  TimerManager::MutexType::Lock lock{m_manager->m_mutex};
+  if (m_level >= 0 || !m_cb) {
+    return false;
+  }
+  m_ms = ms;
+  m_next = cool::GetCurrentMS() + m_ms;
+  m_manager->addTimer(shared_from_this(), lock);
+  return true;
+}
 
-TimerManager::~TimerManager() {}
+static std::atomic<uint64_t> s_timer_manager_id{0};
+
+TimerManager::TimerManager() : m_id(++s_timer_manager_id) {
+  m_previous_time = cool::GetCurrentMS();
+  m_current = m_previous_time;
+  m_wheel.resize(LEVELS);
+  m_bitmap.resize(LEVELS);
+  m_wheel[0].resize(ROOT_SIZE, nullptr);
+  m_bitmap[0].resize(ROOT_SIZE / 64, 0);
+  for (int i = 1; i < LEVELS; ++i) {
+    m_wheel[i].resize(LEVEL_SIZE, nullptr);
+    m_bitmap[i].resize(LEVEL_SIZE / 64, 0);
+  }
+}
+
+TimerManager::~TimerManager() {
+  std::vector<Timer::ptr> timers;
+  MutexType::Lock lock{m_mutex};
+  for (auto &level : m_wheel) {
+    for (auto &head : level) {
+      while (head) {
+        Timer *timer = head;
+        unlink(timer);
+        timers.push_back(std::move(timer->m_self));
+      }
+    }
+  }
+}
 
 Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb,
                                   bool recurring) {
   Timer::ptr timer(new Timer(ms, cb, recurring, this));
-  RWMutexType::WriteLock lock{m_mutex};
+  MutexType::Lock lock{m_mutex};
   addTimer(timer, lock);
   return timer;
 }
+Timer::ptr TimerManager::createTimer(std::function<void()> cb) {
+  Timer::ptr timer(new Timer(0, cb, false, this));
+  timer->m_reusable = true;
+  return timer;
+}
+
 bool TimerManager::hasTimer() {
-  RWMutexType::ReadLock lock{m_mutex};
-  return !m_timers.empty();
+  MutexType::Lock lock{m_mutex};
+  return m_count > 0;
 }
 
 static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
@@ -114,22 +131,39 @@ Timer::ptr TimerManager::addConditionTimer(uint64_t ms,
 }
 
 uint64_t TimerManager::getNextTimer() {
-  RWMutexType::ReadLock lock{m_mutex};
+  MutexType::Lock lock{m_mutex};
   m_tickled = false;
-  if (m_timers.empty()) {
+  if (m_count == 0) {
+    m_planned_wakeup = ~0ull;
     return ~0ull;
   }
-  const Timer::ptr &next = *m_timers.begin();
-  uint64_t now_ms = cool::GetCurrentMS();
-  if (now_ms >= next->m_next) {
-    return 0;
-  } else {
-    return next->m_next - now_ms;
+  uint64_t next = ~0ull;
+  int dist = findSlot(0, m_current & (ROOT_SIZE - 1));
+  if (dist >= 0) {
+    next = m_current + dist;
+  }
+  // 高层的槽只能得到下放的时间, 作为下界
+  for (int level = 1; level < LEVELS; ++level) {
+    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    uint64_t base = (m_current + (1ull << shift) - 1) >> shift;
+    dist = findSlot(level, base & (LEVEL_SIZE - 1));
+    if (dist >= 0) {
+      next = std::min(next, (base + dist) << shift);
+    }
   }
+  uint64_t now_ms = cool::GetCurrentMS();
+  m_planned_wakeup = std::max(next, now_ms);
+  return next > now_ms ? next - now_ms : 0;
 }
-void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock &lock) {
-  auto it = m_timers.insert(val).first;
-  bool at_front = (it == m_timers.begin() && !m_tickled);
+
+void TimerManager::addTimer(Timer::ptr val, MutexType::Lock &lock) {
+  if (m_count == 0) {
+    m_current = cool::GetCurrentMS();
+  }
+  Timer *timer = val.get();
+  timer->m_self = std::move(val);
+  link(timer);
+  bool at_front = !m_tickled && timer->m_next < m_planned_wakeup;
   if (at_front) {
     m_tickled = true;
   }
@@ -141,38 +175,163 @@ void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock &lock) {
 
 void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs) {
   uint64_t now_ms = cool::GetCurrentMS();
-  std::vector<Timer::ptr> expireds;
-  {
-    RWMutexType::ReadLock lock{m_mutex};
-    if (m_timers.empty()) {
-      return;
-    }
-  }
-  RWMutexType::WriteLock lock{m_mutex};
-
-  bool rollover = detectClockRollover(now_ms);
-  if (!rollover && (*m_timers.begin())->m_next > now_ms) {
+  std::vector<Timer *> expireds;
+  std::vector<Timer::ptr> finished;
+  MutexType::Lock lock{m_mutex};
+  if (m_count == 0) {
     return;
   }
 
-  Timer::ptr now_timer(new Timer(now_ms));
-  auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-  while (it != m_timers.end() && (*it)->m_next == now_ms) {
-    ++it;
+  if (detectClockRollover(now_ms)) {
+    // 时钟回拨, 全部视为到期
+    for (auto &level : m_wheel) {
+      for (auto &head : level) {
+        while (head) {
+          expireds.push_back(head);
+          unlink(head);
+        }
+      }
+    }
+    m_current = now_ms;
+  } else if (now_ms >= m_current) {
+    advance(now_ms, expireds);
   }
-  expireds.insert(expireds.begin(), m_timers.begin(), it);
-  m_timers.erase(m_timers.begin(), it);
   cbs.reserve(expireds.size());
 
-  for (auto &timer : expireds) {
+  for (auto timer : expireds) {
     cbs.push_back(timer->m_cb);
     if (timer->m_recurring) {
       timer->m_next = now_ms + timer->m_ms;
-      m_timers.insert(timer);
+      link(timer);
     } else {
-      timer->m_cb = nullptr;
+      if (!timer->m_reusable) {
+        timer->m_cb = nullptr;
+      }
+      finished.push_back(std::move(timer->m_self));
+    }
+  }
+}
+
+void TimerManager::link(Timer *timer) {
+  uint64_t expires = std::max(timer->m_next, m_current);
+  uint64_t delta = expires - m_current;
+  int level = 0;
+  int slot = 0;
+  if (delta < (uint64_t)ROOT_SIZE) {
+    slot = expires & (ROOT_SIZE - 1);
+  } else {
+    level = 1;
+    int shift = ROOT_BITS;
+    while (level < LEVELS - 1 && delta >= (1ull << (shift + LEVEL_BITS))) {
+      ++level;
+      shift += LEVEL_BITS;
+    }
+    uint64_t max_delta = (1ull << (shift + LEVEL_BITS)) - 1;
+    if (delta > max_delta) {
+      // 超出时间轮范围, 先放在最高层最远的槽, 下放时会重新计算
+      expires = m_current + max_delta;
+    }
+    slot = (expires >> shift) & (LEVEL_SIZE - 1);
+  }
+  Timer *&head = m_wheel[level][slot];
+  timer->m_wheel_prev = nullptr;
+  timer->m_wheel_next = head;
+  if (head) {
+    head->m_wheel_prev = timer;
+  }
+  head = timer;
+  timer->m_level = level;
+  timer->m_slot = slot;
+  m_bitmap[level][slot / 64] |= 1ull << (slot % 64);
+  ++m_count;
+}
+
+void TimerManager::unlink(Timer *timer) {
+  int level = timer->m_level;
+  int slot = timer->m_slot;
+  if (timer->m_wheel_prev) {
+    timer->m_wheel_prev->m_wheel_next = timer->m_wheel_next;
+  } else {
+    m_wheel[level][slot] = timer->m_wheel_next;
+  }
+  if (timer->m_wheel_next) {
+    timer->m_wheel_next->m_wheel_prev = timer->m_wheel_prev;
+  }
+  if (!m_wheel[level][slot]) {
+    m_bitmap[level][slot / 64] &= ~(1ull << (slot % 64));
+  }
+  timer->m_wheel_prev = nullptr;
+  timer->m_wheel_next = nullptr;
+  timer->m_level = -1;
+  timer->m_slot = -1;
+  --m_count;
+}
+
+void TimerManager::cascade(int level, int slot) {
+  Timer *timer = m_wheel[level][slot];
+  m_wheel[level][slot] = nullptr;
+  m_bitmap[level][slot / 64] &= ~(1ull << (slot % 64));
+  while (timer) {
+    Timer *next = timer->m_wheel_next;
+    timer->m_wheel_prev = nullptr;
+    timer->m_wheel_next = nullptr;
+    --m_count;
+    link(timer);
+    timer = next;
+  }
+}
+
+void TimerManager::advance(uint64_t now_ms, std::vector<Timer *> &expireds) {
+  while (m_current <= now_ms) {
+    if (m_count == 0) {
+      m_current = now_ms + 1;
+      break;
+    }
+    int idx = m_current & (ROOT_SIZE - 1);
+    if (idx == 0) {
+      for (int level = 1; level < LEVELS; ++level) {
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        int slot = (m_current >> shift) & (LEVEL_SIZE - 1);
+        cascade(level, slot);
+        if (slot != 0) {
+          break;
+        }
+      }
+    }
+    while (Timer *timer = m_wheel[0][idx]) {
+      unlink(timer);
+      expireds.push_back(timer);
+    }
+    // 跳过空槽, 但不越过下一次下放的边界
+    uint64_t next = (m_current | (ROOT_SIZE - 1)) + 1;
+    if (idx + 1 < ROOT_SIZE) {
+      int dist = findSlot(0, idx + 1);
+      if (dist >= 0 && idx + 1 + dist < ROOT_SIZE) {
+        next = m_current + 1 + dist;
+      }
+    }
+    m_current = std::min(next, now_ms + 1);
+  }
+}
+
+int TimerManager::findSlot(int level, int slot) const {
+  const std::vector<uint64_t> &bitmap = m_bitmap[level];
+  int size = level ? LEVEL_SIZE : ROOT_SIZE;
+  int words = size / 64;
+  for (int i = 0; i <= words; ++i) {
+    int w = (slot / 64 + i) % words;
+    uint64_t bits = bitmap[w];
+    if (i == 0) {
+      bits &= ~0ull << (slot % 64);
+    } else if (i == words) {
+      bits &= (1ull << (slot % 64)) - 1;
+    }
+    if (bits) {
+      int pos = w * 64 + __builtin_ctzll(bits);
+      return (pos - slot + size) % size;
     }
   }
+  return -1;
 }
 
 bool TimerManager::detectClockRollover(uint64_t now_ms) {
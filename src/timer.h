@@ -4,7 +4,6 @@
 #include "thread.h"
 #include <cstdint>
 #include <functional>
-#include <set>
 #include <memory>
 #include <vector>
 
@@ -19,42 +18,75 @@ public:
   bool cancel();
   bool refresh();
   bool reset(uint64_t ms, bool from_now);
+  // 重新启动一个由createTimer创建的定时器, 已经在等待中时返回false
+  bool start(uint64_t ms);
 
 private:
   Timer(uint64_t ms, std::function<void()> cb, bool recurring,
         TimerManager *manager);
-  Timer(uint64_t next);
 
   bool m_recurring = false; // 是否循环定时器
+  bool m_reusable = false;  // 到期或取消后保留回调, 可以再次start
   uint64_t m_ms = 0;        // 执行周期
   uint64_t m_next = 0;      // 精确的执行时间
   std::function<void()> m_cb;
   TimerManager* m_manager = nullptr;
 
-  struct Comparator {
-    bool operator () (const Timer::ptr& lhs, const Timer::ptr& rhs) const;
-  };
+  // 时间轮中的位置, 侵入式双向链表
+  Timer *m_wheel_prev = nullptr;
+  Timer *m_wheel_next = nullptr;
+  int m_level = -1; // -1表示不在时间轮中
+  int m_slot = -1;
+  Timer::ptr m_self; // 在时间轮中时持有自身, 保证不被释放
 };
 
+// 分层时间轮, 第0层256个槽, 每槽1ms, 之上4层各64个槽
+// 添加/删除O(1), 到期时高层的槽逐级下放到低层
 class TimerManager {
   friend class Timer;
   public:
-    using RWMutexType = RWMutex;
+    using MutexType = Mutex;
     TimerManager();
     virtual ~TimerManager();
 
     Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
     Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb, std::weak_ptr<void> weak_cond, bool recurring = false);
+    // 创建一个未启动的一次性定时器, 之后通过Timer::start反复使用, 不再分配内存
+    Timer::ptr createTimer(std::function<void()> cb);
+    // 距离下一个定时器到期的毫秒数, 没有定时器时返回~0ull
+    // 最近的定时器在第0层时是精确值, 否则是一个下界
     uint64_t getNextTimer();
     void listExpiredCb(std::vector<std::function<void()>>& cbs);
+    // 进程内唯一, 用于判断缓存的定时器是否属于当前的TimerManager
+    uint64_t getTimerManagerId() const { return m_id; }
   protected:
     virtual void onTimerInsertAtFront() = 0;
-    void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+    void addTimer(Timer::ptr val, MutexType::Lock& lock);
     bool hasTimer();
   private:
-    RWMutexType m_mutex;
-    std::set<Timer::ptr, Timer::Comparator> m_timers;
+    static const int LEVELS = 5;
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+
+    void link(Timer *timer);
+    void unlink(Timer *timer);
+    // 把第level层的slot槽取下来, 重新放入时间轮
+    void cascade(int level, int slot);
+    // 推进时间轮到now_ms(包含), 到期的定时器放入expireds
+    void advance(uint64_t now_ms, std::vector<Timer *> &expireds);
+    // 第level层从slot开始(含)第一个非空槽的距离, 没有返回-1
+    int findSlot(int level, int slot) const;
+
+    uint64_t m_id;
+    MutexType m_mutex;
+    std::vector<std::vector<Timer *>> m_wheel;
+    std::vector<std::vector<uint64_t>> m_bitmap; // 非空槽的位图
+    uint64_t m_current = 0;         // 下一个要处理的毫秒
+    size_t m_count = 0;
     bool m_tickled = false;
+    uint64_t m_planned_wakeup = ~0ull; // 上次getNextTimer计划的唤醒时间
     uint64_t m_previous_time;
     bool detectClockRollover(uint64_t now_ms);
 };
@@ -0,0 +1,131 @@
+#ifndef __COOL_WORK_STEAL_QUEUE_H
+#define __COOL_WORK_STEAL_QUEUE_H
+
+#include "noncopyable.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cool {
+
+// Chase-Lev 工作窃取队列
+// 只有拥有者线程可以 push/pop(队尾, LIFO), 其他线程通过 steal 从队头取(FIFO)
+// T 必须是可以原子读写的平凡类型(一般为指针)
+template <class T> class WorkStealQueue : Noncopyable {
+public:
+  WorkStealQueue(size_t capacity = 256)
+      : m_top(0), m_bottom(0), m_array(new Array(roundup(capacity))) {}
+  ~WorkStealQueue() {
+    delete m_array.load(std::memory_order_relaxed);
+    for (auto &i : m_garbage) {
+      delete i;
+    }
+  }
+
+  // owner
+  void push(T item) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    Array *a = m_array.load(std::memory_order_relaxed);
+    if (b - t > a->capacity() - 1) {
+      a = grow(a, b, t);
+    }
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // owner
+  bool pop(T &item) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    Array *a = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    if (t > b) {
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    item = a->get(b);
+    if (t == b) {
+      // 最后一个元素, 和 steal 竞争
+      bool won = m_top.compare_exchange_strong(
+          t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  // thief, 任意线程
+  bool steal(T &item) {
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    Array *a = m_array.load(std::memory_order_acquire);
+    item = a->get(t);
+    return m_top.compare_exchange_strong(
+        t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  }
+
+  // 近似值, 仅用于判空和统计
+  size_t size() const {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return b > t ? (size_t)(b - t) : 0;
+  }
+  bool empty() const { return size() == 0; }
+
+private:
+  class Array {
+  public:
+    Array(int64_t cap)
+        : m_capacity(cap), m_mask(cap - 1), m_data(new std::atomic<T>[cap]) {}
+    ~Array() { delete[] m_data; }
+    int64_t capacity() const { return m_capacity; }
+    T get(int64_t i) const {
+      return m_data[i & m_mask].load(std::memory_order_relaxed);
+    }
+    void put(int64_t i, T v) {
+      m_data[i & m_mask].store(v, std::memory_order_relaxed);
+    }
+
+  private:
+    int64_t m_capacity;
+    int64_t m_mask;
+    std::atomic<T> *m_data;
+  };
+
+  Array *grow(Array *a, int64_t b, int64_t t) {
+    Array *na = new Array(a->capacity() * 2);
+    for (int64_t i = t; i != b; ++i) {
+      na->put(i, a->get(i));
+    }
+    // 旧数组可能还在被 steal 读取, 延迟到析构时释放
+    m_garbage.push_back(a);
+    m_array.store(na, std::memory_order_release);
+    return na;
+  }
+
+  static int64_t roundup(size_t v) {
+    int64_t cap = 2;
+    while (cap < (int64_t)v) {
+      cap <<= 1;
+    }
+    return cap;
+  }
+
+private:
+  std::atomic<int64_t> m_top;
+  std::atomic<int64_t> m_bottom;
+  std::atomic<Array *> m_array;
+  std::vector<Array *> m_garbage;
+};
+
+} // namespace cool
+
+#endif /* ifndef __COOL_WORK_STEAL_QUEUE_H */
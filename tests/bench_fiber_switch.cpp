@@ -0,0 +1,78 @@
+#include "src/context.h"
+#include "src/cool.h"
+#include "src/stack_allocator.h"
+#include <chrono>
+#include <cstdlib>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static const size_t kStackSize = 128 * 1024;
+
+template <class Ctx> struct SwitchBench {
+  static Ctx s_main;
+  static Ctx s_co;
+  static void Entry() {
+    while (true) {
+      Ctx::Swap(&s_co, &s_main);
+    }
+  }
+  // 返回每秒切换次数, 一次往返计两次切换
+  static double Run(uint64_t rounds) {
+    cool::MallocStackAllocator alloc;
+    void *stack = alloc.alloc(kStackSize);
+    s_main.init();
+    s_co.make(stack, kStackSize, &Entry);
+    auto begin = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < rounds; ++i) {
+      Ctx::Swap(&s_main, &s_co);
+    }
+    std::chrono::duration<double> used =
+        std::chrono::steady_clock::now() - begin;
+    alloc.dealloc(stack, kStackSize);
+    return rounds * 2 / used.count();
+  }
+};
+template <class Ctx> Ctx SwitchBench<Ctx>::s_main;
+template <class Ctx> Ctx SwitchBench<Ctx>::s_co;
+
+// 通过Fiber::call/back, 包含Fiber自身的开销, 使用编译时选择的后端
+static bool s_fiber_stop = false;
+static double bench_fiber(uint64_t rounds) {
+  cool::Fiber::GetThis();
+  cool::Fiber::ptr fiber(new cool::Fiber(
+      []() {
+        while (!s_fiber_stop) {
+          cool::Fiber::GetThis()->back();
+        }
+      },
+      kStackSize, true));
+  auto begin = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < rounds; ++i) {
+    fiber->call();
+  }
+  std::chrono::duration<double> used =
+      std::chrono::steady_clock::now() - begin;
+  s_fiber_stop = true;
+  fiber->call();
+  return rounds * 2 / used.count();
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t rounds = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+  LOG_INFO(g_logger) << "ucontext: "
+                     << (uint64_t)SwitchBench<cool::UContext>::Run(rounds)
+                     << " switches/s";
+#ifdef COOL_HAVE_ASM_CONTEXT
+  LOG_INFO(g_logger) << "asm: "
+                     << (uint64_t)SwitchBench<cool::AsmContext>::Run(rounds)
+                     << " switches/s";
+#endif
+#ifdef COOL_FIBER_ASM_CONTEXT
+  const char *backend = "asm";
+#else
+  const char *backend = "ucontext";
+#endif
+  LOG_INFO(g_logger) << "fiber(" << backend
+                     << "): " << (uint64_t)bench_fiber(rounds) << " switches/s";
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include "src/address.h"
+#include "src/cool.h"
+#include "src/fd_manager.h"
+#include "src/hook.h"
+#include "src/iomanager.h"
+#include "src/socket.h"
+#include "src/tcp_server.h"
+#include <atomic>
+#include <fcntl.h>
+#include <functional>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static const uint16_t PORT = 8031;
+
+// 回显服务器, 记录每次读到数据时所在的线程和开始处理连接时是否相同
+class EchoServer : public cool::TcpServer {
+public:
+  using ptr = std::shared_ptr<EchoServer>;
+  EchoServer(cool::IOManager *worker) : TcpServer(worker, worker) {}
+
+  std::atomic<int> reads = {0};
+  std::atomic<int> moved = {0};
+
+protected:
+  void handle_client(cool::Socket::ptr client) override {
+    int tid = cool::thread_id();
+    char buf[64];
+    while (true) {
+      int n = client->recv(buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      if (cool::thread_id() != tid) {
+        ++moved;
+      }
+      ++reads;
+      client->send(buf, n);
+    }
+  }
+};
+
+// 阻塞的客户端socket, 主线程没有开启hook
+static int connect_to(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT(fd >= 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT(connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0);
+  return fd;
+}
+
+// reuseport模式下连接在accept它的线程上处理, 每次读等待之后都要回到这个线程
+void test_reuseport() {
+  static const int CONNS = 8;
+  static const int ROUNDS = 10;
+  cool::IOManager iom{3, false, "reuseport"};
+  EchoServer::ptr server(new EchoServer(&iom));
+  std::atomic<bool> started = {false};
+  // 监听socket要在开启了hook的线程上创建, 才会被FdMgr当作非阻塞socket管理
+  iom.schedule([server, &started]() {
+    server->setReusePort(true);
+    ASSERT(server->bind(cool::Address::LookupAnyIPAddress(
+        "127.0.0.1:" + std::to_string(PORT))));
+    server->start();
+    started = true;
+  });
+  while (!started) {
+    usleep(1000);
+  }
+
+  std::vector<int> fds;
+  for (int i = 0; i < CONNS; ++i) {
+    fds.push_back(connect_to(PORT));
+  }
+  for (int r = 0; r < ROUNDS; ++r) {
+    for (int fd : fds) {
+      char c = 'a' + r;
+      ASSERT(write(fd, &c, 1) == 1);
+      ASSERT(read(fd, &c, 1) == 1 && c == 'a' + r);
+    }
+    // 让服务端的读重新挂起在epoll上
+    usleep(2 * 1000);
+  }
+  for (int fd : fds) {
+    close(fd);
+  }
+  server->stop();
+  ASSERT(server->reads == CONNS * ROUNDS);
+  ASSERT2(server->moved == 0, server->moved << " reads moved to another thread");
+  LOG_INFO(g_logger) << "test_reuseport ok";
+}
+
+// 连接在accept之前就已经排在监听队列里, 一次accept全部取出, 都是系统层面非阻塞的
+void test_batch_accept() {
+  static const size_t N = 16;
+  cool::IOManager iom{2, false, "batch"};
+  std::atomic<bool> done = {false};
+  iom.schedule([&done]() {
+    auto addr = cool::Address::LookupAnyIPAddress("127.0.0.1:0");
+    cool::Socket::ptr listener = cool::Socket::CreateTCP(addr);
+    ASSERT(listener->bind(addr) && listener->listen());
+    std::vector<cool::Socket::ptr> conns;
+    for (size_t i = 0; i < N; ++i) {
+      cool::Socket::ptr c = cool::Socket::CreateTCP(addr);
+      ASSERT(c->connect(listener->localAddress()));
+      conns.push_back(c);
+    }
+
+    std::vector<cool::Socket::ptr> clients;
+    ASSERT2(listener->accept(clients) == N, "accepted " << clients.size());
+    ASSERT(clients.size() == N);
+    for (auto &c : clients) {
+      int fd = c->socket();
+      ASSERT(fcntl_f(fd, F_GETFL) & O_NONBLOCK);
+      cool::FdCtx::ptr ctx = cool::FdMgr::instance()->get(fd);
+      ASSERT(ctx && ctx->getSysNonBlock() && !ctx->getUserNonBlock());
+    }
+    // 取到的连接可以正常读写
+    ASSERT(conns[0]->send("x", 1) == 1);
+    char buf[4] = {0};
+    bool got = false;
+    for (auto &c : clients) {
+      c->recvTimeout(10);
+      if (c->recv(buf, sizeof(buf)) == 1) {
+        got = true;
+      }
+    }
+    ASSERT(got && buf[0] == 'x');
+
+    // max_count限制一次取出的个数, 剩下的留给下一次
+    for (size_t i = 0; i < 3; ++i) {
+      cool::Socket::ptr c = cool::Socket::CreateTCP(addr);
+      ASSERT(c->connect(listener->localAddress()));
+      conns.push_back(c);
+    }
+    clients.clear();
+    ASSERT(listener->accept(clients, 2) == 2);
+    ASSERT(listener->accept(clients, 2) == 1 && clients.size() == 3);
+    done = true;
+  });
+  while (!done) {
+    usleep(1000);
+  }
+  LOG_INFO(g_logger) << "test_batch_accept ok";
+}
+
+// 整批提交指定线程的任务, 每个任务都只在那个线程上执行一次
+void test_schedule_batch() {
+  static const int N = 64;
+  cool::IOManager iom{3, false, "batch"};
+  const std::vector<int> &ids = iom.threadIds();
+  std::atomic<int> runs[N];
+  std::atomic<int> wrong = {0};
+  std::atomic<int> done = {0};
+  for (int i = 0; i < N; ++i) {
+    runs[i] = 0;
+  }
+  auto make_cbs = [&](int target, int begin, int end) {
+    std::vector<std::function<void()>> cbs;
+    for (int i = begin; i < end; ++i) {
+      cbs.push_back([&, target, i]() {
+        if (target != -1 && cool::thread_id() != target) {
+          ++wrong;
+        }
+        ++runs[i];
+        ++done;
+      });
+    }
+    return cbs;
+  };
+  // 非工作线程提交到指定线程
+  auto cbs = make_cbs(ids[1], 0, N / 4);
+  iom.schedule(cbs.begin(), cbs.end(), ids[1]);
+  // 工作线程提交到另一个线程, 以及不指定线程放入自己的本地队列
+  iom.schedule(
+      [&]() {
+        auto pinned = make_cbs(ids[2], N / 4, N / 2);
+        iom.schedule(pinned.begin(), pinned.end(), ids[2]);
+        auto local = make_cbs(-1, N / 2, N);
+        iom.schedule(local.begin(), local.end());
+      },
+      ids[0]);
+  while (done < N) {
+    usleep(1000);
+  }
+  ASSERT(wrong == 0);
+  for (int i = 0; i < N; ++i) {
+    ASSERT(runs[i] == 1);
+  }
+  LOG_INFO(g_logger) << "test_schedule_batch ok";
+}
+
+int main(int argc, char *argv[]) {
+  test_reuseport();
+  test_batch_accept();
+  test_schedule_batch();
+  return 0;
+}
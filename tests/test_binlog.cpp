@@ -0,0 +1,116 @@
+#include "src/binlog.h"
+#include "src/cool.h"
+#include <unistd.h>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static std::vector<std::string> read_all(const std::string &file,
+                                         const std::string &pattern) {
+  cool::BinLogReader reader(pattern);
+  ASSERT(reader.open(file));
+  std::vector<std::string> lines;
+  std::string line;
+  while (reader.next(line)) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// 写二进制日志后解码, 和printf的结果一致
+void test_roundtrip() {
+  const std::string file = "./binlog_test.bin";
+  remove(file.c_str());
+  ASSERT(cool::BinLog::Open(file));
+  cool::Logger::ptr logger(new cool::Logger("bin"));
+  std::string name = "cool";
+  int v = -42;
+  LOG_BIN_INFO(logger, "hello");
+  LOG_BIN_WARN(logger, "i=%d u=%u x=%#x s=%s str=%-6s| f=%.2f c=%c %%", v,
+               7u, 255, "abc", name, 3.14159, 'A');
+  LOG_BIN_DEBUG(logger, "%05ld %llu %zu", 12L, (unsigned long long)-1,
+                (size_t)9);
+  logger->set_level(cool::LogLevel::INFO);
+  LOG_BIN_DEBUG(logger, "filtered %d", 1);
+  // 不同线程的日志按块写出, 只保证同一个线程内有序
+  cool::BinLog::Flush();
+
+  std::vector<cool::Thread::ptr> thrs;
+  for (int i = 0; i < 2; ++i) {
+    thrs.push_back(cool::Thread::ptr(new cool::Thread(
+        [logger]() {
+          for (int j = 0; j < 1000; ++j) {
+            LOG_BIN_INFO(logger, "thread %s %d", cool::Thread::GetName(), j);
+          }
+        },
+        "bin_" + std::to_string(i))));
+  }
+  for (auto &i : thrs) {
+    i->join();
+  }
+  cool::BinLog::Flush();
+
+  auto lines = read_all(file, "[%p] [%c] %N %m%n");
+  ASSERT2(lines.size() == 2003, lines.size());
+  ASSERT2(lines[0] == "[INFO] [bin] UNKNOWN hello\n", lines[0]);
+  ASSERT2(lines[1] ==
+              "[WARN] [bin] UNKNOWN i=-42 u=7 x=0xff s=abc str=cool  | "
+              "f=3.14 c=A %\n",
+          lines[1]);
+  ASSERT2(lines[2] == "[DEBUG] [bin] UNKNOWN 00012 18446744073709551615 9\n",
+          lines[2]);
+  // 每个线程内的顺序不变
+  int next[2] = {0, 0};
+  for (size_t i = 3; i < lines.size(); ++i) {
+    int t = lines[i].find("bin_1") != std::string::npos;
+    ASSERT2(lines[i] == "[INFO] [bin] bin_" + std::to_string(t) + " thread bin_" +
+                            std::to_string(t) + " " +
+                            std::to_string(next[t]++) + "\n",
+            lines[i]);
+  }
+
+  // 重新打开后追加, 调用点重新登记
+  ASSERT(cool::BinLog::Open(file));
+  LOG_BIN_INFO(logger, "again %s", "x");
+  cool::BinLog::Flush();
+  lines = read_all(file, "%m%n");
+  ASSERT(lines.size() == 2004 && lines.back() == "again x\n");
+
+  ASSERT(cool::BinLog::Open(""));
+  ASSERT(!cool::BinLog::IsEnabled());
+  remove(file.c_str());
+}
+
+// 每条日志的耗时, 和文本日志对比
+void bench() {
+  const std::string file = "./binlog_bench.bin";
+  cool::Logger::ptr logger(new cool::Logger("bench"));
+  ASSERT(cool::BinLog::Open(file));
+  const int N = 200000;
+  uint64_t start = cool::GetCurrentUS();
+  for (int i = 0; i < N; ++i) {
+    LOG_BIN_INFO(logger, "bench %d %s", i, "value");
+  }
+  uint64_t bin = cool::GetCurrentUS() - start;
+  cool::BinLog::Flush();
+  ASSERT(cool::BinLog::Open(""));
+  remove(file.c_str());
+
+  const std::string text_file = "./binlog_bench.txt";
+  logger->add_appender(cool::LogAppender::ptr(new cool::AsyncLogAppender(
+      cool::LogAppender::ptr(new cool::FileLogAppender(text_file)))));
+  start = cool::GetCurrentUS();
+  for (int i = 0; i < N; ++i) {
+    LOG_INFO(logger) << "bench " << i << " value";
+  }
+  uint64_t text = cool::GetCurrentUS() - start;
+  cool::AsyncLogAppender::Flush();
+  remove(text_file.c_str());
+  LOG_INFO(g_logger) << "binary log " << bin * 1000 / N << "ns/line, async text log "
+                     << text * 1000 / N << "ns/line";
+}
+
+int main(int argc, char *argv[]) {
+  test_roundtrip();
+  bench();
+  return 0;
+}
@@ -1,5 +1,8 @@
 #include "src/config.h"
 #include "src/log.h"
+#include "src/macro.h"
+#include "src/thread.h"
+#include <atomic>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -194,6 +197,41 @@ void test_visit() {
                          << ",value=" << var->to_string();
   });
 }
+// 读线程不加锁读取, 主线程同时修改, 读到的值只能是某一次完整写入的值
+void test_concurrent() {
+  auto int_var = cool::Config::lookup<uint64_t>("test.concurrent.int", 0,
+                                                "concurrent int");
+  auto str_var = cool::Config::lookup<std::string>(
+      "test.concurrent.str", std::string(64, '0'), "concurrent str");
+  std::atomic<bool> stop{false};
+  std::vector<cool::Thread::ptr> threads;
+  for (int i = 0; i < 3; ++i) {
+    threads.emplace_back(new cool::Thread(
+        [&]() {
+          uint64_t last = 0;
+          while (!stop) {
+            uint64_t v = int_var->get_value();
+            ASSERT(v >= last);
+            last = v;
+            std::string s = str_var->get_value();
+            ASSERT(s.size() == 64 && s == std::string(64, s[0]));
+          }
+        },
+        "reader_" + std::to_string(i)));
+  }
+  for (uint64_t i = 1; i <= 10000; ++i) {
+    int_var->set_value(i);
+    str_var->set_value(std::string(64, '0' + i % 10));
+  }
+  stop = true;
+  for (auto &t : threads) {
+    t->join();
+  }
+  ASSERT(int_var->get_value() == 10000);
+  ASSERT(str_var->to_string() == std::string(64, '0'));
+  LOG_INFO(LOG_ROOT()) << "test_concurrent ok";
+}
+
 int main() {
   // LOG_INFO(LOG_ROOT()) << g_double_value_config->val();
   // LOG_INFO(LOG_ROOT()) << g_double_value_config->to_string();
@@ -207,5 +245,7 @@ int main() {
   test_log();
 
   // test_visit();
+
+  test_concurrent();
   return 0;
 }
@@ -0,0 +1,64 @@
+#include "src/cool.h"
+#include "src/fd_manager.h"
+#include "src/fd_table.h"
+#include <atomic>
+#include <sys/socket.h>
+#include <unistd.h>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+struct Item {
+  int fd = -1;
+  std::atomic<int> hits = {0};
+};
+
+void test_table() {
+  cool::FdTable<Item, 4, 1024> table([](Item &item, int fd) { item.fd = fd; });
+  ASSERT(table.get(-1) == nullptr);
+  ASSERT(table.get(100) == nullptr);
+  ASSERT(table.getOrCreate(1024) == nullptr);
+
+  // 多个线程同时触发段的分配, 每个fd最后只能落在同一个元素上
+  std::vector<cool::Thread::ptr> thrs;
+  for (int i = 0; i < 4; ++i) {
+    thrs.push_back(cool::Thread::ptr(new cool::Thread(
+        [&table]() {
+          for (int fd = 0; fd < 1024; ++fd) {
+            ++table.getOrCreate(fd)->hits;
+          }
+        },
+        "fd_table_" + std::to_string(i))));
+  }
+  for (auto &i : thrs) {
+    i->join();
+  }
+  for (int fd = 0; fd < 1024; ++fd) {
+    Item *item = table.get(fd);
+    ASSERT(item && item->fd == fd && item->hits == 4);
+  }
+  LOG_INFO(g_logger) << "test_table ok";
+}
+
+void test_fd_manager() {
+  int fds[2];
+  ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  // 远大于初始容量的fd
+  int big = dup2(fds[0], 5000);
+  ASSERT(big == 5000);
+  ASSERT(!cool::FdMgr::instance()->get(big));
+  cool::FdCtx::ptr ctx = cool::FdMgr::instance()->get(big, true);
+  ASSERT(ctx && ctx->isSocket());
+  ASSERT(cool::FdMgr::instance()->get(big) == ctx);
+  cool::FdMgr::instance()->del(big);
+  ASSERT(!cool::FdMgr::instance()->get(big));
+  close(big);
+  close(fds[0]);
+  close(fds[1]);
+  LOG_INFO(g_logger) << "test_fd_manager ok";
+}
+
+int main(int argc, char *argv[]) {
+  test_table();
+  test_fd_manager();
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include "src/cool.h"
+#include "src/fd_manager.h"
+#include "src/iomanager.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 统计堆分配次数, 验证hook的IO在EAGAIN->等待->唤醒的路径上不分配内存
+static std::atomic<bool> s_counting{false};
+static std::atomic<uint64_t> s_allocs{0};
+
+void *operator new(size_t size) {
+  if (s_counting) {
+    ++s_allocs;
+  }
+  void *p = malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static const int WARMUP = 100;
+static const int ROUNDS = 10000;
+static int s_fds[2];
+
+void set_timeout(int fd, int ms) {
+  timeval tv{ms / 1000, ms % 1000 * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+void server() {
+  char c = 0;
+  for (int i = 0; i < WARMUP + ROUNDS; ++i) {
+    ASSERT(read(s_fds[1], &c, 1) == 1);
+    ASSERT(write(s_fds[1], &c, 1) == 1);
+  }
+}
+
+void client() {
+  char c = 'x';
+  for (int i = 0; i < WARMUP + ROUNDS; ++i) {
+    if (i == WARMUP) {
+      s_counting = true;
+    } else if (i == WARMUP + ROUNDS - 1) {
+      // 最后一轮之后server协程结束, 释放协程不算在内
+      s_counting = false;
+    }
+    ASSERT(write(s_fds[0], &c, 1) == 1);
+    ASSERT(read(s_fds[0], &c, 1) == 1);
+  }
+}
+
+void test_timeout() {
+  // 没有数据时应该按SO_RCVTIMEO超时返回
+  char c = 0;
+  uint64_t begin = cool::GetCurrentMS();
+  ASSERT(read(s_fds[0], &c, 1) == -1 && errno == ETIMEDOUT);
+  ASSERT(cool::GetCurrentMS() - begin >= 100);
+  LOG_INFO(g_logger) << "test_timeout ok";
+}
+
+int main(int argc, char *argv[]) {
+  cool::Logger::ptr sys = LOG_NAME("system");
+  sys->set_level(cool::LogLevel::INFO);
+  ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, s_fds) == 0);
+  {
+    cool::IOManager iom(1, false, "alloc");
+    iom.schedule([]() {
+      for (int fd : s_fds) {
+        cool::FdMgr::instance()->get(fd, true);
+        set_timeout(fd, 100);
+      }
+      cool::IOManager::GetThis()->schedule(&server);
+      cool::IOManager::GetThis()->schedule(&client);
+    });
+  }
+  LOG_INFO(g_logger) << "allocations in " << ROUNDS
+                     << " ping-pong rounds: " << s_allocs;
+  ASSERT(s_allocs == 0);
+  {
+    cool::IOManager iom(1, false, "alloc");
+    iom.schedule(&test_timeout);
+  }
+  close(s_fds[0]);
+  close(s_fds[1]);
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include "src/http/http.h"
 #include "src/log.h"
+#include "src/macro.h"
 #include <iostream>
 
 
@@ -21,8 +22,57 @@ void test_response () {
   rsp->dump(std::cout) << std::endl;
 }
 
+void test_header () {
+  cool::http::HttpRequest::ptr req(new cool::http::HttpRequest);
+  req->setHeader("content-length", " 1024 ");
+  req->setHeader("X-Num", "-12");
+  req->setHeader("X-Big", "18446744073709551616");
+  ASSERT(req->getHeaderAs<uint64_t>(cool::http::http_header::CONTENT_LENGTH) == 1024);
+  ASSERT(req->getHeaderAs<int>("x-num") == -12);
+  ASSERT(req->getHeaderAs<uint32_t>("x-num", 7) == 7);
+  ASSERT(req->getHeaderAs<uint64_t>("x-big", 1) == 1);
+  ASSERT(req->getHeaderAs<double>("X-NUM") == -12.0);
+
+  // 超过内联容量之后搬到堆上
+  for (int i = 0; i < 40; ++i) {
+    req->setHeader("h" + std::to_string(i), std::to_string(i));
+  }
+  req->delHeader("H3");
+  ASSERT(req->headers().size() == 42);
+  ASSERT(!req->hasHeader("h3") && req->getHeaderAs<int>("h39") == 39);
+  ASSERT(req->getHeader(cool::http::http_header::CONTENT_LENGTH) == " 1024 ");
+}
+
+// 没有body的响应也要写Content-Length: 0, 1xx/204/304除外
+void test_empty_body () {
+  cool::http::HttpResponse rsp(0x11, false);
+  std::string header;
+  rsp.serializeHeader(header);
+  ASSERT(header.find("Content-Length: 0\r\n") != std::string::npos);
+
+  header.clear();
+  rsp.status(cool::http::http_status::NO_CONTENT);
+  rsp.serializeHeader(header);
+  ASSERT(header.find("Content-Length") == std::string::npos);
+
+  header.clear();
+  rsp.status(cool::http::http_status::NOT_MODIFIED);
+  rsp.serializeHeader(header);
+  ASSERT(header.find("Content-Length") == std::string::npos);
+
+  // 用户设置的长度(例如HEAD的响应)保留, 不重复
+  header.clear();
+  rsp.status(cool::http::http_status::OK);
+  rsp.setHeader("Content-Length", "10");
+  rsp.serializeHeader(header);
+  ASSERT(header.find("Content-Length: 10\r\n") != std::string::npos);
+  ASSERT(header.find("Content-Length: 0") == std::string::npos);
+}
+
 int main(int argc, char* argv[]) {
   test_request();
   test_response();
+  test_header();
+  test_empty_body();
   return 0;
 }
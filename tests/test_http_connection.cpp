@@ -0,0 +1,149 @@
+#include "src/address.h"
+#include "src/cool.h"
+#include "src/http/http_connection.h"
+#include "src/http/http_server.h"
+#include "src/iomanager.h"
+#include <atomic>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+using cool::http::HttpRequest;
+using cool::http::HttpResponse;
+using cool::http::HttpResult;
+using cool::http::HttpSession;
+
+static const uint16_t PORT = 8023;
+static std::atomic<int> s_running = {0};
+static std::atomic<int> s_max_running = {0};
+
+cool::http::HttpServer::ptr start_server() {
+  cool::http::HttpServer::ptr server(new cool::http::HttpServer(true));
+  auto addr = cool::Address::LookupAnyIPAddress("127.0.0.1:" +
+                                                std::to_string(PORT));
+  ASSERT(server->bind(addr));
+  auto sd = server->get_servlet_dispatch();
+  sd->add_servlet("/echo", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                              HttpSession::ptr session) {
+    rsp->body("echo " + req->query().to_string() + " " +
+              req->body().to_string());
+    return 0;
+  });
+  sd->add_servlet("/sleep/:ms", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                                   HttpSession::ptr session) {
+    int n = ++s_running;
+    int old = s_max_running;
+    while (n > old && !s_max_running.compare_exchange_weak(old, n)) {
+    }
+    usleep(req->getParamAs<int>("ms") * 1000);
+    --s_running;
+    rsp->body("slept");
+    return 0;
+  });
+  sd->add_servlet("/chunked", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                                 HttpSession::ptr session) {
+    auto stream = session->streamResponse(rsp);
+    ASSERT(stream);
+    stream->writeFixSize("hello ", 6);
+    stream->writeFixSize("chunked", 7);
+    stream->close();
+    return 0;
+  });
+  sd->add_servlet("/close", [](HttpRequest::ptr req, HttpResponse::ptr rsp,
+                               HttpSession::ptr session) {
+    rsp->setClose(true);
+    rsp->body("bye");
+    return 0;
+  });
+  server->start();
+  return server;
+}
+
+std::string body_of(HttpResult::ptr r) {
+  ASSERT2(r->result == HttpResult::Error::OK, r->to_string());
+  return r->response->body();
+}
+
+void test_keepalive(cool::http::HttpConnectionPool::ptr pool) {
+  for (int i = 0; i < 10; ++i) {
+    auto r = pool->doGet("/echo?i=" + std::to_string(i), 1000);
+    ASSERT(body_of(r) == "echo i=" + std::to_string(i) + " ");
+  }
+  auto r = pool->doPost("/echo", 1000, {{"Content-Type", "text/plain"}},
+                        "post body");
+  ASSERT(body_of(r) == "echo  post body");
+  // 同一个连接处理了所有请求
+  ASSERT(pool->totalCount() == 1 && pool->idleCount() == 1);
+
+  ASSERT(body_of(pool->doGet("/chunked", 1000)) == "hello chunked");
+  ASSERT(pool->totalCount() == 1);
+
+  // 服务端要求关闭的连接不放回池中
+  ASSERT(body_of(pool->doGet("/close", 1000)) == "bye");
+  ASSERT(pool->totalCount() == 0 && pool->idleCount() == 0);
+  ASSERT(body_of(pool->doGet("/echo", 1000)) == "echo  ");
+  ASSERT(pool->totalCount() == 1);
+}
+
+void test_timeout(cool::http::HttpConnectionPool::ptr pool) {
+  uint64_t start = cool::GetCurrentMS();
+  auto r = pool->doGet("/sleep/500", 100);
+  ASSERT2(r->result == HttpResult::Error::TIMEOUT, r->to_string());
+  ASSERT(cool::GetCurrentMS() - start < 400);
+  // 超时的连接被关闭, 不会读到上一个请求的响应
+  ASSERT(body_of(pool->doGet("/echo?x", 1000)) == "echo x ");
+}
+
+void test_max_size() {
+  cool::http::HttpConnectionPool::ptr pool(
+      new cool::http::HttpConnectionPool("127.0.0.1", PORT, 2, 200));
+  std::atomic<int> done = {0};
+  s_max_running = 0;
+  auto iom = cool::IOManager::GetThis();
+  for (int i = 0; i < 6; ++i) {
+    iom->schedule([pool, &done]() {
+      ASSERT(body_of(pool->doGet("/sleep/50", 2000)) == "slept");
+      ++done;
+    });
+  }
+  while (done < 6) {
+    usleep(10 * 1000);
+  }
+  ASSERT(s_max_running == 2 && pool->totalCount() == 2);
+
+  // 连接数已满时等待超时
+  auto c1 = pool->getConnection();
+  auto c2 = pool->getConnection();
+  cool::http::HttpResult::Error err = HttpResult::Error::OK;
+  ASSERT(!pool->getConnection(50, &err) &&
+         err == HttpResult::Error::POOL_GET_CONNECTION);
+  c1.reset();
+  ASSERT(pool->getConnection(50));
+  c2.reset();
+
+  // 空闲连接由定时器关闭
+  usleep(500 * 1000);
+  ASSERT2(pool->totalCount() == 0, pool->totalCount());
+}
+
+void run() {
+  auto server = start_server();
+  {
+    cool::http::HttpConnectionPool::ptr pool(
+        new cool::http::HttpConnectionPool("127.0.0.1", PORT));
+    test_keepalive(pool);
+    test_max_size();
+    test_timeout(pool);
+
+    cool::http::HttpConnectionPool::ptr bad(
+        new cool::http::HttpConnectionPool("127.0.0.1", 1));
+    ASSERT(bad->doGet("/", 100)->result == HttpResult::Error::CONNECT_FAIL);
+  }
+  server->stop();
+  LOG_INFO(g_logger) << "test_http_connection ok";
+}
+
+int main(int argc, char *argv[]) {
+  cool::IOManager iom(2, true, "client");
+  iom.schedule(run);
+  return 0;
+}
@@ -19,9 +19,8 @@ void test_request() {
                       << " hasError = " << parser.hasError()
                       << " isFinished = " << parser.isFinished()
                       << " content-length = " << parser.content_length();
-  temp.resize(temp.size() - s);
   LOG_DEBUG(g_logger) << parser.m_data->to_string();
-  LOG_DEBUG(g_logger) << temp;
+  LOG_DEBUG(g_logger) << temp.substr(s);
 }
 
 const char test_response_data[] =
@@ -45,10 +44,9 @@ void test_response() {
                       << " isFinished = " << parser.isFinished()
                       << " total = " << temp.size()
                       << " content_length = " << parser.content_length();
-  temp.resize(temp.size() - s);
 
   LOG_DEBUG(g_logger) << parser.m_data->to_string();
-  LOG_DEBUG(g_logger) << temp;
+  LOG_DEBUG(g_logger) << temp.substr(s);
 }
 
 int main(int argc, char *argv[]) {
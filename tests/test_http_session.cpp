@@ -0,0 +1,315 @@
+#include "src/config.h"
+#include "src/cool.h"
+#include "src/fd_manager.h"
+#include "src/http/http_session.h"
+#include "src/iomanager.h"
+#include "src/socket.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// 统计recvRequest/sendResponse中的堆分配次数
+static std::atomic<bool> s_counting{false};
+static std::atomic<uint64_t> s_allocs{0};
+
+void *operator new(size_t size) {
+  if (s_counting) {
+    ++s_allocs;
+  }
+  void *p = malloc(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static const int ROUNDS = 1000;
+static const char s_get[] = "GET /cool/xx?id=1#top HTTP/1.1\r\n"
+                            "Host: www.cool.com\r\n"
+                            "User-Agent: test\r\n\r\n";
+static int s_fds[2];
+static int s_rsp_fds[2];
+
+cool::Socket::ptr wrap(int fd) {
+  cool::Socket::ptr sock(new cool::Socket(AF_UNIX, SOCK_STREAM, 0));
+  ASSERT(sock->init(fd));
+  return sock;
+}
+
+void write_all(int fd, const std::string &data) {
+  ASSERT(write(fd, data.c_str(), data.size()) == (ssize_t)data.size());
+}
+
+bool read_fix_size(int fd, char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t rt = read(fd, buf, len);
+    if (rt <= 0) {
+      return false;
+    }
+    buf += rt;
+    len -= rt;
+  }
+  return true;
+}
+
+void wait_ack(int fd) {
+  char c;
+  ASSERT(read(fd, &c, 1) == 1);
+}
+
+void client() {
+  int fd = s_fds[0];
+  for (int i = 0; i < ROUNDS; ++i) {
+    // 计数期间客户端不能分配内存
+    ASSERT(write(fd, s_get, sizeof(s_get) - 1) == sizeof(s_get) - 1);
+    wait_ack(fd);
+  }
+  // 请求头分两次到达
+  std::string get = s_get;
+  write_all(fd, get.substr(0, 20));
+  usleep(10 * 1000);
+  write_all(fd, get.substr(20));
+  wait_ack(fd);
+  // body在读缓冲区里
+  write_all(fd, "POST /small HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello");
+  wait_ack(fd);
+  // body超过读缓冲区, 剩下的部分直接读进body
+  std::string big(64 * 1024, 'x');
+  write_all(fd, "POST /big HTTP/1.0\r\nConnection: keep-alive\r\n"
+                "Content-Length: " +
+                    std::to_string(big.size()) + "\r\n\r\n" + big);
+  wait_ack(fd);
+
+  // 流水线: 一次写入多个请求, 最后一个请求分两次到达
+  write_all(fd, "GET /p1 HTTP/1.1\r\n\r\n"
+                "POST /p2 HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                "GET /p3 HTTP/1.1\r\nHost: x\r\n\r\n"
+                "GET /p4 HTTP/1.1\r\nHo");
+  usleep(10 * 1000);
+  write_all(fd, "st: y\r\n\r\n");
+  std::string expect;
+  for (auto path : {"/p1", "/p2", "/p3", "/p4"}) {
+    cool::http::HttpResponse rsp(0x11, false);
+    rsp.body(path);
+    expect += rsp.to_string();
+  }
+  std::string data(expect.size(), 0);
+  ASSERT(read_fix_size(fd, &data[0], data.size()));
+  ASSERT(data == expect);
+
+  // chunked上传, 后面紧跟一个流水线请求
+  write_all(fd, "POST /up HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                "5;ext=1\r\nhello\r\n"
+                "6\r\n world\r\n"
+                "0\r\nX-Trailer: t\r\n\r\n"
+                "GET /after HTTP/1.1\r\n\r\n");
+  wait_ack(fd);
+  // 超过stream_body_size的body, servlet只读了一部分
+  std::string big_body(100 * 1024, 'y');
+  write_all(fd, "POST /big HTTP/1.1\r\nContent-Length: " +
+                    std::to_string(big_body.size()) + "\r\n\r\n" + big_body);
+  write_all(fd, "GET /next HTTP/1.1\r\n\r\n");
+  wait_ack(fd);
+  // chunked响应
+  write_all(fd, "GET /stream HTTP/1.1\r\n\r\n");
+  std::string chunked = "HTTP/1.1 200 OK\r\n"
+                        "Connection: keep-alive\r\n"
+                        "Transfer-Encoding: chunked\r\n\r\n"
+                        "5\r\nhello\r\n"
+                        "6\r\n world\r\n"
+                        "3\r\nabc\r\n"
+                        "0\r\n\r\n";
+  data.assign(chunked.size(), 0);
+  ASSERT(read_fix_size(fd, &data[0], data.size()));
+  ASSERT(data == chunked);
+
+  write_all(fd, "GET / HTTP/1.1\r\nConnection: close\r\n\r\n");
+  wait_ack(fd);
+}
+
+static std::string s_expect;
+
+void rsp_client() {
+  std::string data;
+  // 服务端计数期间客户端不能分配内存
+  data.reserve(1 << 20);
+  char buf[4096];
+  int rt = 0;
+  while ((rt = read(s_rsp_fds[0], buf, sizeof(buf))) > 0) {
+    data.append(buf, rt);
+  }
+  ASSERT(data == s_expect);
+  LOG_INFO(g_logger) << "test_send_response ok, bytes=" << data.size();
+}
+
+void rsp_server() {
+  cool::http::HttpSession::ptr session(
+      new cool::http::HttpSession(wrap(s_rsp_fds[1])));
+  cool::http::HttpResponse::ptr rsp(new cool::http::HttpResponse(0x11, false));
+  rsp->setHeader("Server", "cool");
+  rsp->body("hello");
+  for (int i = 0; i < ROUNDS; ++i) {
+    s_expect += rsp->to_string();
+  }
+  for (int i = 0; i < ROUNDS; ++i) {
+    s_counting = i > 1;
+    ASSERT(session->sendResponse(rsp) > 0);
+    s_counting = false;
+  }
+  LOG_INFO(g_logger) << "allocations in " << ROUNDS - 2
+                     << " sendResponse: " << s_allocs;
+  ASSERT(s_allocs == 0);
+
+  // body跨多个ByteArray内存块
+  cool::ByteArray::ptr ba(new cool::ByteArray(128));
+  std::string content;
+  for (int i = 0; i < 1000; ++i) {
+    content += std::to_string(i) + ",";
+  }
+  ba->write(content.c_str(), content.size());
+  ba->position(0);
+  rsp->body(ba);
+  s_expect += rsp->to_string();
+  ASSERT(session->sendResponse(rsp) > 0);
+
+  // 内存块数超过IOV_MAX, 要分多次sendmsg
+  ba.reset(new cool::ByteArray(2));
+  ba->write(content.c_str(), content.size());
+  ba->position(0);
+  rsp->body(ba);
+  s_expect += rsp->to_string();
+  ASSERT(session->sendResponse(rsp) > 0);
+
+  // body来自文件的一段
+  char path[] = "/tmp/test_http_session_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  unlink(path);
+  ASSERT(write(fd, content.c_str(), content.size()) == (ssize_t)content.size());
+  rsp->bodyFile(fd, 10, content.size() - 10, true);
+  rsp->setClose(true);
+  s_expect += rsp->to_string() + content.substr(10);
+  ASSERT(session->sendResponse(rsp) ==
+         (int)(rsp->to_string().size() + content.size() - 10));
+  session->close();
+}
+
+void server() {
+  cool::http::HttpSession::ptr session(
+      new cool::http::HttpSession(wrap(s_fds[1])));
+  char ack = 0;
+  for (int i = 0; i < ROUNDS; ++i) {
+    s_counting = i > 1;
+    auto req = session->recvRequest();
+    s_counting = false;
+    ASSERT(req);
+    ASSERT(req->path() == "/cool/xx" && req->query() == "id=1" &&
+           req->fragment() == "top");
+    ASSERT(req->getHeader("host") == "www.cool.com" && !req->isClose());
+    session->write(&ack, 1);
+  }
+  LOG_INFO(g_logger) << "allocations in " << ROUNDS - 2
+                     << " keep-alive GETs: " << s_allocs;
+  ASSERT(s_allocs == 0);
+
+  auto req = session->recvRequest();
+  ASSERT(req && req->path() == "/cool/xx" &&
+         req->getHeader("user-agent") == "test");
+  session->write(&ack, 1);
+
+  req = session->recvRequest();
+  ASSERT(req && req->method() == cool::http::http_method::POST);
+  ASSERT(req->path() == "/small" && req->body() == "hello");
+  session->write(&ack, 1);
+
+  req = session->recvRequest();
+  ASSERT(req && req->path() == "/big" && req->body().size() == 64 * 1024);
+  ASSERT(req->body().find_first_not_of('x') == cool::http::StringView::npos);
+  ASSERT(!req->isClose());
+  session->write(&ack, 1);
+
+  for (auto path : {"/p1", "/p2", "/p3", "/p4"}) {
+    req = session->recvRequest();
+    ASSERT(req && req->path() == path && !req->isClose());
+    if (req->path() == "/p2") {
+      ASSERT(req->body() == "abc");
+    }
+    if (req->path() == "/p4") {
+      // 跨两次读到达, 搬移缓冲区之后重新解析
+      ASSERT(req->getHeader("host") == "y");
+    }
+    cool::http::HttpResponse::ptr rsp(
+        new cool::http::HttpResponse(0x11, false));
+    rsp->body(req->path().to_string());
+    ASSERT(session->sendResponse(rsp, !session->hasBufferedRequest()) >= 0);
+  }
+
+  req = session->recvRequest();
+  ASSERT(req && req->path() == "/up" && req->body().empty());
+  auto in = req->bodyStream();
+  ASSERT(in);
+  std::string body;
+  char buf[4];
+  int rt = 0;
+  while ((rt = in->read(buf, sizeof(buf))) > 0) {
+    body.append(buf, rt);
+  }
+  ASSERT(rt == 0 && body == "hello world");
+  ASSERT(req->getHeader("transfer-encoding") == "chunked");
+  req = session->recvRequest();
+  ASSERT(req && req->path() == "/after" && !req->bodyStream());
+  session->write(&ack, 1);
+
+  cool::Config::lookup<uint64_t>("http.request.stream_body_size")
+      ->set_value(64 * 1024);
+  req = session->recvRequest();
+  ASSERT(req && req->path() == "/big" && req->bodyStream());
+  ASSERT(req->bodyStream()->read(buf, sizeof(buf)) == sizeof(buf));
+  // 没读完的body在下一次recvRequest时丢掉
+  req = session->recvRequest();
+  ASSERT(req && req->path() == "/next");
+  session->write(&ack, 1);
+
+  req = session->recvRequest();
+  ASSERT(req && req->path() == "/stream");
+  cool::http::HttpResponse::ptr rsp(new cool::http::HttpResponse(0x11, false));
+  auto out = session->streamResponse(rsp);
+  ASSERT(out && out->write("hello", 5) == 5 && out->write(" world", 6) == 6);
+  cool::ByteArray::ptr ba(new cool::ByteArray(2));
+  ba->write("abc", 3);
+  ba->position(0);
+  ASSERT(out->write(ba, 3) == 3);
+  ASSERT(session->sendResponse(rsp) == 0);
+
+  req = session->recvRequest();
+  ASSERT(req && req->isClose());
+  session->write(&ack, 1);
+  LOG_INFO(g_logger) << "test_http_session ok";
+
+  cool::IOManager::GetThis()->schedule(&rsp_server);
+  cool::IOManager::GetThis()->schedule(&rsp_client);
+}
+
+int main(int argc, char *argv[]) {
+  cool::Logger::ptr sys = LOG_NAME("system");
+  sys->set_level(cool::LogLevel::INFO);
+  ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, s_fds) == 0);
+  // 登记到FdManager后客户端的read/write才会走hook
+  cool::FdMgr::instance()->get(s_fds[0], true);
+  cool::FdMgr::instance()->get(s_fds[1], true);
+  ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, s_rsp_fds) == 0);
+  cool::FdMgr::instance()->get(s_rsp_fds[0], true);
+  cool::FdMgr::instance()->get(s_rsp_fds[1], true);
+  cool::IOManager iom(1, false, "session");
+  iom.schedule([]() {
+    cool::IOManager::GetThis()->schedule(&server);
+    cool::IOManager::GetThis()->schedule(&client);
+  });
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "src/cool.h"
+#include "src/fd_manager.h"
+#include "src/iomanager.h"
+#include <atomic>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static std::atomic<int> s_done = {0};
+
+// socketpair不经过hook, 手动注册成socket
+static void make_pair(int fds[2]) {
+  ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  cool::FdMgr::instance()->get(fds[0], true);
+  cool::FdMgr::instance()->get(fds[1], true);
+}
+
+void test_ping_pong() {
+  for (int p = 0; p < 8; ++p) {
+    int fds[2];
+    make_pair(fds);
+    int a = fds[0], b = fds[1];
+    cool::IOManager::GetThis()->schedule([a]() {
+      char c = 0;
+      for (int i = 0; i < 1000; ++i) {
+        ASSERT(write(a, &c, 1) == 1);
+        ASSERT(read(a, &c, 1) == 1);
+      }
+      close(a);
+      ++s_done;
+    });
+    cool::IOManager::GetThis()->schedule([b]() {
+      char c = 0;
+      for (int i = 0; i < 1000; ++i) {
+        ASSERT(read(b, &c, 1) == 1);
+        iovec iov;
+        iov.iov_base = &c;
+        iov.iov_len = 1;
+        ASSERT(writev(b, &iov, 1) == 1);
+      }
+      close(b);
+      ++s_done;
+    });
+  }
+}
+
+void test_timeout() {
+  int fds[2];
+  make_pair(fds);
+  timeval tv{0, 100 * 1000};
+  setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  char c;
+  uint64_t begin = cool::GetCurrentMS();
+  ASSERT(read(fds[0], &c, 1) == -1 && errno == ETIMEDOUT);
+  LOG_INFO(g_logger) << "test_timeout used=" << cool::GetCurrentMS() - begin;
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void test_close_cancel() {
+  int fds[2];
+  make_pair(fds);
+  int fd = fds[0];
+  cool::IOManager::GetThis()->addTimer(50, [fd]() { close(fd); });
+  char c;
+  ASSERT(read(fd, &c, 1) == -1 && errno == EBADF);
+  close(fds[1]);
+  LOG_INFO(g_logger) << "test_close_cancel ok";
+}
+
+void test_fixed_buffers() {
+  static char bufs[2][64];
+  iovec iovs[2];
+  for (int i = 0; i < 2; ++i) {
+    iovs[i].iov_base = bufs[i];
+    iovs[i].iov_len = sizeof(bufs[i]);
+  }
+  cool::IOManager *iom = cool::IOManager::GetThis();
+  ASSERT(iom->registerBuffers(iovs, 2));
+
+  int fds[2];
+  make_pair(fds);
+  int b = fds[1];
+  iom->schedule([iom, b]() {
+    ASSERT(iom->readFixed(b, bufs[1], sizeof(bufs[1]), 1) == 5);
+    ASSERT(memcmp(bufs[1], "hello", 5) == 0);
+    close(b);
+    ++s_done;
+  });
+  memcpy(bufs[0], "hello", 5);
+  ASSERT(iom->writeFixed(fds[0], bufs[0], 5, 0) == 5);
+  close(fds[0]);
+}
+
+void test() {
+  cool::IOManager *iom = cool::IOManager::GetThis();
+  if (!iom->isUring()) {
+    LOG_INFO(g_logger) << "io_uring not supported, skip";
+    return;
+  }
+  test_ping_pong();
+  test_timeout();
+  test_close_cancel();
+  test_fixed_buffers();
+}
+
+int main(int argc, char *argv[]) {
+  cool::Config::lookup("iomanager.backend", std::string("epoll"))
+      ->set_value("io_uring");
+  {
+    cool::IOManager iom(2, false, "uring");
+    iom.schedule(&test);
+  }
+  LOG_INFO(g_logger) << "done=" << s_done;
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include "src/cool.h"
+#include "src/fd_manager.h"
+#include "src/iomanager.h"
+#include <atomic>
+#include <sys/socket.h>
+#include <unistd.h>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static void wait_for(const std::atomic<int> &v, int expect) {
+  while (v < expect) {
+    usleep(100);
+  }
+}
+
+// 每个工作线程一个epoll, 各线程上的协程同时做阻塞读写
+void test_ping_pong() {
+  static const int ROUNDS = 200;
+  cool::IOManager iom{3, false, "reactor"};
+  std::atomic<int> done = {0};
+  for (int id : iom.threadIds()) {
+    iom.schedule(
+        [&done]() {
+          int sv[2];
+          ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+          cool::FdMgr::instance()->get(sv[0], true);
+          cool::FdMgr::instance()->get(sv[1], true);
+          // 对端在另一个协程里, 可能被别的线程执行, 事件注册到fd所属的epoll上
+          cool::IOManager::GetThis()->schedule([sv]() {
+            char c = 0;
+            for (int i = 0; i < ROUNDS; ++i) {
+              ASSERT(read(sv[1], &c, 1) == 1 && c == (char)i);
+              ASSERT(write(sv[1], &c, 1) == 1);
+            }
+          });
+          for (int i = 0; i < ROUNDS; ++i) {
+            char c = (char)i;
+            ASSERT(write(sv[0], &c, 1) == 1);
+            ASSERT(read(sv[0], &c, 1) == 1 && c == (char)i);
+          }
+          close(sv[0]);
+          close(sv[1]);
+          ++done;
+        },
+        id);
+  }
+  wait_for(done, 3);
+  LOG_INFO(g_logger) << "test_ping_pong ok";
+}
+
+// 关闭时没有挂起等待的fd也要解除和线程的绑定, 重新使用的fd号注册到新线程的epoll上
+void test_fd_reuse() {
+  cool::IOManager iom{2, false, "reuse"};
+  const std::vector<int> &ids = iom.threadIds();
+  std::atomic<int> step = {0};
+  int sv[2];
+  iom.schedule(
+      [&]() {
+        ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        cool::FdMgr::instance()->get(sv[0], true);
+        cool::FdMgr::instance()->get(sv[1], true);
+        step = 1;
+        char c = 0;
+        // 等待主线程写入, sv[0]注册到线程0的epoll上
+        ASSERT(read(sv[0], &c, 1) == 1);
+        close(sv[0]);
+        close(sv[1]);
+        step = 2;
+      },
+      ids[0]);
+  wait_for(step, 1);
+  usleep(10 * 1000);
+  ASSERT(write(sv[1], "x", 1) == 1);
+  wait_for(step, 2);
+
+  int old_fd = sv[0];
+  std::atomic<uint64_t> woke_us = {0};
+  iom.schedule(
+      [&]() {
+        ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        cool::FdMgr::instance()->get(sv[0], true);
+        cool::FdMgr::instance()->get(sv[1], true);
+        step = 3;
+        char c = 0;
+        ASSERT(read(sv[0], &c, 1) == 1);
+        woke_us = cool::GetCurrentUS();
+        close(sv[0]);
+        close(sv[1]);
+      },
+      ids[1]);
+  wait_for(step, 3);
+  ASSERT2(sv[0] == old_fd, "fd " << old_fd << " not reused, got " << sv[0]);
+
+  // 线程0忙着执行一个不让出的任务, fd如果还在线程0的epoll上, 要等它结束才能醒来
+  iom.schedule(
+      [&]() {
+        step = 4;
+        uint64_t end = cool::GetCurrentMS() + 300;
+        while (cool::GetCurrentMS() < end) {
+        }
+      },
+      ids[0]);
+  wait_for(step, 4);
+  usleep(10 * 1000);
+  uint64_t start = cool::GetCurrentUS();
+  ASSERT(write(sv[1], "y", 1) == 1);
+  while (woke_us == 0) {
+    usleep(100);
+  }
+  ASSERT2(woke_us - start < 150 * 1000,
+          "read woke after " << woke_us - start << "us");
+  LOG_INFO(g_logger) << "test_fd_reuse ok, woke after " << woke_us - start
+                     << "us";
+}
+
+int main(int argc, char *argv[]) {
+  cool::Config::lookup<bool>("iomanager.reactor_per_thread")->set_value(true);
+  test_ping_pong();
+  test_fd_reuse();
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "src/cool.h"
+#include "src/iomanager.h"
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+#include <vector>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+// 多个外部线程同时向idle的工作线程提交任务, tickle合并时不能丢掉唤醒,
+// 否则任务要等到epoll_wait超时(3s)才会执行
+void test_tickle() {
+  static const int PRODUCERS = 4;
+  static const int ROUNDS = 2000;
+  cool::IOManager iom{4, false, "tickle"};
+  std::atomic<uint64_t> max_us = {0};
+  std::atomic<uint64_t> total = {0};
+
+  std::vector<cool::Thread::ptr> thrs;
+  for (int i = 0; i < PRODUCERS; ++i) {
+    thrs.push_back(cool::Thread::ptr(new cool::Thread(
+        [&iom, &max_us, &total, i]() {
+          for (int r = 0; r < ROUNDS; ++r) {
+            // 每轮提交1~3个任务, 等它们执行完, 工作线程重新回到idle
+            int n = 1 + (r + i) % 3;
+            std::atomic<int> done = {0};
+            uint64_t start = cool::GetCurrentUS();
+            for (int k = 0; k < n; ++k) {
+              iom.schedule([&done]() { ++done; });
+            }
+            while (done < n) {
+              sched_yield();
+            }
+            uint64_t us = cool::GetCurrentUS() - start;
+            uint64_t old = max_us;
+            while (us > old && !max_us.compare_exchange_weak(old, us)) {
+            }
+            total += n;
+            if (r % 16 == 0) {
+              usleep(200);
+            }
+          }
+        },
+        "producer_" + std::to_string(i))));
+  }
+  for (auto &i : thrs) {
+    i->join();
+  }
+  ASSERT2(max_us < 500 * 1000, "max latency " << max_us << "us");
+  LOG_INFO(g_logger) << "test_tickle ok, tasks=" << total
+                     << " max latency=" << max_us << "us";
+}
+
+int main(int argc, char *argv[]) {
+  test_tickle();
+  return 0;
+}
@@ -1,5 +1,11 @@
+#include "src/config.h"
 #include "src/log.h"
+#include "src/macro.h"
 #include "src/util.h"
+#include <atomic>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 void test_log_1() {
   cool::Logger::ptr logger(new cool::Logger("test"));
@@ -42,7 +48,209 @@ void test_log_2() {
   LOG_DEBUG(logger) << "test new log";
 }
 
+// 编译后的格式: 字面量合并, 截断时返回完整长度, 同一秒的时间只格式化一次
+void test_formatter() {
+  cool::Logger::ptr logger(new cool::Logger("fmt"));
+  cool::LogFormatter fmt("%d{%Y}%T[%p] %c %f:%l %% %m%n");
+  ASSERT(!fmt.get_error());
+  const std::string thread_name = "main";
+  cool::LogEvent::ptr event(new cool::LogEvent(
+      logger.get(), cool::LogLevel::WARN, "a.cpp", 12, 0, 1, thread_name, 0, 0));
+  event->get_ss() << "hello " << 42;
+  struct tm tm;
+  time_t t = 0;
+  localtime_r(&t, &tm);
+  std::string expect = std::to_string(tm.tm_year + 1900) +
+                       "\t[WARN] fmt a.cpp:12 % hello 42\n";
+  ASSERT2(fmt.format(event) == expect, fmt.format(event));
+
+  char buf[8];
+  ASSERT(fmt.format(buf, sizeof(buf), event) == expect.size());
+  ASSERT(std::string(buf, sizeof(buf)) == expect.substr(0, sizeof(buf)));
+  // 截断在消息中间
+  char buf2[32];
+  size_t n = expect.size() - 4;
+  ASSERT(fmt.format(buf2, n, event) == expect.size());
+  ASSERT(std::string(buf2, n) == expect.substr(0, n));
+
+  cool::LogFormatter bad("%x %d{%Y");
+  ASSERT(bad.get_error());
+}
+
+class CaptureAppender : public cool::LogAppender {
+public:
+  void log(cool::LogEvent::ptr event) override {
+    events.push_back(event.get());
+    lines.push_back(event->get_content());
+  }
+
+  std::vector<cool::LogEvent *> events;
+  std::vector<std::string> lines;
+};
+
+static std::string nested_log(cool::Logger::ptr logger) {
+  LOG_INFO(logger) << "inner";
+  return "outer";
+}
+
+// 事件在同一个线程里复用, 流的格式不会带到下一条, 嵌套打日志时另外分配
+void test_event_reuse() {
+  cool::Logger::ptr logger(new cool::Logger("reuse"));
+  std::shared_ptr<CaptureAppender> capture(new CaptureAppender);
+  logger->add_appender(capture);
+  LOG_INFO(logger) << std::hex << 255;
+  LOG_INFO(logger) << 255;
+  ASSERT(capture->events[0] == capture->events[1]);
+  ASSERT(capture->lines[0] == "ff" && capture->lines[1] == "255");
+
+  LOG_INFO(logger) << nested_log(logger);
+  ASSERT(capture->lines[2] == "inner" && capture->lines[3] == "outer");
+  ASSERT(capture->events[2] != capture->events[3]);
+
+  // 只求值一次, 级别不够时不求值后面的表达式
+  int n = 0;
+  logger->set_level(cool::LogLevel::INFO);
+  LOG_DEBUG(logger) << ++n;
+  ASSERT(n == 0 && capture->lines.size() == 4);
+  if (n == 0)
+    LOG_INFO(LOG_STATIC_NAME("reuse")) << "else";
+  else
+    ASSERT(false);
+}
+
+static size_t count_lines(const std::string &filename) {
+  std::ifstream ifs(filename);
+  std::string line;
+  size_t n = 0;
+  while (std::getline(ifs, line)) {
+    ++n;
+  }
+  return n;
+}
+
+class SlowAppender : public cool::LogAppender {
+public:
+  void log(cool::LogEvent::ptr event) override {}
+  void write(const char *data, size_t len) override {
+    usleep(1000);
+    ++count;
+    last.assign(data, len);
+  }
+
+  std::atomic<uint64_t> count = {0};
+  std::string last;
+};
+
+// 多个线程写同一个异步输出器, Flush之后文件里是全部的日志
+void test_log_async() {
+  const std::string filename = "./log_async.txt";
+  remove(filename.c_str());
+  cool::Logger::ptr logger(new cool::Logger("async"));
+  logger->add_appender(cool::LogAppender::ptr(new cool::AsyncLogAppender(
+      cool::LogAppender::ptr(new cool::FileLogAppender(filename)))));
+
+  std::vector<cool::Thread::ptr> thrs;
+  for (int i = 0; i < 4; ++i) {
+    thrs.push_back(cool::Thread::ptr(new cool::Thread(
+        [logger]() {
+          for (int j = 0; j < 10000; ++j) {
+            LOG_INFO(logger) << "async log " << j;
+          }
+        },
+        "async_" + std::to_string(i))));
+  }
+  for (auto &i : thrs) {
+    i->join();
+  }
+  cool::AsyncLogAppender::Flush();
+  ASSERT2(count_lines(filename) == 40000, count_lines(filename));
+
+  // 超过缓冲区一半的日志直接写, 顺序不变
+  LOG_INFO(logger) << "small";
+  LOG_INFO(logger) << std::string(1024 * 1024, 'x');
+  cool::AsyncLogAppender::Flush();
+  ASSERT(count_lines(filename) == 40002);
+
+  // 输出器太慢, 缓冲区满时丢弃, FATAL日志写完才返回
+  auto overflow = cool::Config::lookup<std::string>("log.async.overflow");
+  auto buffer_size = cool::Config::lookup<uint64_t>("log.async.buffer_size");
+  overflow->set_value("drop");
+  buffer_size->set_value(4096);
+  std::shared_ptr<SlowAppender> slow(new SlowAppender);
+  cool::Logger::ptr slow_logger(new cool::Logger("slow"));
+  slow_logger->add_appender(
+      cool::LogAppender::ptr(new cool::AsyncLogAppender(slow)));
+  cool::Thread thr(
+      [slow_logger, slow]() {
+        for (int j = 0; j < 1000; ++j) {
+          LOG_INFO(slow_logger) << "drop log " << j;
+        }
+        LOG_FATAL(slow_logger) << "fatal";
+        ASSERT(slow->last.find("fatal") != std::string::npos);
+      },
+      "async_drop");
+  thr.join();
+  uint64_t dropped = cool::AsyncLogAppender::GetDropped();
+  ASSERT(dropped > 0 && slow->count + dropped == 1001);
+  overflow->set_value("block");
+}
+
+static std::vector<std::string> list_dir(const std::string &dir) {
+  std::vector<std::string> files;
+  DIR *d = opendir(dir.c_str());
+  struct dirent *dp = nullptr;
+  while (d && (dp = readdir(d)) != nullptr) {
+    if (dp->d_name[0] != '.') {
+      files.push_back(dp->d_name);
+    }
+  }
+  if (d) {
+    closedir(d);
+  }
+  return files;
+}
+
+// 超过大小时在后台切分, 旧文件被压缩, 只保留最近的max_files个
+void test_log_rotate() {
+  const std::string dir = "./log_rotate";
+  ASSERT(system(("rm -rf " + dir).c_str()) == 0);
+  mkdir(dir.c_str(), 0755);
+  const std::string filename = dir + "/rotate.txt";
+  cool::Logger::ptr logger(new cool::Logger("rotate"));
+  cool::FileLogAppender::ptr appender(new cool::FileLogAppender(
+      filename, 1024, cool::FileLogAppender::DAILY, 3, true));
+  logger->add_appender(appender);
+  for (int i = 0; i < 200; ++i) {
+    LOG_INFO(logger) << "rotate log " << i;
+    usleep(100);
+  }
+  std::vector<std::string> files;
+  for (int i = 0; i < 100; ++i) {
+    files = list_dir(dir);
+    size_t gz = 0;
+    for (auto &f : files) {
+      gz += f.size() > 3 && f.compare(f.size() - 3, 3, ".gz") == 0;
+    }
+    if (files.size() == 4 && gz == 3) {
+      break;
+    }
+    usleep(20 * 1000);
+  }
+  ASSERT2(files.size() == 4, files.size());
+
+  // 文件被外部删除后重新打开
+  ASSERT(unlink(filename.c_str()) == 0);
+  ASSERT(appender->reopen());
+  LOG_INFO(logger) << "after reopen";
+  ASSERT(count_lines(filename) == 1);
+  ASSERT(system(("rm -rf " + dir).c_str()) == 0);
+}
+
 int main() {
   test_log_2();
+  test_formatter();
+  test_event_reuse();
+  test_log_async();
+  test_log_rotate();
   return 0;
 }
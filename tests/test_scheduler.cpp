@@ -1,10 +1,100 @@
 #include "src/cool.h"
+#include "src/iomanager.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <unistd.h>
 
 cool::Logger::ptr g_logger = LOG_ROOT();
 
 void test_fiber();
+
+// 外部线程提交的任务进全局队列, 工作线程内提交的进本地队列并且会被窃取,
+// 让出的协程回到本地队列, 每个任务都只能执行一次
+void test_run_once() {
+  static const int N = 20000;
+  std::unique_ptr<std::atomic<int>[]> runs(new std::atomic<int>[N]);
+  for (int i = 0; i < N; ++i) {
+    runs[i] = 0;
+  }
+  std::atomic<int>* counts = runs.get();
+  cool::Scheduler sc{4, false, "once"};
+  sc.start();
+  for (int i = 0; i < N / 2; ++i) {
+    sc.schedule([counts, i]() {
+      ++counts[i];
+      int j = i + N / 2;
+      cool::Scheduler::GetThis()->schedule([counts, j]() {
+        if (j % 7 == 0) {
+          cool::Fiber::YieldToReady();
+        }
+        ++counts[j];
+      });
+    });
+  }
+  sc.stop();
+  for (int i = 0; i < N; ++i) {
+    ASSERT2(runs[i] == 1, "task " << i << " ran " << runs[i] << " times");
+  }
+  LOG_INFO(g_logger) << "test_run_once ok";
+}
+
+// 从非工作线程指定线程提交, 任务只能在那个线程上执行
+// 所有线程共用一个epoll时被唤醒的可能是别的线程, 要接力唤醒目标线程, 不能等到epoll超时
+void test_inbox() {
+  cool::IOManager iom{3, false, "inbox"};
+  const std::vector<int> &ids = iom.threadIds();
+  ASSERT(ids.size() == 3);
+  uint64_t max_us = 0;
+  for (int round = 0; round < 50; ++round) {
+    for (int target : ids) {
+      std::atomic<int> ran_on = {0};
+      uint64_t start = cool::GetCurrentUS();
+      iom.schedule([&ran_on]() { ran_on = cool::thread_id(); }, target);
+      while (ran_on == 0) {
+        usleep(100);
+      }
+      max_us = std::max(max_us, cool::GetCurrentUS() - start);
+      ASSERT2(ran_on == target, "expect " << target << " got " << ran_on);
+    }
+  }
+  ASSERT2(max_us < 1000 * 1000, "max latency " << max_us << "us");
+  LOG_INFO(g_logger) << "test_inbox ok, max latency " << max_us << "us";
+}
+
+// 让出的协程放回本线程的收件箱或本地队列, 在它之后提交到本地队列的任务也要能执行,
+// 只有一个工作线程时没有别人来窃取
+void test_yield() {
+  cool::Scheduler sc{1, false, "yield"};
+  sc.start();
+  int tid = sc.threadIds()[0];
+  std::atomic<int> done = {0};
+  std::atomic<int> moved = {0};
+  auto spin = [&done, &moved](int pinned) {
+    std::atomic<bool> flag = {false};
+    cool::Scheduler::GetThis()->schedule([&flag]() { flag = true; });
+    while (!flag) {
+      cool::Fiber::YieldToReady();
+      if (pinned != -1 && cool::thread_id() != pinned) {
+        ++moved;
+      }
+    }
+    ++done;
+  };
+  sc.schedule([spin, tid]() { spin(tid); }, tid);
+  sc.schedule([spin]() { spin(-1); });
+  while (done < 2) {
+    usleep(1000);
+  }
+  sc.stop();
+  ASSERT(moved == 0);
+  LOG_INFO(g_logger) << "test_yield ok";
+}
+
 int main(int argc, char* argv[]) {
+  test_run_once();
+  test_inbox();
+  test_yield();
   LOG_DEBUG(g_logger) << "main start";
   cool::Scheduler sc{3, false, "test"};
   sc.start();
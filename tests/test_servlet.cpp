@@ -0,0 +1,158 @@
+#include "src/cool.h"
+#include "src/http/servlet.h"
+#include <atomic>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+using cool::http::HttpRequest;
+using cool::http::HttpResponse;
+using cool::http::HttpSession;
+using cool::http::Servlet;
+
+static Servlet::ptr make_servlet(const std::string &name) {
+  return Servlet::ptr(new cool::http::FunctionServlet(
+      [name](HttpRequest::ptr req, HttpResponse::ptr rsp,
+             HttpSession::ptr session) {
+        rsp->body(name);
+        return 0;
+      }));
+}
+
+// 返回处理请求的servlet写入的body, 参数写进req
+static std::string dispatch(cool::http::ServletDispatch &sd,
+                            HttpRequest::ptr req, const std::string &path) {
+  HttpResponse::ptr rsp(new HttpResponse);
+  req->path(path);
+  sd.handle(req, rsp, nullptr);
+  if (rsp->status() == cool::http::http_status::NOT_FOUND) {
+    return "404";
+  }
+  return rsp->to_string().substr(rsp->to_string().find("\r\n\r\n") + 4);
+}
+
+void test_router() {
+  cool::http::Router router;
+  auto a = make_servlet("a");
+  auto b = make_servlet("b");
+  auto c = make_servlet("c");
+  ASSERT(router.insert("/user/list", a));
+  ASSERT(router.insert("/user/:id", b));
+  ASSERT(router.insert("/user/:id/posts/:post", c));
+  ASSERT(!router.insert("/user/:name/x", c));
+  ASSERT(!router.insert("/bad/*x/y", c));
+  ASSERT(router.insert("/users", c));
+  ASSERT(router.insert("/static/*file", a));
+
+  cool::http::Router::Params params;
+  ASSERT(router.match("/user/list", &params) == a && params.size == 0);
+  ASSERT(router.match("/user/42", &params) == b && params.size == 1);
+  ASSERT(params.items[0].first == "id" && params.items[0].second == "42");
+  ASSERT(router.match("/user/42/posts/7", &params) == c && params.size == 2);
+  ASSERT(params.items[1].first == "post" && params.items[1].second == "7");
+  // 参数分支匹配失败后不能留下参数
+  ASSERT(router.match("/user/42/posts", &params) == nullptr);
+  ASSERT(router.match("/user/", &params) == nullptr);
+  ASSERT(router.match("/users", &params) == c);
+  ASSERT(router.match("/static/css/a.css", &params) == a && params.size == 1);
+  ASSERT(params.items[0].second == "css/a.css");
+  ASSERT(router.match("/static/", &params) == a);
+  ASSERT(router.match("/static", &params) == nullptr);
+
+  ASSERT(cool::http::Router::IsRouteGlob("/cool/*"));
+  ASSERT(cool::http::Router::IsRouteGlob("/cool*"));
+  ASSERT(!cool::http::Router::IsRouteGlob("/cool/*.html"));
+  ASSERT(!cool::http::Router::IsRouteGlob("/c?ol/*"));
+  ASSERT(!cool::http::Router::IsRouteGlob("/user/:id/*"));
+}
+
+void test_dispatch() {
+  cool::http::ServletDispatch sd;
+  HttpRequest::ptr req(new HttpRequest);
+  sd.add_servlet("/cool/xx", make_servlet("exact"));
+  sd.add_glob_servlet("/cool/*", make_servlet("prefix"));
+  sd.add_glob_servlet("/*", make_servlet("root"));
+  sd.add_glob_servlet("*.html", make_servlet("html"));
+  sd.add_servlet("/user/:id", make_servlet("user"));
+
+  ASSERT(dispatch(sd, req, "/cool/xx") == "exact");
+  ASSERT(dispatch(sd, req, "/cool/yy/zz") == "prefix");
+  ASSERT(dispatch(sd, req, "/other") == "root");
+  ASSERT(dispatch(sd, req, "/user/9") == "user");
+  ASSERT(req->getParam("id") == "9");
+
+  sd.del_glob_servlet("/*");
+  ASSERT(dispatch(sd, req, "/a/b.html") == "html");
+  ASSERT(dispatch(sd, req, "/other") == "404");
+  sd.del_servlet("/cool/xx");
+  ASSERT(dispatch(sd, req, "/cool/xx") == "prefix");
+  ASSERT(sd.get_glob_servlet("/cool/*") && !sd.get_servlet("/cool/xx"));
+
+  sd.set_default_servlet(make_servlet("default"));
+  ASSERT(dispatch(sd, req, "/other") == "default");
+}
+
+// 路由表中的glob和fnmatch的glob之间按添加顺序匹配
+void test_glob_order() {
+  HttpRequest::ptr req(new HttpRequest);
+  cool::http::ServletDispatch sd;
+  sd.add_glob_servlet("*.png", make_servlet("png"));
+  sd.add_glob_servlet("/*", make_servlet("root"));
+  ASSERT(dispatch(sd, req, "/a.png") == "png");
+  ASSERT(dispatch(sd, req, "/a") == "root");
+  // 重新添加的glob排到最后
+  sd.add_glob_servlet("*.png", make_servlet("png"));
+  ASSERT(dispatch(sd, req, "/a.png") == "root");
+
+  cool::http::ServletDispatch sd2;
+  sd2.add_glob_servlet("/img/*", make_servlet("img"));
+  sd2.add_glob_servlet("*.png", make_servlet("png"));
+  sd2.add_glob_servlet("/*", make_servlet("root"));
+  ASSERT(dispatch(sd2, req, "/img/a.png") == "img");
+  ASSERT(dispatch(sd2, req, "/b.png") == "png");
+  ASSERT(dispatch(sd2, req, "/b") == "root");
+  ASSERT(dispatch(sd2, req, "/img/b") == "img");
+}
+
+// 查找的同时不停地增删路由, 快照被替换后旧快照不能还在被读
+void test_concurrent() {
+  cool::http::ServletDispatch sd;
+  auto fixed = make_servlet("fixed");
+  sd.add_servlet("/fixed/:id", fixed);
+  std::atomic<bool> stop = {false};
+  std::atomic<uint64_t> lookups = {0};
+
+  std::vector<cool::Thread::ptr> thrs;
+  for (int i = 0; i < 4; ++i) {
+    thrs.push_back(cool::Thread::ptr(new cool::Thread(
+        [&]() {
+          cool::http::Router::Params params;
+          while (!stop) {
+            cool::Rcu::ReadLock lock;
+            ASSERT(sd.get_matched_servlet("/fixed/1", &params) == fixed);
+            ASSERT(params.size == 1 && params.items[0].first == "id");
+            ++lookups;
+          }
+        },
+        "servlet_" + std::to_string(i))));
+  }
+  for (int i = 0; i < 200; ++i) {
+    std::string path = "/tmp/" + std::to_string(i % 50) + "/:x";
+    sd.add_servlet(path, make_servlet(path));
+    if (i % 3 == 0) {
+      sd.del_servlet(path);
+    }
+  }
+  stop = true;
+  for (auto &i : thrs) {
+    i->join();
+  }
+  LOG_INFO(g_logger) << "lookups=" << lookups;
+}
+
+int main(int argc, char *argv[]) {
+  test_router();
+  test_dispatch();
+  test_glob_order();
+  test_concurrent();
+  return 0;
+}
@@ -0,0 +1,46 @@
+#include "src/cool.h"
+#include "src/stack_allocator.h"
+#include <cstring>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+void test_reuse() {
+  cool::MmapStackAllocator alloc;
+  size_t size = 128 * 1024;
+  void *a = alloc.alloc(size);
+  memset(a, 0x5a, size);
+  alloc.dealloc(a, size);
+  ASSERT(cool::MmapStackAllocator::CachedCount() == 1);
+  void *b = alloc.alloc(size);
+  ASSERT(a == b);
+  ASSERT(cool::MmapStackAllocator::CachedCount() == 0);
+  // 除栈顶常驻部分外, 其余页已经被MADV_DONTNEED清零
+  ASSERT(((char *)b)[0] == 0);
+  ASSERT(((char *)b)[size - 1] == 0x5a);
+  alloc.dealloc(b, size);
+  LOG_INFO(g_logger) << "test_reuse ok";
+}
+
+void test_guard_page() {
+  pid_t pid = fork();
+  if (pid == 0) {
+    cool::MmapStackAllocator alloc;
+    char *p = (char *)alloc.alloc(64 * 1024);
+    // 写到栈底之下的保护页
+    *(volatile char *)(p - 1) = 1;
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+  LOG_INFO(g_logger) << "test_guard_page ok";
+}
+
+int main(int argc, char *argv[]) {
+  test_reuse();
+  test_guard_page();
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include "src/cool.h"
+#include "src/iomanager.h"
+#include "src/util.h"
+#include <atomic>
+#include <cstdlib>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+static std::atomic<int> s_fired{0};
+static std::atomic<int> s_late{0};
+static std::atomic<int> s_early{0};
+
+// 大量随机到期时间的定时器, 覆盖第0层和第1层的下放
+void test_wheel() {
+  const int count = 2000;
+  {
+    cool::IOManager iom(2, false, "timer");
+    std::vector<cool::Timer::ptr> canceled;
+    for (int i = 0; i < count; ++i) {
+      uint64_t ms = rand() % 700;
+      uint64_t deadline = cool::GetCurrentMS() + ms;
+      iom.addTimer(ms, [deadline]() {
+        uint64_t now = cool::GetCurrentMS();
+        if (now < deadline) {
+          ++s_early;
+        } else if (now > deadline + 50) {
+          ++s_late;
+        }
+        ++s_fired;
+      });
+      // 再放一个会被取消的远期定时器(第2层)
+      canceled.push_back(iom.addTimer(60 * 1000 + ms, []() { ASSERT(false); }));
+    }
+    for (auto &i : canceled) {
+      ASSERT(i->cancel());
+      ASSERT(!i->cancel());
+    }
+  }
+  LOG_INFO(g_logger) << "test_wheel fired=" << s_fired << " early=" << s_early
+                     << " late=" << s_late;
+  ASSERT(s_fired == count && s_early == 0);
+}
+
+void test_recurring_reset() {
+  std::atomic<int> ticks{0};
+  uint64_t begin = cool::GetCurrentMS();
+  {
+    cool::IOManager iom(1, false, "timer");
+    cool::Timer::ptr timer;
+    timer = iom.addTimer(
+        20,
+        [&timer, &ticks]() {
+          if (++ticks == 3) {
+            // 之后每次间隔改为50ms
+            timer->reset(50, true);
+          } else if (ticks == 5) {
+            timer->cancel();
+          }
+        },
+        true);
+    cool::Timer::ptr refreshed = iom.addTimer(100, [begin]() {
+      ASSERT(cool::GetCurrentMS() >= begin + 150);
+    });
+    iom.schedule([refreshed]() {
+      usleep(50 * 1000);
+      ASSERT(refreshed->refresh());
+    });
+  }
+  uint64_t used = cool::GetCurrentMS() - begin;
+  LOG_INFO(g_logger) << "test_recurring_reset ticks=" << ticks
+                     << " used=" << used;
+  ASSERT(ticks == 5 && used >= 160);
+}
+
+int main(int argc, char *argv[]) {
+  cool::Logger::ptr sys = LOG_NAME("system");
+  sys->set_level(cool::LogLevel::INFO);
+  test_wheel();
+  test_recurring_reset();
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include "src/cool.h"
+#include "src/work_steal_queue.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+cool::Logger::ptr g_logger = LOG_ROOT();
+
+void test_owner() {
+  cool::WorkStealQueue<size_t> q(2);
+  size_t v = 0;
+  ASSERT(!q.pop(v) && !q.steal(v) && q.empty());
+  // 超过初始容量时扩容, 已有的元素不能丢
+  for (size_t i = 0; i < 100; ++i) {
+    q.push(i);
+  }
+  ASSERT(q.size() == 100);
+  // 拥有者从队尾取(LIFO), 窃取者从队头取(FIFO)
+  ASSERT(q.pop(v) && v == 99);
+  ASSERT(q.steal(v) && v == 0);
+  for (size_t i = 98; i > 0; --i) {
+    ASSERT(q.pop(v) && v == i);
+  }
+  ASSERT(!q.pop(v) && !q.steal(v) && q.empty());
+  LOG_INFO(g_logger) << "test_owner ok";
+}
+
+// 拥有者一边push一边pop, 多个线程同时steal, 每个元素只能被取走一次
+void test_steal() {
+  static const size_t N = 200000;
+  cool::WorkStealQueue<size_t> q(4);
+  std::unique_ptr<std::atomic<int>[]> taken(new std::atomic<int>[N]);
+  for (size_t i = 0; i < N; ++i) {
+    taken[i] = 0;
+  }
+  std::atomic<bool> done = {false};
+  std::atomic<size_t> stolen = {0};
+
+  std::vector<cool::Thread::ptr> thrs;
+  for (int i = 0; i < 3; ++i) {
+    thrs.push_back(cool::Thread::ptr(new cool::Thread(
+        [&]() {
+          size_t v = 0;
+          while (true) {
+            if (q.steal(v)) {
+              ASSERT(v < N);
+              ++taken[v];
+              ++stolen;
+            } else if (done) {
+              break;
+            }
+          }
+        },
+        "thief_" + std::to_string(i))));
+  }
+
+  size_t v = 0;
+  for (size_t i = 0; i < N; ++i) {
+    q.push(i);
+    // 经常把队列取到只剩0或1个, 和窃取者争最后一个元素
+    if (i % 3 != 0 && q.pop(v)) {
+      ASSERT(v < N);
+      ++taken[v];
+    }
+  }
+  while (q.pop(v)) {
+    ASSERT(v < N);
+    ++taken[v];
+  }
+  done = true;
+  for (auto &i : thrs) {
+    i->join();
+  }
+  ASSERT(q.empty());
+  for (size_t i = 0; i < N; ++i) {
+    ASSERT2(taken[i] == 1, "item " << i << " taken " << taken[i] << " times");
+  }
+  LOG_INFO(g_logger) << "test_steal ok, stolen=" << stolen;
+}
+
+int main(int argc, char *argv[]) {
+  test_owner();
+  test_steal();
+  return 0;
+}